@@ -0,0 +1,36 @@
+#!/bin/sh
+# Ahead-of-time translation with pm0toc against the interpreter and the JIT
+# on every bench/*.txt program, compiled with -O. The translated program's
+# output and final registers and stack (-f) on bench/<name>.in must match
+# quiet interpretation. The times are the best of 5 runs on the inputs in
+# bench/common.sh, gcc is the time to build the translation with -O2. Run
+# from the repository root after `make bench`.
+
+. bench/common.sh
+
+# the translated program takes no -m, so it gets a wrapper that drops it
+cat > /tmp/pm0_aot.sh << 'SCRIPT'
+#!/bin/sh
+exec /tmp/pm0_aot
+SCRIPT
+chmod +x /tmp/pm0_aot.sh
+
+printf "%-10s %6s %8s %8s %8s %8s\n" "program" "check" "quiet" "jit" "aot" "gcc"
+for src in bench/*.txt
+do
+  name=$(basename "$src" .txt)
+  input=$(large "$name")
+  ./lex "$src" || exit 1
+  ./pcg -O > /dev/null || exit 1
+  ./pm0toc -o /tmp/pm0_aot.c || exit 1
+
+  t0=$(ms); gcc -O2 /tmp/pm0_aot.c -o /tmp/pm0_aot || exit 1; t1=$(ms)
+
+  check=ok
+  ./vm -m quiet -f < "bench/$name.in" > /tmp/pm0_quiet.txt
+  /tmp/pm0_aot -f < "bench/$name.in" > /tmp/pm0_native.txt
+  cmp -s /tmp/pm0_quiet.txt /tmp/pm0_native.txt || check=FAIL
+
+  printf "%-10s %6s %8d %8d %8d %8d\n" "$name" "$check" $(best ./vm "$input") $(best ./vm "$input" jit) $(best /tmp/pm0_aot.sh "$input") $((t1 - t0))
+done
+rm -f /tmp/pm0_aot.sh /tmp/pm0_aot.c /tmp/pm0_aot /tmp/pm0_quiet.txt /tmp/pm0_native.txt
@@ -0,0 +1,46 @@
+#!/bin/sh
+# Many short runs of every bench/*.txt program (compiled with -O): one ./vm
+# process per input against vmbatch -p, which loads the program once per
+# thread and runs it on each input, on one thread and on every CPU. The
+# inputs are 1..200 plus the program's bench/<name>.in, and every vmbatch
+# run's output must match the ./vm run on the same input. Times are wall
+# clock for the whole set. Run from the repository root after `make bench`.
+
+. bench/common.sh
+
+jobs=$(getconf _NPROCESSORS_ONLN)
+mkdir -p /tmp/pm0_batch
+printf "%-10s %6s %6s %8s %8s %8s\n" "program" "check" "runs" "vm" "batch-1" "batch-$jobs"
+for src in bench/*.txt
+do
+  name=$(basename "$src" .txt)
+  ./lex "$src" || exit 1
+  ./pcg -O > /dev/null || exit 1
+
+  rm -f /tmp/pm0_batch/*
+  cp "bench/$name.in" /tmp/pm0_batch/0
+  for n in $(seq 1 200)
+  do
+    echo $n > /tmp/pm0_batch/$n
+  done
+  inputs=$(ls /tmp/pm0_batch | sort -n | sed 's|^|/tmp/pm0_batch/|')
+
+  t0=$(ms)
+  for input in $inputs
+  do
+    echo "== $input (status 0)"
+    ./vm -m quiet < "$input"
+  done > /tmp/pm0_processes.txt
+  t1=$(ms)
+  ./vmbatch -j 1 -p elf.txt $inputs > /tmp/pm0_batch1.txt 2> /dev/null
+  t2=$(ms)
+  ./vmbatch -j "$jobs" -p elf.txt $inputs > /tmp/pm0_batchn.txt 2> /dev/null
+  t3=$(ms)
+
+  check=ok
+  cmp -s /tmp/pm0_processes.txt /tmp/pm0_batch1.txt || check=FAIL
+  cmp -s /tmp/pm0_processes.txt /tmp/pm0_batchn.txt || check=FAIL
+
+  printf "%-10s %6s %6d %8d %8d %8d\n" "$name" "$check" $(echo $inputs | wc -w) $((t1 - t0)) $((t2 - t1)) $((t3 - t2))
+done
+rm -rf /tmp/pm0_batch /tmp/pm0_processes.txt /tmp/pm0_batch1.txt /tmp/pm0_batchn.txt
@@ -0,0 +1,46 @@
+# Helpers shared by the timing scripts in bench/, sourced from the
+# repository root.
+
+ms()
+{
+  echo $(( $(date +%s%N) / 1000000 ))
+}
+
+# best of 5 quiet runs of $1 (plus any flags in $3) reading $2, in ms
+best()
+{
+  fastest=999999
+  for run in 1 2 3 4 5
+  do
+    t0=$(ms); echo "$2" | $1 -m ${3:-quiet} > /dev/null; t1=$(ms)
+    [ $((t1 - t0)) -lt $fastest ] && fastest=$((t1 - t0))
+  done
+  echo $fastest
+}
+
+# median of 11 quiet runs of $1 (plus any flags in $3) reading $2, in ms,
+# for comparisons small enough that a best-of-5 can land either way
+median()
+{
+  times=""
+  for run in 1 2 3 4 5 6 7 8 9 10 11
+  do
+    t0=$(ms); echo "$2" | $1 -m ${3:-quiet} > /dev/null; t1=$(ms)
+    times="$times $((t1 - t0))"
+  done
+  echo $times | tr ' ' '\n' | sort -n | sed -n 6p
+}
+
+# input for timing, large enough to run for a while
+large()
+{
+  case $1 in
+    dist) echo 300000 ;;
+    fib) echo 1000000 ;;
+    nested) echo 1200 ;;
+    poly) echo 400000 ;;
+    spin) echo 3000000 ;;
+    sqrt) echo 200000 ;;
+    *) cat "bench/$1.in" ;;
+  esac
+}
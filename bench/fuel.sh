@@ -0,0 +1,48 @@
+#!/bin/sh
+# Cost of the fuel checks (./vm -n and -e) on every bench/*.txt program
+# compiled with -O: quiet and JIT runs with no limits, then with limits too
+# high to be reached, where the JIT also compiles the checks in. Limited runs
+# must print the same as unlimited ones, and every mode must stop at the same
+# place once a run is over its limit, with superinstructions fused or not
+# (-u) on a loop closed by a backward JPC, which pcg never emits. Times are the best of 5 runs on the
+# inputs in bench/common.sh. Run from the repository root after `make bench`.
+
+. bench/common.sh
+
+limits="-n 1000000000000 -e 3600000"
+printf "%-10s %6s %8s %8s %8s %8s\n" "program" "check" "quiet" "limited" "jit" "limited"
+for src in bench/*.txt
+do
+  name=$(basename "$src" .txt)
+  input=$(large "$name")
+  ./lex "$src" || exit 1
+  ./pcg -O > /dev/null || exit 1
+
+  check=ok
+  ./vm -m quiet -f < "bench/$name.in" > /tmp/pm0_free.txt
+  for mode in quiet jit tiered
+  do
+    ./vm -m $mode -f $limits < "bench/$name.in" | cmp -s - /tmp/pm0_free.txt || check=FAIL
+    echo "$input" | ./vm -m $mode -b -n 1000000 | tail -n 1 > /tmp/pm0_stop_$mode.txt
+  done
+  cmp -s /tmp/pm0_stop_quiet.txt /tmp/pm0_stop_jit.txt || check=FAIL
+  cmp -s /tmp/pm0_stop_quiet.txt /tmp/pm0_stop_tiered.txt || check=FAIL
+
+  printf "%-10s %6s %8d %8d %8d %8d\n" "$name" "$check" $(best ./vm "$input") $(best ./vm "$input" "quiet $limits") \
+    $(best ./vm "$input" jit) $(best ./vm "$input" "jit $limits")
+done
+
+# i := i + 1 until n <= i, with the comparison and the JPC back fused into one
+# superinstruction in verified runs
+printf "7 0 3\n6 0 5\n1 0 1000\n4 0 4\n1 0 0\n4 0 3\n3 0 3\n1 0 1\n2 0 1\n4 0 3\n3 0 4\n3 0 3\n2 0 8\n8 0 18\n3 0 3\n9 0 1\n9 0 3\n" > /tmp/pm0_branch.txt
+check=ok
+for limit in $(seq 1 40)
+do
+  ./vm -m quiet -u -b -n $limit -p /tmp/pm0_branch.txt < /dev/null | tail -n 1 > /tmp/pm0_stop_unfused.txt
+  for mode in quiet jit
+  do
+    ./vm -m $mode -b -n $limit -p /tmp/pm0_branch.txt < /dev/null | tail -n 1 | cmp -s - /tmp/pm0_stop_unfused.txt || check=FAIL
+  done
+done
+printf "%-10s %6s\n" "backjpc" "$check"
+rm -f /tmp/pm0_free.txt /tmp/pm0_stop_*.txt /tmp/pm0_branch.txt
@@ -0,0 +1,89 @@
+#!/bin/sh
+# Incremental compilation (parsercodegen_complete.c -i). A program of 600
+# procedures, some with procedures declared in them, is compiled in full,
+# then with -i into an empty elf.cache, again with nothing changed, and
+# after editing one procedure, when only that one is parsed and generated.
+# Every build must write the elf.txt a full compile of the same source does.
+# Times are the best of 5 compiles, wall clock, not counting ./lex. Run from
+# the repository root after `make bench`.
+
+. bench/common.sh
+
+root=$(pwd)
+dir=/tmp/pm0_incremental
+rm -rf $dir
+mkdir -p $dir
+
+# $1 procedures f1 to f$1 adding to a, every fourth with a helper g of its
+# own, and main statements calling every one of them. $2 is added to what
+# procedure $3 adds, an edit to one procedure
+program()
+{
+  awk -v n=$1 -v extra=$2 -v edited=$3 'BEGIN {
+    printf "var a;\n"
+    for(k = 1; k <= n; ++k)
+    {
+      add = k % 7 + (k == edited ? extra : 0)
+      printf "procedure f%d;\n  var i, s;\n", k
+      if(k % 4 == 0)
+        printf "  procedure g%d;\n  begin\n    s := s + i * %d\n  end;\n", k, k % 5
+      printf "begin\n  i := 0;\n  s := 0;\n  while i < %d do\n  begin\n", k % 3 + 1
+      if(k % 4 == 0) printf "    call g%d;\n", k
+      else printf "    s := s + i;\n"
+      printf "    i := i + 1\n  end;\n  a := a + s + %d\n", add
+      if(k > 1 && k % 10 == 0) printf ";\n  if a > 30000 then a := a - 30000 else fi\n"
+      printf "end;\n"
+    }
+    printf "begin\n  a := 0;\n"
+    for(k = 1; k <= n; ++k) printf "  call f%d;\n", k
+    printf "  write a\nend.\n"
+  }'
+}
+
+# best of 5 compiles in $dir of token_list.txt, with pcg flags $1, each from
+# the cache in $2 if given, with no cache if it's "none"
+compile()
+{
+  fastest=999999
+  for run in 1 2 3 4 5
+  do
+    case "$2" in
+      "") ;;
+      none) rm -f elf.cache ;;
+      *) cp "$2" elf.cache ;;
+    esac
+    t0=$(ms); "$root/pcg" $1 > /dev/null; t1=$(ms)
+    [ $((t1 - t0)) -lt $fastest ] && fastest=$((t1 - t0))
+  done
+  echo $fastest
+}
+
+cd $dir
+procedures=600
+program $procedures 0 0 > before.txt
+program $procedures 3 $((procedures / 2)) > after.txt
+
+"$root/lex" before.txt > /dev/null
+full=$(compile "")
+cp elf.txt full.txt
+cold=$(compile -i none)
+check=ok
+cmp -s elf.txt full.txt || check=FAIL
+cp elf.cache before.cache
+warm=$(compile -i before.cache)
+cmp -s elf.txt full.txt || check=FAIL
+echo 0 | "$root/vm" -m quiet -s 200000 -d 1000 > before.out || check=FAIL
+
+"$root/lex" after.txt > /dev/null
+"$root/pcg" > /dev/null && cp elf.txt full.txt
+edit=$(compile -i before.cache)
+cmp -s elf.txt full.txt || check=FAIL
+echo 0 | "$root/vm" -m quiet -s 200000 -d 1000 | cmp -s - before.out && check=FAIL # the edit shows
+cp before.cache elf.cache
+"$root/pcg" -i | grep Procedures
+
+echo
+printf "%-10s %6s %8s %8s %8s %8s\n" "procedures" "check" "full" "cold" "warm" "edit"
+printf "%-10d %6s %8d %8d %8d %8d\n" $procedures "$check" $full $cold $warm $edit
+cd "$root"
+rm -rf $dir
@@ -0,0 +1,37 @@
+#!/bin/sh
+# Batch I/O (-b) against interactive READ and PRINT on bench/io/readsum.txt,
+# which reads 1000000 numbers and prints a running sum after each. Without
+# the prompts, the -b output must match the interactive one. Times are the
+# best of 5 runs, quiet and JIT, reading the numbers from a file. Run from
+# the repository root after `make bench`.
+
+. bench/common.sh
+
+count=1000000
+awk -v n=$count 'BEGIN { print n; srand(1); for(i = 0; i < n; ++i) print int(rand()*2000001) - 1000000 }' > /tmp/pm0_io.in
+
+# best of 5 runs of ./vm with the flags in $1, in ms
+bestio()
+{
+  fastest=999999
+  for run in 1 2 3 4 5
+  do
+    t0=$(ms); ./vm $1 -i /tmp/pm0_io.in > /dev/null; t1=$(ms)
+    [ $((t1 - t0)) -lt $fastest ] && fastest=$((t1 - t0))
+  done
+  echo $fastest
+}
+
+./lex bench/io/readsum.txt || exit 1
+./pcg -O > /dev/null || exit 1
+
+check=ok
+./vm -m quiet -i /tmp/pm0_io.in | sed 's/Please Enter an Integer: //g' > /tmp/pm0_io_prompted.txt
+./vm -m quiet -b -i /tmp/pm0_io.in > /tmp/pm0_io_batch.txt
+cmp -s /tmp/pm0_io_prompted.txt /tmp/pm0_io_batch.txt || check=FAIL
+./vm -m jit -b -i /tmp/pm0_io.in > /tmp/pm0_io_batch.txt
+cmp -s /tmp/pm0_io_prompted.txt /tmp/pm0_io_batch.txt || check=FAIL
+
+printf "%-10s %6s %8s %8s %8s %8s\n" "program" "check" "quiet" "quiet-b" "jit" "jit-b"
+printf "%-10s %6s %8d %8d %8d %8d\n" "readsum" "$check" $(bestio "-m quiet") $(bestio "-m quiet -b") $(bestio "-m jit") $(bestio "-m jit -b")
+rm -f /tmp/pm0_io.in /tmp/pm0_io_prompted.txt /tmp/pm0_io_batch.txt
@@ -0,0 +1,29 @@
+#!/bin/sh
+# JIT versus the interpreter on every bench/*.txt program, plain and
+# compiled with -O. The JIT's output and final registers and stack (-f) on
+# bench/<name>.in must match quiet interpretation. The times are the best of
+# 5 runs on the inputs in bench/common.sh. Run from the repository root
+# after `make bench`.
+
+. bench/common.sh
+
+printf "%-10s %6s %8s %8s %8s %8s\n" "program" "check" "ms" "jit" "-O ms" "jit"
+for src in bench/*.txt
+do
+  name=$(basename "$src" .txt)
+  input=$(large "$name")
+  ./lex "$src" || exit 1
+
+  check=ok
+  for flags in "" -O
+  do
+    ./pcg $flags > /dev/null || exit 1
+    ./vm -m quiet -f < "bench/$name.in" > /tmp/pm0_interp.txt
+    ./vm -m jit -f < "bench/$name.in" > /tmp/pm0_jit.txt
+    cmp -s /tmp/pm0_interp.txt /tmp/pm0_jit.txt || check=FAIL
+    [ -z "$flags" ] && plain="$(best ./vm "$input") $(best ./vm "$input" jit)"
+  done
+
+  printf "%-10s %6s %8d %8d %8d %8d\n" "$name" "$check" $plain $(best ./vm "$input") $(best ./vm "$input" jit)
+done
+rm -f /tmp/pm0_interp.txt /tmp/pm0_jit.txt
@@ -0,0 +1,140 @@
+#!/bin/sh
+# Separate compilation (parsercodegen_complete.c -c) and ./pl0ld. A program
+# of a few modules calling each other, with its own variables and main
+# statements in each, must print what the same program written as one
+# source file does, and so must a module calling a procedure it declares
+# after the call. Then a program of 200 modules is built: every module one
+# after another, all of them on every CPU, and again after changing nothing
+# and after changing one module, when only that one is recompiled before
+# linking. Times are wall clock. Run from the repository root after
+# `make bench`.
+
+. bench/common.sh
+
+jobs=$(getconf _NPROCESSORS_ONLN)
+root=$(pwd)
+dir=/tmp/pm0_link
+rm -rf $dir
+mkdir -p $dir
+
+# module $1 of $2: procedure p$1 adds to its variable and calls p of the
+# module before it, f$1n1 to f$1n$3 loop over it, and the main statements
+# start it off; the last module calls into every other one. $4 of proc or
+# main writes the procedures or statements alone, for putting the modules
+# together into one source file
+module()
+{
+  awk -v k=$1 -v n=$2 -v procs=$3 -v part=$4 'BEGIN {
+    if(part == "") printf "var a%d;\n", k
+    if(part == "" || part == "proc")
+    {
+      printf "procedure p%d;\nbegin\n  a%d := a%d + %d;\n  write a%d", k, k, k, k + 1, k
+      if(k > 0) printf ";\n  call p%d", k - 1
+      printf "\nend;\n"
+      for(j = 1; j <= procs; ++j)
+        printf "procedure f%dn%d;\n  var i;\nbegin\n  i := 0;\n  while i < %d do\n  begin\n    a%d := a%d + i * %d - %d / 3;\n    i := i + 1\n  end\nend;\n", k, j, j, k, k, j, k
+    }
+    if(part == "" || part == "main")
+    {
+      if(part == "") printf "begin\n"
+      printf "  a%d := %d;\n", k, 10*k
+      for(j = 1; j <= procs; ++j) printf "  call f%dn%d;\n", k, j
+      if(k == n - 1) printf "  call p%d;\n", k
+      printf "  write a%d", k
+      if(part == "") printf "\nend.\n"
+    }
+  }'
+}
+
+# compiles $dir/src/m$1.txt to $dir/obj/m$1.o in a directory of its own,
+# lex and pcg always write to the current one
+cat > $dir/compile.sh <<END
+mkdir -p $dir/build/m\$1 && cd $dir/build/m\$1 &&
+"$root/lex" $dir/src/m\$1.txt > /dev/null && "$root/pcg" -c -O > /dev/null && mv elf.o $dir/obj/m\$1.o
+END
+
+# every module whose source changed since its object was written, on every CPU
+build()
+{
+  for k in $(seq 0 $(($1 - 1)))
+  do
+    [ ! -f $dir/obj/m$k.o ] || [ $dir/src/m$k.txt -nt $dir/obj/m$k.o ] && echo $k
+  done | xargs -P "$jobs" -I {} sh $dir/compile.sh {}
+}
+
+objects()
+{
+  for k in $(seq 0 $(($1 - 1))); do printf "$dir/obj/m$k.o "; done
+}
+
+# the same program as modules and as one file
+mkdir -p $dir/src $dir/obj
+modules=4
+{
+  printf "var a0"
+  for k in $(seq 1 $((modules - 1))); do printf ", a$k"; done
+  echo ";"
+  for k in $(seq 0 $((modules - 1))); do module $k $modules 2 proc; done
+  echo "begin"
+  for k in $(seq 0 $((modules - 1))); do module $k $modules 2 main; [ $k -lt $((modules - 1)) ] && echo ";"; done
+  printf "\nend.\n"
+} > $dir/whole.txt
+for k in $(seq 0 $((modules - 1))); do module $k $modules 2 > $dir/src/m$k.txt; done
+./lex $dir/whole.txt > /dev/null && ./pcg -O > /dev/null || exit 1
+./vm -m quiet -f -s 5000 > $dir/whole.out
+build $modules
+./pl0ld -o $dir/linked.bin $(objects $modules) || exit 1
+check=ok
+./vm -m quiet -f -s 5000 -p $dir/linked.bin | cmp -s - $dir/whole.out || check=FAIL
+
+# p calls q before q is declared: compiled alone and linked alone it must
+# print what it does with q declared first
+forward()
+{
+  printf "var a;\n"
+  [ $1 = first ] && printf "procedure q;\nbegin\n  a := a * 3\nend;\n"
+  printf "procedure p;\nbegin\n  a := a + 1;\n  call q\nend;\n"
+  [ $1 = later ] && printf "procedure q;\nbegin\n  a := a * 3\nend;\n"
+  printf "begin\n  a := 4;\n  call p;\n  call q;\n  write a\nend.\n"
+}
+forward first > $dir/first.txt
+forward later > $dir/src/mforward.txt
+./lex $dir/first.txt > /dev/null && ./pcg > /dev/null || exit 1
+./vm -m quiet -f > $dir/first.out
+sh $dir/compile.sh forward || exit 1
+./pl0ld -o $dir/forward.bin $dir/obj/mforward.o || exit 1
+./vm -m quiet -f -p $dir/forward.bin | cmp -s - $dir/first.out || check=FAIL
+printf "%-10s %6s\n" "modules" "check"
+printf "%-10d %6s\n" $modules "$check"
+
+# one large program
+rm -rf $dir/src $dir/obj $dir/build
+mkdir -p $dir/src $dir/obj
+modules=200
+for k in $(seq 0 $((modules - 1))); do module $k $modules 8 > $dir/src/m$k.txt; done
+t0=$(ms)
+for k in $(seq 0 $((modules - 1))); do sh $dir/compile.sh $k || exit 1; done
+./pl0ld -o $dir/linked.bin $(objects $modules) || exit 1
+t1=$(ms)
+./vm -m quiet -s 200000 -d 1000 -p $dir/linked.bin > $dir/first.out || exit 1
+rm -f $dir/obj/*
+t2=$(ms)
+build $modules
+./pl0ld -o $dir/linked.bin $(objects $modules) || exit 1
+t3=$(ms)
+build $modules
+./pl0ld -o $dir/linked.bin $(objects $modules) || exit 1
+t4=$(ms)
+sleep 1 # a newer modification time than the object's
+echo "" >> $dir/src/m57.txt
+t5=$(ms)
+build $modules
+./pl0ld -o $dir/linked.bin $(objects $modules) || exit 1
+t6=$(ms)
+check=ok
+./vm -m quiet -s 200000 -d 1000 -p $dir/linked.bin | cmp -s - $dir/first.out || check=FAIL
+
+echo
+printf "%-8s %6s %8s %8s %8s %8s\n" "modules" "check" "serial" "cpus-$jobs" "none" "one"
+printf "%-8d %6s %8d %8d %8d %8d\n" $modules "$check" $((t1 - t0)) $((t3 - t2)) $((t4 - t3)) $((t6 - t5))
+rm -rf $dir
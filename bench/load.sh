@@ -0,0 +1,55 @@
+#!/bin/sh
+# Loading elf.txt against the same program as a binary executable (./vm -w,
+# or parsercodegen_complete.c -b): every bench/*.txt program must print the
+# same from either, then straight-line programs of up to 2 million
+# instructions, half of them with constants too wide to pack, are loaded and
+# run quietly from each. Times are the best of 5 runs. Run from the
+# repository root after `make bench`.
+
+. bench/common.sh
+
+printf "%-10s %6s\n" "program" "check"
+for src in bench/*.txt
+do
+  name=$(basename "$src" .txt)
+  ./lex "$src" || exit 1
+  ./pcg -O > /dev/null || exit 1
+  ./vm -m quiet -f < "bench/$name.in" > /tmp/pm0_text.txt
+  ./pcg -O -b > /dev/null || exit 1
+  check=ok
+  ./vm -m quiet -f -p elf.bin < "bench/$name.in" | cmp -s - /tmp/pm0_text.txt || check=FAIL
+  printf "%-10s %6s\n" "$name" "$check"
+done
+
+# best of 5 ./vm runs with flags $1, in ms
+fastest()
+{
+  least=999999
+  for run in 1 2 3 4 5
+  do
+    t0=$(ms); ./vm -m quiet $1 > /dev/null; t1=$(ms)
+    [ $((t1 - t0)) -lt $least ] && least=$((t1 - t0))
+  done
+  echo $least
+}
+
+echo
+printf "%-12s %6s %10s %10s %8s %8s\n" "instructions" "check" "text-KB" "binary-KB" "text" "binary"
+for pairs in 1000 100000 1000000
+do
+  # x := i for every i, the odd ones past what 16 bits hold, then write x
+  awk -v n=$pairs 'BEGIN { print "7 0 3"; print "6 0 4"
+                           for(i = 0; i < n; ++i) { print "1 0", (i % 2 ? 100000 + i : i); print "4 0 3" }
+                           print "3 0 3"; print "9 0 1"; print "9 0 3" }' > /tmp/pm0_load.txt
+  words=$((6*pairs + 100))
+  ./vm -s $words -p /tmp/pm0_load.txt -w /tmp/pm0_load.bin || exit 1
+
+  check=ok
+  ./vm -m quiet -s $words -p /tmp/pm0_load.txt > /tmp/pm0_text.txt
+  ./vm -m quiet -s $words -p /tmp/pm0_load.bin | cmp -s - /tmp/pm0_text.txt || check=FAIL
+
+  printf "%-12d %6s %10d %10d %8d %8d\n" $((2*pairs + 5)) "$check" \
+    $(($(wc -c < /tmp/pm0_load.txt) / 1024)) $(($(wc -c < /tmp/pm0_load.bin) / 1024)) \
+    $(fastest "-s $words -p /tmp/pm0_load.txt") $(fastest "-s $words -p /tmp/pm0_load.bin")
+done
+rm -f /tmp/pm0_load.txt /tmp/pm0_load.bin /tmp/pm0_text.txt elf.bin
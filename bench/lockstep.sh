@@ -0,0 +1,38 @@
+#!/bin/sh
+# Lockstep lanes (vmbatch -w) against one run at a time on every bench/*.txt
+# program, compiled with -O. Each program runs on 1024 inputs close to each
+# other, 4 times its bench/<name>.in plus 0 to 15, as a batch of similar
+# jobs would be. Every -w run's output must match the one without. Times are
+# the wall time vmbatch reports for the whole batch on one thread. Run from
+# the repository root after `make bench`.
+
+. bench/common.sh
+
+mkdir -p /tmp/pm0_lanes
+printf "%-10s %6s %8s %8s %8s %8s\n" "program" "check" "w1" "w8" "w64" "w256"
+for src in bench/*.txt
+do
+  name=$(basename "$src" .txt)
+  ./lex "$src" || exit 1
+  ./pcg -O > /dev/null || exit 1
+
+  rm -f /tmp/pm0_lanes/*
+  base=$(( $(cat "bench/$name.in") * 4 ))
+  for k in $(seq 1 1024)
+  do
+    echo $((base + k % 16)) > /tmp/pm0_lanes/$k
+  done
+  inputs=$(ls /tmp/pm0_lanes | sort -n | sed 's|^|/tmp/pm0_lanes/|')
+
+  check=ok
+  times=""
+  for w in 1 8 64 256
+  do
+    time=$(./vmbatch -j 1 -w $w -p elf.txt $inputs 2>&1 > /tmp/pm0_lanes_$w.txt | sed 's/.* in \([0-9]*\).*/\1/')
+    times="$times $time"
+    cmp -s /tmp/pm0_lanes_1.txt /tmp/pm0_lanes_$w.txt || check=FAIL
+  done
+
+  printf "%-10s %6s %8d %8d %8d %8d\n" "$name" "$check" $times
+done
+rm -rf /tmp/pm0_lanes /tmp/pm0_lanes_*.txt
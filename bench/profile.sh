@@ -0,0 +1,29 @@
+#!/bin/sh
+# Cost of ./vm -m profile on every bench/*.txt program. A profiled run's
+# output and final registers and stack (-f) on bench/<name>.in must match
+# quiet interpretation, and the instruction counts in profile.txt must add up
+# to its total. The times are the best of 5 runs on the inputs in
+# bench/common.sh. Run from the repository root after `make bench`.
+
+. bench/common.sh
+
+printf "%-10s %6s %8s %8s %8s\n" "program" "check" "quiet" "profile" "x"
+for src in bench/*.txt
+do
+  name=$(basename "$src" .txt)
+  input=$(large "$name")
+  ./lex "$src" || exit 1
+  ./pcg > /dev/null || exit 1
+
+  check=ok
+  ./vm -m quiet -f < "bench/$name.in" > /tmp/pm0_quiet.txt
+  ./vm -m profile -f < "bench/$name.in" > /tmp/pm0_profile.txt
+  cmp -s /tmp/pm0_quiet.txt /tmp/pm0_profile.txt || check=FAIL
+  awk 'NR == 1 { total = $1 } /^Instructions by hits/ { on = 1; next } /^$/ { on = 0 }
+       on && $1 ~ /^[0-9]+$/ { sum += $5 } END { exit sum != total }' profile.txt || check=FAIL
+
+  quiet=$(best ./vm "$input")
+  profile=$(best ./vm "$input" profile)
+  printf "%-10s %6s %8d %8d %8s\n" "$name" "$check" $quiet $profile $(awk "BEGIN { printf \"%.2f\", $profile / ($quiet ? $quiet : 1) }")
+done
+rm -f /tmp/pm0_quiet.txt /tmp/pm0_profile.txt
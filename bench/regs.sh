@@ -0,0 +1,29 @@
+#!/bin/sh
+# Head-to-head of the PM/0 stack backend (vm) and the register backend (rvm):
+# instructions executed and wall time for every bench/*.txt program on
+# bench/<name>.in. Run from the repository root after `make bench`.
+# Both machines stop on stack overflow, but vm verifies PM/0 code before it
+# runs it without further checks, while rvm trusts pcg's register code and
+# never checks its loads, stores, or jumps, so the times favour rvm a little.
+
+ms()
+{
+  echo $(( $(date +%s%N) / 1000000 ))
+}
+
+printf "%-10s %10s %10s %10s %10s\n" "program" "pm0 instr" "reg instr" "pm0 ms" "reg ms"
+for src in bench/*.txt
+do
+  name=$(basename "$src" .txt)
+  ./lex "$src" || exit 1
+
+  ./pcg > /dev/null || exit 1
+  stack=$(./vm < "bench/$name.in" | grep -cE '(LIT|OPR|LOD|STO|CAL|INC|JMP|JPC|SYS|RTN|ADD|SUB|MUL|DIV|EQL|NEQ|LSS|LEQ|GTR|GEQ|EVEN|DUP|LDL|STL|LDG|STG)	')
+  t0=$(ms); ./vm -m quiet < "bench/$name.in" > /dev/null; t1=$(ms)
+
+  ./pcg -r > /dev/null || exit 1
+  reg=$(./rvm -c < "bench/$name.in" 2>&1 >/dev/null | sed 's/[^0-9]//g')
+  t2=$(ms); ./rvm < "bench/$name.in" > /dev/null; t3=$(ms)
+
+  printf "%-10s %10d %10d %10d %10d\n" "$name" "$stack" "$reg" $((t1 - t0)) $((t3 - t2))
+done
@@ -0,0 +1,25 @@
+#!/bin/sh
+# Compiles every bench/*.txt program with and without -O and reports the
+# number of instructions the VM executes for each, using bench/<name>.in
+# as the program's input. Run from the repository root after `make`.
+
+count()
+{
+  # one trace line per executed instruction
+  ./vm | grep -cE '(LIT|OPR|LOD|STO|CAL|INC|JMP|JPC|SYS|RTN|ADD|SUB|MUL|DIV|EQL|NEQ|LSS|LEQ|GTR|GEQ|EVEN|DUP|LDL|STL|LDG|STG)	'
+}
+
+printf "%-10s %10s %10s %8s\n" "program" "plain" "-O" "saved"
+for src in bench/*.txt
+do
+  name=$(basename "$src" .txt)
+  ./lex "$src" || exit 1
+
+  ./pcg > /dev/null || exit 1
+  plain=$(count < "bench/$name.in")
+
+  ./pcg -O > /dev/null || exit 1
+  opt=$(count < "bench/$name.in")
+
+  printf "%-10s %10d %10d %7d%%\n" "$name" "$plain" "$opt" $(( (plain - opt) * 100 / plain ))
+done
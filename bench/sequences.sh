@@ -0,0 +1,42 @@
+#!/bin/sh
+# Profiles which straight-line instruction sequences the bench programs spend
+# their time in, the input for choosing superinstructions (see vm.c). Every
+# bench/*.txt program is compiled with the given pcg flags (none or -O) and
+# traced on bench/<name>.in. Each run of 2 to 5 instructions executed one
+# after another without a jump between them is counted. The totals are
+# printed in descending order. Run from the repository root after `make`.
+
+for src in bench/*.txt
+do
+  name=$(basename "$src" .txt)
+  ./lex "$src" || exit 1
+  ./pcg "$@" > /dev/null || exit 1
+  ./vm -s 500 < "bench/$name.in" | sed 's/^Please Enter an Integer: //' | awk '
+    BEGIN {
+      split("LIT OPR LOD STO CAL INC JMP JPC SYS LDL STL LDG STG", ops, " ")
+      split("RTN ADD SUB MUL DIV EQL NEQ LSS LEQ GTR GEQ EVEN DUP", oprs, " ")
+      n = 0
+      while((getline line < "elf.txt") > 0)
+      {
+        split(line, f, " ")
+        name[n++] = f[1] == 2 ? oprs[f[3] + 1] : ops[f[1]]
+      }
+    }
+    /^Initial values:/ { pc = $3; next }
+    NF < 6 || $1 !~ /^[A-Z]+$/ || $1 == "L" { next }
+    {
+      i = (499 - pc) / 3
+      run = (run > 0 && i == last + 1) ? run + 1 : 1
+      seq[run % 5] = name[i]
+      for(k = 2; k <= 5 && k <= run; ++k)
+      {
+        s = seq[(run - k + 1) % 5]
+        for(j = run - k + 2; j <= run; ++j)
+          s = s " " seq[j % 5]
+        count[s]++
+      }
+      last = i
+      pc = $4
+    }
+    END { for(s in count) print count[s], s }'
+done | awk '{ c = $1; $1 = ""; total[$0] += c } END { for(s in total) print total[s] s }' | sort -rn | head -25
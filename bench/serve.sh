@@ -0,0 +1,47 @@
+#!/bin/sh
+# Many clients of bench/io/readsum.txt at once, each given 100 numbers a line
+# at a time: one ./vm process per client against ./vmserve -c, which steps
+# every client's machine on one thread or on every CPU and suspends it
+# whenever it has read all the input sent so far. Every client's output must
+# match ./vm's on the same input. Times are wall clock for the whole set.
+# Run from the repository root after `make bench`.
+
+. bench/common.sh
+
+ulimit -n 8192 2> /dev/null # two pipe ends per client
+jobs=$(getconf _NPROCESSORS_ONLN)
+awk 'BEGIN { print 100; srand(3); for(i = 0; i < 100; ++i) print int(rand()*2001) - 1000 }' > /tmp/pm0_serve.in
+
+./lex bench/io/readsum.txt || exit 1
+./pcg -O > /dev/null || exit 1
+./vm -m quiet -i /tmp/pm0_serve.in > /tmp/pm0_serve_one.txt
+
+printf "%-8s %6s %8s %8s %8s\n" "clients" "check" "vm" "serve-1" "serve-$jobs"
+for clients in 10 100 1000 3000
+do
+  rm -f /tmp/pm0_serve_expected.txt
+  for k in $(seq 0 $((clients - 1)))
+  do
+    echo "== client $k (status 0)" >> /tmp/pm0_serve_expected.txt
+    cat /tmp/pm0_serve_one.txt >> /tmp/pm0_serve_expected.txt
+  done
+
+  t0=$(ms)
+  for k in $(seq 1 $clients)
+  do
+    ./vm -m quiet < /tmp/pm0_serve.in > /dev/null &
+  done
+  wait
+  t1=$(ms)
+  ./vmserve -t 1 -p elf.txt -c $clients /tmp/pm0_serve.in > /tmp/pm0_serve1.txt 2> /dev/null
+  t2=$(ms)
+  ./vmserve -t "$jobs" -p elf.txt -c $clients /tmp/pm0_serve.in > /tmp/pm0_serven.txt 2> /dev/null
+  t3=$(ms)
+
+  check=ok
+  cmp -s /tmp/pm0_serve_expected.txt /tmp/pm0_serve1.txt || check=FAIL
+  cmp -s /tmp/pm0_serve_expected.txt /tmp/pm0_serven.txt || check=FAIL
+
+  printf "%-8d %6s %8d %8d %8d\n" $clients "$check" $((t1 - t0)) $((t2 - t1)) $((t3 - t2))
+done
+rm -f /tmp/pm0_serve.in /tmp/pm0_serve_one.txt /tmp/pm0_serve_expected.txt /tmp/pm0_serve1.txt /tmp/pm0_serven.txt
@@ -0,0 +1,62 @@
+#!/bin/sh
+# Snapshots (./vm -k and -r): every bench/*.txt program and
+# bench/io/readsum.txt compiled with -O, saved at its first READ and restored
+# in quiet, tiered, and JIT modes, must print what one whole run does, and so
+# must bench/snapshot/warm.txt saved part way through its warm-up by -n. Then
+# 100 runs of warm.txt, whose warm-up needs no input, one after the other and
+# all at once: whole runs against restores of a snapshot taken at its READ.
+# Times are wall clock for the whole set. Run from the repository root after
+# `make bench`.
+
+. bench/common.sh
+
+jobs=$(getconf _NPROCESSORS_ONLN)
+snap=/tmp/pm0_snapshot.bin
+
+printf "%-10s %6s\n" "program" "check"
+for src in bench/*.txt bench/io/readsum.txt
+do
+  name=$(basename "$src" .txt)
+  [ -f "bench/$name.in" ] && input="bench/$name.in" || input=/tmp/pm0_snapshot.in
+  printf '3\n5\n-2\n9\n' > /tmp/pm0_snapshot.in
+  ./lex "$src" || exit 1
+  ./pcg -O > /dev/null || exit 1
+
+  check=ok
+  for mode in quiet tiered jit
+  do
+    ./vm -m $mode -f -i "$input" > /tmp/pm0_whole.txt
+    ./vm -m $mode -f -k $snap > /tmp/pm0_parts.txt || check=FAIL
+    ./vm -m $mode -f -r $snap -i "$input" >> /tmp/pm0_parts.txt
+    cmp -s /tmp/pm0_whole.txt /tmp/pm0_parts.txt || check=FAIL
+  done
+  printf "%-10s %6s\n" "$name" "$check"
+done
+
+./lex bench/snapshot/warm.txt || exit 1
+./pcg -O > /dev/null || exit 1
+check=ok
+echo 5 | ./vm -m quiet > /tmp/pm0_whole.txt
+./vm -m quiet -n 1000000 -k $snap > /dev/null
+for mode in quiet trace tiered jit
+do
+  echo 5 | ./vm -m $mode -r $snap | grep -o "Output.*" > /tmp/pm0_parts.txt
+  grep -o "Output.*" /tmp/pm0_whole.txt | cmp -s - /tmp/pm0_parts.txt || check=FAIL
+done
+printf "%-10s %6s\n" "warm -n" "$check"
+
+./vm -m quiet -k $snap > /dev/null
+echo
+printf "%-10s %8s %8s %8s %8s\n" "runs" "whole" "restore" "whole-$jobs" "rest-$jobs"
+runs=100
+t0=$(ms)
+for k in $(seq 1 $runs); do echo 5 | ./vm -m quiet > /dev/null; done
+t1=$(ms)
+for k in $(seq 1 $runs); do echo 5 | ./vm -m quiet -r $snap > /dev/null; done
+t2=$(ms)
+seq 1 $runs | xargs -P "$jobs" -I {} sh -c 'echo 5 | ./vm -m quiet > /dev/null'
+t3=$(ms)
+seq 1 $runs | xargs -P "$jobs" -I {} sh -c "echo 5 | ./vm -m quiet -r $snap > /dev/null"
+t4=$(ms)
+printf "%-10d %8d %8d %8d %8d\n" $runs $((t1 - t0)) $((t2 - t1)) $((t3 - t2)) $((t4 - t3))
+rm -f $snap /tmp/pm0_snapshot.in /tmp/pm0_whole.txt /tmp/pm0_parts.txt
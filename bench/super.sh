@@ -0,0 +1,22 @@
+#!/bin/sh
+# Superinstructions versus plain dispatch: best of 5 quiet runs of every
+# bench/*.txt program, plain and compiled with -O, on the larger inputs in
+# bench/common.sh. Run from the repository root after `make bench`, which
+# builds vm_nosuper.
+
+. bench/common.sh
+
+printf "%-10s %8s %8s %8s %8s\n" "program" "ms" "super" "-O ms" "super"
+for src in bench/*.txt
+do
+  name=$(basename "$src" .txt)
+  input=$(large "$name")
+  ./lex "$src" || exit 1
+
+  ./pcg > /dev/null || exit 1
+  plain=$(best ./vm_nosuper "$input")
+  super=$(best ./vm "$input")
+
+  ./pcg -O > /dev/null || exit 1
+  printf "%-10s %8d %8d %8d %8d\n" "$name" "$plain" "$super" $(best ./vm_nosuper "$input") $(best ./vm "$input")
+done
@@ -0,0 +1,31 @@
+#!/bin/sh
+# Tiered execution against quiet interpretation and the JIT on every
+# bench/*.txt program. -m tiered must match quiet (output and -f final state)
+# at the default thresholds and with every loop and call hot at once. The
+# times are the best of 5 runs on the inputs in bench/common.sh, followed by
+# the -t split of a tiered run on the small bench/<name>.in input, where most
+# programs should never leave the interpreter. Run from the repository root
+# after `make bench`.
+
+. bench/common.sh
+
+printf "%-10s %6s %8s %8s %8s   %s\n" "program" "check" "quiet" "jit" "tiered" "small input tiers"
+for src in bench/*.txt
+do
+  name=$(basename "$src" .txt)
+  input=$(large "$name")
+  ./lex "$src" || exit 1
+  ./pcg > /dev/null || exit 1
+
+  check=ok
+  ./vm -m quiet -f < "bench/$name.in" > /tmp/pm0_quiet.txt
+  for thresholds in "" "-l 1 -c 1"
+  do
+    ./vm -m tiered $thresholds -f < "bench/$name.in" > /tmp/pm0_tiered.txt
+    cmp -s /tmp/pm0_quiet.txt /tmp/pm0_tiered.txt || check=FAIL
+  done
+
+  tiers=$(./vm -m tiered -t < "bench/$name.in" 2>&1 > /dev/null | sed 's/^Tiers: //')
+  printf "%-10s %6s %8d %8d %8d   %s\n" "$name" "$check" $(best ./vm "$input") $(best ./vm "$input" jit) $(best ./vm "$input" tiered) "$tiers"
+done
+rm -f /tmp/pm0_quiet.txt /tmp/pm0_tiered.txt
@@ -0,0 +1,49 @@
+#!/bin/sh
+# Top-of-stack cache versus the plain loop on every bench/*.txt program
+# compiled with -O. "words" is PAS words read or written, replayed from the
+# text trace on bench/<name>.in with each handler's accesses in either loop.
+# The times are the median of 11 quiet runs on the inputs in bench/common.sh;
+# the two loops are within a few percent of each other either way, so a
+# best-of-5 isn't enough to tell them apart. Run from the repository root
+# after `make bench`, which builds vm_notos.
+
+. bench/common.sh
+
+# operand stack depth before each instruction is (BP - SP + 1) minus the
+# frame the procedure's INC allocated, the cached loop pays less when it's 0
+words()
+{
+  sed 's/^Please Enter an Integer: //' | awk '
+    /^Initial values:/ { bp = $4; sp = $5; calls = 0; frame[0] = 0; next }
+    NF < 6 || $1 !~ /^[A-Z]+$/ { next }
+    {
+      d = bp - sp + 1 - frame[calls]
+      op = $1
+      if(op == "SYS") op = op $3
+      if(op ~ /^(ADD|SUB|MUL|DIV|EQL|NEQ|LSS|LEQ|GTR|GEQ)$/) { plain += 3; cached += 1 }
+      else if(op == "LIT" || op == "SYS2") { plain += 1; cached += (d > 0) }
+      else if(op ~ /^(LOD|LDL|LDG)$/) { plain += 2; cached += 1 + (d > 0) }
+      else if(op ~ /^(STO|STL|STG)$/) { plain += 2; cached += 1 + (d > 1) }
+      else if(op == "JPC" || op == "SYS1") { plain += 1; cached += (d > 1) }
+      else if(op == "CAL") { plain += 3; cached += 3 + (d > 0); frame[++calls] = 0 }
+      else if(op == "RTN") { plain += 2; cached += 3; --calls }
+      else if(op == "EVEN") { plain += 2 }
+      else if(op == "DUP") { plain += 2; cached += 1 }
+      else if(op == "INC") frame[calls] = $3
+      bp = $5; sp = $6
+    }
+    END { print plain, cached }'
+}
+
+printf "%-10s %10s %10s %6s %8s %8s\n" "program" "words" "cached" "cut" "ms" "cached"
+for src in bench/*.txt
+do
+  name=$(basename "$src" .txt)
+  ./lex "$src" || exit 1
+  ./pcg -O > /dev/null || exit 1
+
+  set -- $(./vm < "bench/$name.in" | words)
+  input=$(large "$name")
+  printf "%-10s %10d %10d %5d%% %8d %8d\n" "$name" "$1" "$2" $(( ($1 - $2) * 100 / $1 )) \
+    $(median ./vm_notos "$input") $(median ./vm "$input")
+done
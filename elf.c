@@ -0,0 +1,152 @@
+/* Translated from PM/0 by pm0toc, build with gcc -O2 */
+#include <stdio.h>
+#include <string.h>
+
+#define MEMORY_SIZE 500
+#define MAX_DEPTH 100
+
+static int base(const int* PAS, int b, int l)
+{
+  while(l-- > 0)
+    b = PAS[b];
+  return b;
+}
+
+static void printStack(const int* PAS, const int* ARS, int topARs, int BP, int SP)
+{
+  int baseOfStack;
+  for(int ARs=0; ; ++ARs)
+    if(base(PAS, BP, ARs) == 0)
+    {
+      baseOfStack = base(PAS, BP, --ARs);
+      break;
+    }
+
+  int tmp2 = 0;
+  for(int i=baseOfStack; i>=SP; --i)
+  {
+    if(ARS[tmp2] == i && tmp2 < topARs)
+    {
+      printf("| ");
+      ++tmp2;
+    }
+    printf("%-2d ", PAS[i]);
+  }
+  printf("\n");
+}
+
+int main(int argc, char* argv[])
+{
+  int showFinal = argc > 1 && strcmp(argv[1], "-f") == 0;
+  int PAS[MEMORY_SIZE] = {0};
+  int ARS[MAX_DEPTH + 1] = {0};
+  int topARs = 0;
+  int bp = 364, input, PC, BP, SP;
+  int ra;
+
+  goto L36;
+L1:
+  goto L31;
+L2:
+  goto L3;
+L3:
+  if(bp -8 < 0) goto overflow;
+  PAS[bp-4] = PAS[PAS[PAS[bp]]-3];
+  PAS[bp-5] = PAS[PAS[bp]-3];
+  PAS[bp-4] = PAS[bp-4] + PAS[bp-5];
+  PAS[bp-3] = PAS[bp-4];
+  PAS[bp-4] = PAS[PAS[PAS[bp]]-4];
+  PAS[bp-5] = PAS[bp-3];
+  PAS[bp-4] = PAS[bp-4] + PAS[bp-5];
+  PAS[PAS[PAS[bp]]-4] = PAS[bp-4];
+  PAS[bp-4] = PAS[bp-3];
+  PAS[bp-5] = 10;
+  PAS[bp-4] = PAS[bp-4] < PAS[bp-5];
+  if(PAS[bp-4] == 0) goto L22;
+  PAS[bp-4] = PAS[PAS[bp]-3];
+  PAS[bp-5] = 1;
+  PAS[bp-4] = PAS[bp-4] + PAS[bp-5];
+  PAS[PAS[bp]-3] = PAS[bp-4];
+  if(topARs == MAX_DEPTH) goto overflow;
+  PAS[bp-4] = PAS[bp];
+  PAS[bp-5] = bp;
+  PAS[bp-6] = 436;
+  bp += -4;
+  ARS[topARs++] = bp;
+  goto L2;
+L21:
+  goto L22;
+L22:
+  ra = PAS[bp-2]; bp = PAS[bp-1]; ARS[topARs] = 0; --topARs; goto ret;
+L23:
+  goto L24;
+L24:
+  if(bp -7 < 0) goto overflow;
+  PAS[bp-3] = PAS[PAS[bp]-3];
+  PAS[bp-4] = 2;
+  PAS[bp-3] = PAS[bp-3] * PAS[bp-4];
+  PAS[PAS[bp]-3] = PAS[bp-3];
+  if(topARs == MAX_DEPTH) goto overflow;
+  PAS[bp-3] = PAS[bp];
+  PAS[bp-4] = bp;
+  PAS[bp-5] = 409;
+  bp += -3;
+  ARS[topARs++] = bp;
+  goto L2;
+L30:
+  ra = PAS[bp-2]; bp = PAS[bp-1]; ARS[topARs] = 0; --topARs; goto ret;
+L31:
+  if(bp -7 < 0) goto overflow;
+  PAS[bp-4] = PAS[PAS[bp]-3];
+  PAS[bp-3] = PAS[bp-4];
+  if(topARs == MAX_DEPTH) goto overflow;
+  PAS[bp-4] = bp;
+  PAS[bp-5] = bp;
+  PAS[bp-6] = 394;
+  bp += -4;
+  ARS[topARs++] = bp;
+  goto L23;
+L35:
+  ra = PAS[bp-2]; bp = PAS[bp-1]; ARS[topARs] = 0; --topARs; goto ret;
+L36:
+  if(bp -8 < 0) goto overflow;
+  printf("Please Enter an Integer: ");
+  if(scanf("%d", &input) != 1) input = 0;
+  PAS[bp-5] = input;
+  PAS[bp-3] = PAS[bp-5];
+  PAS[bp-5] = 0;
+  PAS[bp-4] = PAS[bp-5];
+  if(topARs == MAX_DEPTH) goto overflow;
+  PAS[bp-5] = bp;
+  PAS[bp-6] = bp;
+  PAS[bp-7] = 373;
+  bp += -5;
+  ARS[topARs++] = bp;
+  goto L1;
+L42:
+  PAS[bp-5] = PAS[bp-4];
+  printf("Output result is: %d\n", PAS[bp-5]);
+  PC = 364; BP = bp; SP = bp -4; goto halt;
+
+ret:
+  switch(ra)
+  {
+    case 436: goto L21;
+    case 409: goto L30;
+    case 394: goto L35;
+    case 373: goto L42;
+  }
+  return 1;
+
+overflow:
+  printf("Stack overflow (memory %d words, call depth %d)\n", MEMORY_SIZE, MAX_DEPTH);
+  return 2;
+
+halt:
+  if(showFinal)
+  {
+    printf("Final values:\t   %5d%5d%5d  ", PC, BP, SP);
+    printStack(PAS, ARS, topARs, BP, SP);
+  }
+  return 0;
+}
@@ -0,0 +1,141 @@
+/*
+  PM/0 Executable Format
+
+  elf.bin: elf.txt's program packed for loading with one mmap and no
+  parsing. A header, then one int per instruction (op in bits 0-5, l in
+  8-15, m in 16-31), the constants, and optionally the debug map: the source
+  path padded to a whole int and 4 ints of source range per instruction. An
+  l or m that doesn't fit its bits is marked by WIDE_L or WIDE_M and is the
+  next of the constants instead, taken in order. Ints are in the byte order
+  of the machine that wrote them.
+
+  Notes:
+    - Written by parsercodegen_complete.c -b, pl0ld.c, and ./vm -w, mapped by
+      vm.c, all through this header so the format is defined in one place
+    - Included once by each of them, the way vm.c includes vm_run.h
+*/
+#ifndef EXECUTABLE_H
+#define EXECUTABLE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define EXECUTABLE_MAGIC 0x7f304d50 //"PM0\x7f"
+#define EXECUTABLE_VERSION 1
+#define WIDE_L 0x40
+#define WIDE_M 0x80
+
+typedef struct ExecutableHeader
+{
+  int magic;
+  int version;
+  int codeLength;    //instructions
+  int constantCount;
+  int debugSize;     //bytes of debug map after the constants, 0 without one
+  unsigned checksum; //of everything after the header, see checksum()
+}ExecutableHeader;
+
+//FNV-1a a word at a time
+unsigned checksum(const unsigned* _words, size_t _count)
+{
+  unsigned hash = 2166136261u;
+  for(size_t i=0; i<_count; ++i)
+    hash = (hash ^ _words[i]) * 16777619u;
+  return hash;
+}
+
+//bytes of debug map for _codeLength instructions from _sourcePath, 0 for none
+size_t executableDebugSize(int _codeLength, const char* _sourcePath)
+{
+  if(_sourcePath == NULL || _sourcePath[0] == '\0')
+    return 0;
+  return (strlen(_sourcePath) / sizeof(int) + 1)*sizeof(int) + 4*sizeof(int)*(size_t)_codeLength;
+}
+
+//room for an executable's body: every instruction with two constants at
+//most, and the debug map, zeroed so the path's padding is. NULL if it can't
+//be allocated
+unsigned* allocateExecutable(int _codeLength, const char* _sourcePath)
+{
+  return calloc(3*(size_t)_codeLength*sizeof(int) + executableDebugSize(_codeLength, _sourcePath) + 1, 1);
+}
+
+//instruction _index into _body of _codeLength instructions, with its wide
+//operands added to the constants after them. 0 if op doesn't fit its bits
+int packInstruction(unsigned* _body, int _codeLength, int _index, int* _constantCount, int _op, int _l, int _m)
+{
+  int* constants = (int*)_body + _codeLength;
+  unsigned flags = _op;
+  if(_l < 0 || _l > 0xff)
+  {
+    flags |= WIDE_L;
+    constants[(*_constantCount)++] = _l;
+    _l = 0;
+  }
+  if(_m < -0x8000 || _m > 0x7fff)
+  {
+    flags |= WIDE_M;
+    constants[(*_constantCount)++] = _m;
+    _m = 0;
+  }
+  _body[_index] = flags | (unsigned)_l << 8 | ((unsigned)_m & 0xffff) << 16;
+  return _op >= 0 && _op <= 0x3f;
+}
+
+//the packed _body with its debug map from _sourcePath and _ranges (4 ints
+//per instruction, NULL without a map) after the constants, and the header in
+//front. 0 if it can't be written
+int writeExecutableFile(FILE* _fp, unsigned* _body, int _codeLength, int _constantCount, const char* _sourcePath, const int* _ranges)
+{
+  size_t debugSize = _ranges != NULL ? executableDebugSize(_codeLength, _sourcePath) : 0;
+  if(debugSize > 0)
+  {
+    char* path = (char*)((int*)_body + _codeLength + _constantCount);
+    size_t pathSize = debugSize - 4*sizeof(int)*(size_t)_codeLength;
+    strcpy(path, _sourcePath);
+    memcpy(path + pathSize, _ranges, 4*sizeof(int)*(size_t)_codeLength);
+  }
+
+  size_t words = _codeLength + _constantCount + debugSize / sizeof(int);
+  ExecutableHeader header = {EXECUTABLE_MAGIC, EXECUTABLE_VERSION, _codeLength, _constantCount, (int)debugSize, checksum(_body, words)};
+  fwrite(&header, sizeof(ExecutableHeader), 1, _fp);
+  fwrite(_body, sizeof(int), words, _fp);
+  return !ferror(_fp);
+}
+
+//instruction _index unpacked, with *_constant the next constant unused so
+//far, 0 if it needs more constants than there are
+int unpackInstruction(const ExecutableHeader* _header, int _index, int* _constant, int* _op, int* _l, int* _m)
+{
+  const unsigned* code = (const unsigned*)(_header + 1);
+  const int* constants = (const int*)code + _header->codeLength;
+  unsigned packed = code[_index];
+  int flags = packed & 0xff;
+  *_op = flags & 0x3f;
+  *_l = (packed >> 8) & 0xff;
+  *_m = (short)(packed >> 16);
+  if(*_constant + !!(flags & WIDE_L) + !!(flags & WIDE_M) > _header->constantCount)
+    return 0;
+  if(flags & WIDE_L)
+    *_l = constants[(*_constant)++];
+  if(flags & WIDE_M)
+    *_m = constants[(*_constant)++];
+  return 1;
+}
+
+//the debug map's source path and its 4 ints of range per instruction, NULL
+//for an executable without one
+const char* executableSource(const ExecutableHeader* _header, const int** _ranges)
+{
+  if(_header->debugSize == 0)
+    return NULL;
+  const char* path = (const char*)((const int*)(_header + 1) + _header->codeLength + _header->constantCount);
+  size_t pathSize = _header->debugSize - 4*sizeof(int)*(size_t)_header->codeLength;
+  if((size_t)_header->debugSize < 4*sizeof(int)*(size_t)_header->codeLength || memchr(path, '\0', pathSize) == NULL)
+    return NULL;
+  *_ranges = (const int*)(path + pathSize);
+  return path;
+}
+
+#endif
@@ -25,6 +25,8 @@
 
   Notes:
     - lex.c accepts ONE command-line argument (input PL/0 source file)
+    - Besides token_list.txt, writes token_map.txt with the line and column
+      of every token, which the code generator turns into elf.map
     - parsercodegen_complete.c accepts NO command-line arguments
     - Input filename is hard-coded in parsercodegen_complete.c
     - Implements recursive-descent parser for extended PL/0 grammar
@@ -86,6 +88,8 @@ typedef enum {
 #define IDENTIFIER_MAX_LEN 11
 #define NUMBER_MAX_DIGITS 5
 #define INITIAL_BUFFER_SIZE 128
+#define MAX_TOKENS 65536 //same as MAX_TOKEN_TABLE_SIZE in parsercodegen_complete.c
+#define MAX_TOKEN_TEXT 16 //longest token in token_list.txt, "2 " and an 11 letter name, and a space
 
 //determines if symbol is compound or not, hack
 #define isSingleDigitSymbol(tkn) ((tkn >= 4 && tkn <= 8) || (tkn >= 14 && tkn <= 18) || tkn == 10 || tkn == 12)
@@ -199,7 +203,8 @@ TokenType getSymbolType(char* chs)
   }
 }
 
-TokenType grabNextToken(FILE* fp, char* str)
+//start is set to the file offset of the token's first character
+TokenType grabNextToken(FILE* fp, char* str, long* start)
 {
   int ch = ' ';
 
@@ -240,6 +245,8 @@ TokenType grabNextToken(FILE* fp, char* str)
     }
   }
 
+  *start = ftell(fp) - 1;
+
   //if starts with letter
   if(isalpha(ch))
   {
@@ -337,12 +344,24 @@ int main(int argc, char** argv)
 
   /*----- Main Loop -----*/
   char str[512];
-  char tokenList[2048];
+  static char tokenList[MAX_TOKENS*MAX_TOKEN_TEXT];
   int type;
 
   int numTokens = 0;
-  while((type = grabNextToken(fp, str)) != endfilesym)
+  static long tokenStart[MAX_TOKENS];
+  static int tokenLength[MAX_TOKENS];
+  int tokenCount = 0;
+  long start;
+  while((type = grabNextToken(fp, str, &start)) != endfilesym)
   {
+    if(tokenCount == MAX_TOKENS)
+    {
+      printf("Error: program has more than %d tokens\n", MAX_TOKENS);
+      return 1;
+    }
+    tokenStart[tokenCount] = start;
+    tokenLength[tokenCount++] = strlen(str);
+
     /*----- Token List Printing -----*/
     if(type != identifiererror && type != numbererror)
     {
@@ -377,8 +396,39 @@ int main(int argc, char** argv)
   tokenList[numTokens] = '\0';
   /*----- Main Loop -----*/
 
+  /*----- Token Positions -----*/
+  //token_map.txt: the source path, then line, column, and length of every token in
+  //token_list.txt, in the same order. Offsets only grow, so one pass finds them all
+  FILE* fmap = fopen("token_map.txt", "w");
+  if(fmap == NULL)
+  {
+    printf("File unable to be created\n");
+    return 1;
+  }
+  fprintf(fmap, "%s\n", argv[1]);
+
+  rewind(fp);
+  long offset = 0;
+  int line = 1, column = 1, ch;
+  for(int i=0; i<tokenCount; ++i)
+  {
+    for(; offset < tokenStart[i] && (ch = fgetc(fp)) != EOF; ++offset)
+    {
+      if(ch == '\n') { ++line; column = 1; }
+      else ++column;
+    }
+    fprintf(fmap, "%d %d %d\n", line, column, tokenLength[i]);
+  }
+  fclose(fmap);
+  /*----- Token Positions -----*/
+
   fclose(fp);
   FILE* foutput = fopen("token_list.txt", "w");
+  if(foutput == NULL)
+  {
+    printf("File unable to be created\n");
+    return 1;
+  }
   fprintf(foutput, "%s", tokenList);
 
 
@@ -25,7 +25,23 @@
 
   Notes:
     - lex.c accepts ONE command-line argument (input PL/0 source file)
-    - parsercodegen_complete.c accepts NO command-line arguments
+    - parsercodegen_complete.c accepts an optional -O flag, which turns on
+      local value numbering and loop-invariant code motion and emits DUP (OPR 0 12)
+      and the direct addressing forms LDL/STL (10/11) and LDG/STG (12/13)
+    - -r selects the register backend instead, which writes relf.txt for rvm.c;
+      -O only affects the PM/0 backend
+    - When lex.c left a token_map.txt, the PM/0 backend also writes elf.map, the
+      source range every instruction of elf.txt was generated from
+    - -b writes the PM/0 code to elf.bin instead, the binary executable ./vm -p
+      elf.bin maps without parsing, with elf.map's ranges built in (see
+      Executable)
+    - -c compiles one module of a larger program to elf.o instead, for
+      pl0ld.c to link with others: calls to procedures it doesn't declare are
+      left for pl0ld to resolve (see Object)
+    - -i keeps each procedure's code in elf.cache and reuses it on the next
+      compile when neither the procedure nor what it can see changed, only
+      edited procedures are parsed and generated again (see Incremental
+      Compilation); not with -O, -r, or -c
     - Input filename is hard-coded in parsercodegen_complete.c
     - Implements recursive-descent parser for extended PL/0 grammar
     - Supports procedures, call statements, and if-then-else
@@ -44,12 +60,24 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include "executable.h"
 
 
 /*----- Enums and Macros -----*/
-#define MAX_SYMBOL_TABLE_SIZE 500
-#define MAX_TOKEN_TABLE_SIZE 2048
-#define MAX_INSTRUCTION_TABLE_SIZE 500 //PAS for HW1 was max 500, so this is overkill if anything
+#define MAX_SYMBOL_TABLE_SIZE 2048
+#define MAX_TOKEN_TABLE_SIZE 65536
+#define MAX_INSTRUCTION_TABLE_SIZE 32768
+#define MAX_NODE_TABLE_SIZE 32768
+#define MAX_VALUE_TABLE_SIZE (2*MAX_NODE_TABLE_SIZE) //every expression node and every variable load can create at most one value
+#define MAX_HOISTED_PER_LOOP 32
+#define MAX_REG_INSTRUCTION_TABLE_SIZE MAX_INSTRUCTION_TABLE_SIZE //any program that fits PM/0 code
+#define MAX_FRAGMENT_TABLE_SIZE (2*MAX_SYMBOL_TABLE_SIZE) //procedures of this compile and the last one
+#define MAX_CACHED_INSTRUCTION_TABLE_SIZE (4*MAX_INSTRUCTION_TABLE_SIZE) //nested procedures are in their parent's fragment too
+#define MAX_VIRTUAL_TABLE_SIZE 256 //virtual instructions/registers in one statement
+#define REGISTER_COUNT 8 //register file of rvm.c
+#define ALLOCATABLE_REGISTERS 6 //the last two registers are reserved for spill code
+#define CACHE_MAGIC 0x43304c50 //elf.cache, see Incremental Compilation
+#define CACHE_VERSION 1
 
 
 typedef enum TokenType{
@@ -105,6 +133,10 @@ enum Instructions
   JMP = 7,
   JPC = 8,
   SYS = 9,
+  LDL = 10, //LOD/STO forms emitted with -O, M is the same offset LOD/STO use
+  STL = 11, //L = 0, frame relative
+  LDG = 12, //level 0 globals, relative to the fixed main frame
+  STG = 13,
 
   RTN = 0,
   ADD = 1,
@@ -117,7 +149,8 @@ enum Instructions
   LEQ = 8,
   GTR = 9,
   GEQ = 10,
-  EVEN = 11
+  EVEN = 11,
+  DUP = 12 //pushes a copy of the top of stack, only emitted with -O
 };
 
 typedef struct Instruction
@@ -127,6 +160,53 @@ typedef struct Instruction
   int m;
 }Instruction;
 
+//instruction set of rvm.c, see there for semantics
+enum RegisterInstructions
+{
+  RLI = 1,
+  RLD,
+  RST,
+  RCAL,
+  RINC,
+  RJMP,
+  RJPZ,
+  RSYS,
+  RRTN,
+  RADD = 10, //R[a] = R[b] op R[c], same order as the OPR sub-ops
+  RSUB,
+  RMUL,
+  RDIV,
+  REQL,
+  RNEQ,
+  RLSS,
+  RLEQ,
+  RGTR,
+  RGEQ,
+  RADDI = 20, //R[a] = R[b] op c
+  RSUBI,
+  RMULI,
+  RDIVI,
+  REQLI,
+  RNEQI,
+  RLSSI,
+  RLEQI,
+  RGTRI,
+  RGEQI,
+  REVEN = 30,
+
+  PRINT = 1, //SYS codes, same as PM/0
+  READ = 2,
+  HALT = 3
+};
+
+typedef struct RegInstruction
+{
+  int op;
+  int a;
+  int b;
+  int c;
+}RegInstruction;
+
 typedef struct Symbol
 {
   int kind; //const = 1, var = 2, procedure = 3
@@ -135,6 +215,8 @@ typedef struct Symbol
   int level; //all
   int addr; //var and procedure
   int mark; //all = 0 (default)
+  int external; //procedure only, called with -c but not declared (left to pl0ld)
+  int definition; //external only, 1 + the procedure declared after the calls, 0 if none
 }Symbol;
 
 enum SymbolEnum
@@ -152,8 +234,18 @@ typedef struct Token
   TokenType type;
   int value; //holds value of number if number
   char name[12]; //holds name of identifier if identifier
+  int line; //position in the source, from token_map.txt, 0 if unknown
+  int column;
+  int length;
 }Token;
 
+//first and last token an instruction was generated from
+typedef struct SourceRange
+{
+  int first;
+  int last;
+}SourceRange;
+
 typedef enum ErrorCode
 {
   PeriodMissing = 1,
@@ -178,6 +270,97 @@ typedef enum ErrorCode
   SkipsymDetected
 }ErrorCode;
 
+typedef enum NodeKind
+{
+  NullNode = 0,
+  BlockNode,   //op = locals, level = block level, left = first procedure, right = statement, symbol = procedure (-1 for main)
+  AssignNode,  //symbol := left
+  CallNode,    //call symbol
+  BeginNode,   //left = first statement, chained through next
+  IfNode,      //if left then right else third fi
+  WhileNode,   //while left do right
+  ReadNode,    //read symbol
+  WriteNode,   //write left
+  NumberNode,  //op = value
+  VarNode,     //symbol, level = currentLevel - symbol level
+  BinaryNode,  //left op right, op = OPR sub-op
+  EvenNode,    //even left
+  TempNode     //compiler temporary in the current frame, op = address
+}NodeKind;
+
+typedef struct Node
+{
+  NodeKind kind;
+  int op;
+  int symbol;
+  int level;
+  int left;
+  int right;
+  int third;
+  int next; //next statement in a begin, next procedure in a block
+
+  //filled in by local value numbering (-O)
+  int vn;       //value number
+  int holder;   //variable already holding this value, -1 if none
+  int dupRight; //right operand has the same value as left, DUP instead of evaluating it
+
+  //tokens the node was parsed from: whole statements, if/while only up to then/do,
+  //procedures only their "procedure name;" header
+  int first;
+  int last;
+
+  //-i: elf.cache key of a procedure, 0 if it can't be cached, and 1 + the cached
+  //fragment it's generated from instead of its parsed block, 0 if none
+  unsigned long long key;
+  int fragment;
+}Node;
+
+//code of one procedure in elf.cache, see Incremental Compilation
+typedef struct Fragment
+{
+  unsigned long long key;
+  unsigned long long parent; //key of the enclosing procedure, 0 at level 0
+  int start; //first instruction, in cache_list or instruction_list
+  int count;
+  int header; //"procedure" token of the procedure generated from it
+  int used;
+}Fragment;
+
+typedef struct CachedInstruction
+{
+  int op;
+  int l;
+  int m; //relative to the fragment's first instruction for relocation InternalAddress
+  int first; //source range, relative to the "procedure" token
+  int last;
+  int relocation;
+  char name[12]; //procedure called, for relocation OuterCall
+  int symbol; //which name resolved to when the fragment is used
+}CachedInstruction;
+
+typedef struct CacheHeader
+{
+  int magic;
+  int version;
+  int fragmentCount;
+  int instructionCount;
+}CacheHeader;
+
+enum Relocations
+{
+  NoRelocation = 0,
+  InternalAddress = 1,
+  OuterCall = 2
+};
+
+typedef struct Value
+{
+  int kind; //NodeKind the value was built from
+  int op;
+  int a;
+  int b;
+}Value;
+
 
 /*----- Enums, Macros, and Structs -----*/
 
@@ -190,30 +373,104 @@ typedef enum ErrorCode
 Symbol symbol_table[MAX_SYMBOL_TABLE_SIZE];
 Token token_list[MAX_TOKEN_TABLE_SIZE];
 Instruction instruction_list[MAX_INSTRUCTION_TABLE_SIZE];
+Node node_list[MAX_NODE_TABLE_SIZE]; //node 0 is the empty node
+SourceRange source_list[MAX_INSTRUCTION_TABLE_SIZE]; //written to elf.map
 
 unsigned linenumber;
 unsigned tokenindex;
+int tokenCount;
+int symbolCount;
 unsigned currentLevel;
+unsigned nodecount;
+
+int optimize; //-O
+int registerBackend; //-r
+int binaryOutput; //-b
+int objectOutput; //-c
+int incremental; //-i
+
+//object file state, see Object
+int globalAccess[MAX_INSTRUCTION_TABLE_SIZE]; //addresses the main activation record
+int calledSymbol[MAX_INSTRUCTION_TABLE_SIZE]; //1 + the symbol a CAL calls, 0 if none
+
+//source map state
+char sourcePath[512]; //first line of token_map.txt, empty if there was none
+SourceRange currentSource; //range the instructions being generated come from
+
+//register backend state
+RegInstruction reg_list[MAX_REG_INSTRUCTION_TABLE_SIZE];
+unsigned reglinenumber;
+RegInstruction virtual_list[MAX_VIRTUAL_TABLE_SIZE]; //current statement, operands are virtual registers
+int virtualCount;
+int vregCount;
+
+//code generation state
+int genLevel;
+int frameLocals; //locals of the block being generated, temporaries are stored past them
+int frameTemps;  //temporaries the current block needs, added to its INC
+int tempBase;    //first free temporary
+
+//local value numbering state, reset for every basic block
+Value value_table[MAX_VALUE_TABLE_SIZE];
+int valueCount;
+int valueComputed[MAX_VALUE_TABLE_SIZE];
+int valueRecomputed[MAX_VALUE_TABLE_SIZE];
+int valueCost[MAX_VALUE_TABLE_SIZE];
+int valueTemp[MAX_VALUE_TABLE_SIZE]; //frame slot the value is saved in, -1 if none
+int valueReady[MAX_VALUE_TABLE_SIZE];
+int currentValue[MAX_SYMBOL_TABLE_SIZE]; //value number each variable holds, -1 if unknown
+
+//loop invariant code motion state
+char procModifies[MAX_SYMBOL_TABLE_SIZE][MAX_SYMBOL_TABLE_SIZE]; //variables a procedure may store to, including through calls
+char loopModifies[MAX_SYMBOL_TABLE_SIZE];
+int hoisted[MAX_HOISTED_PER_LOOP]; //expressions computed in the preheader of the loop being generated
+int hoistedCount;
+
+//incremental compilation state, see Incremental Compilation
+Fragment fragment_list[MAX_FRAGMENT_TABLE_SIZE]; //read from elf.cache, in its order
+int fragmentCount;
+int fragmentOrder[MAX_FRAGMENT_TABLE_SIZE]; //fragment_list sorted by key
+CachedInstruction cache_list[MAX_CACHED_INSTRUCTION_TABLE_SIZE];
+int cacheCount;
+Fragment compiled_list[MAX_SYMBOL_TABLE_SIZE]; //procedures generated this time, written back to elf.cache
+int compiledCount;
+unsigned long long scopeHash = 14695981039346656037ull; //symbols visible at the current point of the parse
+unsigned long long enclosingKey; //of the procedure being generated
+int proceduresReused;
+int proceduresParsed;
 /*----- Globals -----*/
 
 
 
 
 /*----- Helper Functions -----*/
+//FNV-1a, 64 bits for elf.cache keys
+unsigned long long hashBytes(unsigned long long _hash, const void* _data, size_t _size)
+{
+  const unsigned char* bytes = _data;
+  for(size_t i=0; i<_size; ++i)
+    _hash = (_hash ^ bytes[i]) * 1099511628211ull;
+  return _hash;
+}
+
 void insertSymbol(Symbol _addition)
 {
-  for(int i=0; i<MAX_SYMBOL_TABLE_SIZE; ++i)
-  {
-    //all global member variables are zeroed out by c standard upon initialization.
-    if(symbol_table[i].kind == 0)
-    {
-      symbol_table[i] = _addition;
-      return;
-    }
-  }
-  
   //ran out of space, should not happen
-  exit(-1);
+  if(symbolCount == MAX_SYMBOL_TABLE_SIZE)
+    exit(-1);
+
+  symbol_table[symbolCount++] = _addition;
+
+  //what code using the symbol depends on, procedure addresses are relocated
+  Symbol signature;
+  memset(&signature, 0, sizeof(Symbol)); //past the name's terminator too
+  signature.kind = _addition.kind;
+  strcpy(signature.name, _addition.name);
+  signature.val = _addition.val;
+  signature.level = _addition.level;
+  if(_addition.kind != Procedure)
+    signature.addr = _addition.addr;
+  scopeHash = hashBytes(scopeHash, &signature, sizeof(Symbol));
 }
 
 void insertConst(int _val, const char* _name)
@@ -224,6 +481,8 @@ void insertConst(int _val, const char* _name)
   newconst.level = currentLevel;
   newconst.addr = 0;
   newconst.mark = 0;
+  newconst.external = 0;
+  newconst.definition = 0;
   strcpy(newconst.name, _name);
   insertSymbol(newconst);
 }
@@ -236,6 +495,8 @@ void insertVar(int _addr, const char* _name)
   newvar.level = currentLevel;
   newvar.addr = _addr;
   newvar.mark = 0;
+  newvar.external = 0;
+  newvar.definition = 0;
   strcpy(newvar.name, _name);
   insertSymbol(newvar);
 }
@@ -248,23 +509,56 @@ void insertProc(int _addr, const char* _name)
   newproc.level = currentLevel;
   newproc.addr = _addr;
   newproc.mark = 0;
+  newproc.external = 0;
+  newproc.definition = 0;
   strcpy(newproc.name, _name);
   insertSymbol(newproc);
 }
 
+//a procedure of another module, called as if declared at level 0. It may
+//store to anything at level 0 by calling back into this module
+int insertExternal(const char* _name)
+{
+  unsigned savedLevel = currentLevel;
+  currentLevel = 0;
+  insertProc(0, _name);
+  currentLevel = savedLevel;
+
+  int symbol = symbolCount - 1;
+  symbol_table[symbol].external = 1;
+  for(int i=0; i<symbol; ++i)
+    if(symbol_table[i].kind == Variable && symbol_table[i].level == 0)
+      procModifies[symbol][i] = 1;
+  return symbol;
+}
+
+//the module declares the external _name itself after all, at level 0 as
+//_symbol: calls made before are patched to it once it's generated
+void defineExternal(const char* _name, int _symbol)
+{
+  for(int i=0; i<_symbol; ++i)
+    if(symbol_table[i].external && symbol_table[i].definition == 0 && strcmp(symbol_table[i].name, _name) == 0)
+      symbol_table[i].definition = _symbol + 1;
+}
+
 void insertInstruction(int _op, int _l, int _m, unsigned _line)
 {
+  //ran out of space, same as insertSymbol
+  if(_line >= MAX_INSTRUCTION_TABLE_SIZE)
+    exit(-1);
+
   Instruction newinstruction;
   newinstruction.op = _op;
   newinstruction.l = _l;
   newinstruction.m = _m;
   instruction_list[_line] = newinstruction;
+  source_list[_line] = currentSource;
 }
 
 //-1 on failure to find, index on success
 int lookupSymbol(const char* _name)
 {
-  for(int i=MAX_SYMBOL_TABLE_SIZE-1; i >= 0; --i)
+  for(int i=symbolCount-1; i >= 0; --i)
   {
     if(strcmp(_name, symbol_table[i].name) == 0 && symbol_table[i].level <= currentLevel && symbol_table[i].mark == Available)
       return i;
@@ -276,11 +570,12 @@ int lookupSymbol(const char* _name)
 
 int isValidDecl(const char* _name)
 {
-  for(int i=MAX_SYMBOL_TABLE_SIZE-1; i >= 0; --i)
+  for(int i=symbolCount-1; i >= 0; --i)
   {
     if(strcmp(_name, symbol_table[i].name) != 0) continue;
     if(symbol_table[i].level != currentLevel) continue;
     if(symbol_table[i].mark == Unavailable) continue;
+    if(symbol_table[i].external) continue; //a later declaration is what earlier calls meant
 
 
     return 0;
@@ -368,6 +663,10 @@ void printErrorAndHalt(ErrorCode _error_code)
 
   fputs(errcode, outputfile);
   printf("%s\n", errcode);
+  if(binaryOutput)
+    remove("elf.bin"); //not left to run in place of the program that failed
+  if(objectOutput)
+    remove("elf.o");
   //printInstructions();
   // if(token_list[tokenindex-1].type == identsym)
   // {
@@ -383,7 +682,8 @@ void printErrorAndHalt(ErrorCode _error_code)
 }
 
 //0 for success, -1 for EOF reached, 1 for error detected
-int readToken(FILE* fp)
+//_map is token_map.txt, positioned at the line for this token, or NULL
+int readToken(FILE* fp, FILE* _map)
 {
   int ch = 'a';
   int err = fscanf(fp, "%d", &ch);
@@ -391,7 +691,10 @@ int readToken(FILE* fp)
     return EOF;
   
   Token new_token;
+  memset(&new_token, 0, sizeof(Token));
   new_token.type = ch;
+  if(_map != NULL && fscanf(_map, "%d %d %d", &new_token.line, &new_token.column, &new_token.length) != 3)
+    new_token.line = new_token.column = new_token.length = 0;
 
   switch(ch)
   {
@@ -409,14 +712,8 @@ int readToken(FILE* fp)
     break;
   }
 
-  for(int i=0; i<MAX_TOKEN_TABLE_SIZE; ++i)
-  {
-    if(token_list[i].type == 0)
-    {
-      token_list[i] = new_token;
-      break;
-    }
-  }
+  if(tokenCount < MAX_TOKEN_TABLE_SIZE)
+    token_list[tokenCount++] = new_token;
 
   if(ch == 1) 
     return 1;
@@ -447,6 +744,14 @@ void printOP(int _op)
       printf("%9s","JPC"); break;
     case SYS:
       printf("%9s","SYS"); break;
+    case LDL:
+      printf("%9s","LDL"); break;
+    case STL:
+      printf("%9s","STL"); break;
+    case LDG:
+      printf("%9s","LDG"); break;
+    case STG:
+      printf("%9s","STG"); break;
     
     default:
       printf("PRINTING ERROR");
@@ -466,41 +771,349 @@ void printInstructions()
     printf("%5d%5d\n", 0, instruction_list[i].m);
   }
 }
+
+int newNode(NodeKind _kind)
+{
+  if(++nodecount == MAX_NODE_TABLE_SIZE) exit(-1); //ran out of space, same as insertSymbol
+
+  Node newnode;
+  memset(&newnode, 0, sizeof(Node));
+  newnode.kind = _kind;
+  newnode.symbol = -1;
+  newnode.holder = -1;
+  node_list[nodecount] = newnode;
+  return nodecount;
+}
+
+int newSymbolNode(NodeKind _kind, int _symbol)
+{
+  int node = newNode(_kind);
+  node_list[node].symbol = _symbol;
+  node_list[node].level = currentLevel - symbol_table[_symbol].level;
+  return node;
+}
+
+int newBinaryNode(int _op, int _left, int _right)
+{
+  int node = newNode(BinaryNode);
+  node_list[node].op = _op;
+  node_list[node].left = _left;
+  node_list[node].right = _right;
+  return node;
+}
+
+void printSymbolTable()
+{
+  printf("\nSymbol Table:\n\n");
+  printf("Kind | Name        | Value | Level | Address | Mark\n");
+  printf("---------------------------------------------------\n");
+
+  for(int i=0; i<MAX_SYMBOL_TABLE_SIZE; ++i)
+  {
+    Symbol s = symbol_table[i]; if(s.kind == 0) break;
+
+    printf("%4d | %11s | %5d | %5d | %7d | %4d\n", s.kind, s.name, s.val, s.level, s.addr, s.mark);
+  }
+}
 /*----- Helper Functions -----*/
 
+/*----- Incremental Compilation -----*/
+//-i keeps every procedure's code in elf.cache between compiles, keyed by a
+//hash of the procedure's tokens and of the symbols visible where it's
+//declared, the only things the code of a procedure depends on without -O. A
+//procedure whose key is cached isn't parsed: its tokens are skipped and its
+//fragment is copied in where genProcedure would have generated it, with jumps
+//and calls inside it moved to where it lands and calls to procedures outside
+//it looked up by name. Procedures declared in it are kept in the cache for
+//when it changes. elf.cache is the header, the fragments, then all of their
+//instructions, read and written whole. The main block's statements are
+//always parsed.
+
+//index just past the next token of _type from _index
+int skipPast(int _index, int _type)
+{
+  while(_index < tokenCount && token_list[_index].type != _type)
+    ++_index;
+  return _index + 1;
+}
+
+//index of the ";" ending the block from _index, found without parsing it, -1
+//if the tokens don't hold a whole block
+int skipBlock(int _index)
+{
+  if(_index >= tokenCount)
+    return -1;
+  if(token_list[_index].type == constsym)
+    _index = skipPast(_index, semicolonsym);
+  if(_index < tokenCount && token_list[_index].type == varsym)
+    _index = skipPast(_index, semicolonsym);
+
+  while(_index < tokenCount && token_list[_index].type == procsym)
+  {
+    _index = skipBlock(_index + 3); //procedure name ;
+    if(_index == -1 || token_list[_index].type != semicolonsym)
+      return -1;
+    ++_index;
+  }
+
+  //the statement, only begin ... end holds more of them
+  for(int depth = 0; _index < tokenCount; ++_index)
+  {
+    int type = token_list[_index].type;
+    if(type == beginsym)
+      ++depth;
+    else if(type == endsym && --depth < 0)
+      return -1;
+    else if(depth == 0 && (type == semicolonsym || type == periodsym))
+      return type == semicolonsym ? _index : -1;
+  }
+  return -1;
+}
+
+//the key of the procedure declared from _header to _end, its symbol just
+//inserted. The tokens' positions are left out, so edits elsewhere that only
+//shift it in the source don't change it
+unsigned long long procedureKey(int _header, int _end)
+{
+  unsigned long long key = hashBytes(scopeHash, &currentLevel, sizeof(currentLevel));
+  for(int i=_header; i<=_end; ++i)
+  {
+    Token t = token_list[i];
+    key = hashBytes(key, &t.type, sizeof(t.type));
+    key = hashBytes(key, &t.value, sizeof(t.value));
+    key = hashBytes(key, t.name, sizeof(t.name));
+  }
+  return key != 0 ? key : 1; //0 is no key
+}
+
+int compareFragments(const void* _a, const void* _b)
+{
+  unsigned long long a = fragment_list[*(const int*)_a].key, b = fragment_list[*(const int*)_b].key;
+  return (a > b) - (a < b);
+}
+
+int compareKey(const void* _key, const void* _fragment)
+{
+  unsigned long long a = *(const unsigned long long*)_key, b = fragment_list[*(const int*)_fragment].key;
+  return (a > b) - (a < b);
+}
+
+//fragment cached under _key, -1 if none
+int findFragment(unsigned long long _key)
+{
+  int* found = bsearch(&_key, fragmentOrder, fragmentCount, sizeof(int), compareKey);
+  return found != NULL ? *found : -1;
+}
+
+//reads elf.cache, a missing or unreadable cache is an empty one
+void readCache()
+{
+  FILE* fp = fopen("elf.cache", "rb");
+  if(fp == NULL)
+    return;
+
+  CacheHeader header;
+  if(fread(&header, sizeof(CacheHeader), 1, fp) == 1 && header.magic == CACHE_MAGIC && header.version == CACHE_VERSION &&
+     header.fragmentCount >= 0 && header.fragmentCount <= MAX_FRAGMENT_TABLE_SIZE &&
+     header.instructionCount >= 0 && header.instructionCount <= MAX_CACHED_INSTRUCTION_TABLE_SIZE &&
+     fread(fragment_list, sizeof(Fragment), header.fragmentCount, fp) == header.fragmentCount &&
+     fread(cache_list, sizeof(CachedInstruction), header.instructionCount, fp) == header.instructionCount)
+  {
+    fragmentCount = header.fragmentCount;
+    cacheCount = header.instructionCount;
+  }
+  fclose(fp);
+
+  for(int i=0; i<fragmentCount; ++i)
+  {
+    Fragment f = fragment_list[i];
+    if(f.start < 0 || f.count < 0 || f.start + f.count > cacheCount)
+    {
+      fragmentCount = 0; //not one this compiler wrote
+      break;
+    }
+    fragment_list[i].used = 0;
+    fragmentOrder[i] = i;
+  }
+  qsort(fragmentOrder, fragmentCount, sizeof(int), compareFragments);
+}
+
+//the cached fragment for the procedure whose symbol was just inserted at
+//_header, resolving its calls to outer procedures, -1 to parse it instead.
+//*_key is set to the procedure's key, 0 if it can't be cached
+int reuseProcedure(int _header, unsigned long long* _key)
+{
+  *_key = 0;
+  int end = skipBlock(_header + 3);
+  if(end == -1)
+    return -1;
+  *_key = procedureKey(_header, end);
+
+  int fragment = findFragment(*_key);
+  if(fragment == -1 || fragment_list[fragment].used)
+    return -1;
+
+  ++currentLevel; //names are looked up from inside the procedure, as parsing it would
+  Fragment f = fragment_list[fragment];
+  for(int i=f.start; i<f.start + f.count; ++i)
+  {
+    if(cache_list[i].relocation != OuterCall)
+      continue;
+
+    cache_list[i].symbol = lookupSymbol(cache_list[i].name);
+    if(cache_list[i].symbol == -1 || symbol_table[cache_list[i].symbol].kind != Procedure)
+    {
+      --currentLevel;
+      return -1;
+    }
+  }
+  --currentLevel;
+
+  fragment_list[fragment].used = 1;
+  tokenindex = end + 1;
+  return fragment;
+}
+
+//genProcedure's code for a procedure that wasn't parsed, from its fragment
+void genFragment(int _proc)
+{
+  Fragment f = fragment_list[node_list[_proc].fragment - 1];
+  int header = node_list[_proc].first, start = linenumber;
+  for(int i=f.start; i<f.start + f.count; ++i)
+  {
+    CachedInstruction c = cache_list[i];
+    int m = c.m;
+    if(c.relocation == InternalAddress)
+      m = (start + m)*3;
+    else if(c.relocation == OuterCall)
+      m = symbol_table[c.symbol].addr;
+
+    calledSymbol[linenumber] = c.relocation == OuterCall ? c.symbol + 1 : 0;
+    currentSource.first = header + c.first;
+    currentSource.last = header + c.last;
+    insertInstruction(c.op, c.l, m, linenumber++);
+  }
+}
+
+//instruction _i as cached in _fragment, generated from it or not
+CachedInstruction cacheInstruction(Fragment _fragment, int _i)
+{
+  Instruction in = instruction_list[_i];
+  CachedInstruction c;
+  memset(&c, 0, sizeof(CachedInstruction));
+  c.op = in.op;
+  c.l = in.l;
+  c.m = in.m;
+  c.first = source_list[_i].first - _fragment.header;
+  c.last = source_list[_i].last - _fragment.header;
+  if((in.op == JMP || in.op == JPC || in.op == CAL) && in.m/3 >= _fragment.start && in.m/3 < _fragment.start + _fragment.count)
+  {
+    c.relocation = InternalAddress;
+    c.m = in.m/3 - _fragment.start;
+  }
+  else if(in.op == CAL)
+  {
+    c.relocation = OuterCall;
+    strcpy(c.name, symbol_table[calledSymbol[_i] - 1].name);
+  }
+  return c;
+}
+
+//every procedure generated this time, then the cached procedures declared in
+//ones that were reused, which weren't
+void writeCache(FILE* _fp)
+{
+  //enclosing procedures come first, so whether they're kept is known
+  int kept[MAX_FRAGMENT_TABLE_SIZE];
+  CacheHeader header = {CACHE_MAGIC, CACHE_VERSION, compiledCount, 0};
+  for(int i=0; i<compiledCount; ++i)
+    header.instructionCount += compiled_list[i].count;
+  for(int i=0; i<fragmentCount; ++i)
+  {
+    Fragment f = fragment_list[i];
+    int parent = f.parent != 0 ? findFragment(f.parent) : -1;
+    kept[i] = !f.used && parent != -1 && parent < i && (fragment_list[parent].used || kept[parent]);
+    if(kept[i] && header.fragmentCount < MAX_FRAGMENT_TABLE_SIZE && header.instructionCount + f.count <= MAX_CACHED_INSTRUCTION_TABLE_SIZE)
+    {
+      ++header.fragmentCount;
+      header.instructionCount += f.count;
+    }
+    else
+      kept[i] = 0;
+  }
+  fwrite(&header, sizeof(CacheHeader), 1, _fp);
+
+  int start = 0;
+  for(int i=0; i<compiledCount; ++i)
+  {
+    Fragment f = compiled_list[i];
+    f.start = start;
+    start += f.count;
+    fwrite(&f, sizeof(Fragment), 1, _fp);
+  }
+  for(int i=0; i<fragmentCount; ++i)
+  {
+    if(!kept[i])
+      continue;
+    Fragment f = fragment_list[i];
+    f.start = start;
+    start += f.count;
+    fwrite(&f, sizeof(Fragment), 1, _fp);
+  }
+
+  for(int i=0; i<compiledCount; ++i)
+  {
+    Fragment f = compiled_list[i];
+    for(int j=f.start; j<f.start + f.count; ++j)
+    {
+      CachedInstruction c = cacheInstruction(f, j);
+      fwrite(&c, sizeof(CachedInstruction), 1, _fp);
+    }
+  }
+  for(int i=0; i<fragmentCount; ++i)
+    if(kept[i])
+      fwrite(cache_list + fragment_list[i].start, sizeof(CachedInstruction), fragment_list[i].count, _fp);
+}
+/*----- Incremental Compilation -----*/
+
+
+
 /*----- Grammar Checking -----*/
-void isProgram();
+int isProgram();
 
-void parseBlock();
+int parseBlock();
 void parseConstDecl();
 int parseVarDecl(); //returns num variables declares
-void parseProcDecl();
-void parseStatement();
-void parseCondition();
-void parseExpression();
-void parseTerm();
-void parseFactor();
-
-void isProgram()
+int parseProcDecl();
+int parseStatement();
+int parseCondition();
+int parseExpression();
+int parseTerm();
+int parseFactor();
+
+int isProgram()
 {
-  parseBlock();
+  int program = parseBlock();
   if(token_list[tokenindex++].type != periodsym) printErrorAndHalt(PeriodMissing);
-  insertInstruction(SYS, 0, 3, linenumber++);
+  node_list[program].first = 0;
+  node_list[program].last = tokenindex - 1;
+  return program;
 }
 
-void parseBlock()
+int parseBlock()
 {
+  int block = newNode(BlockNode);
+  node_list[block].level = currentLevel;
+  unsigned long long savedScope = scopeHash;
 
   parseConstDecl();
-  int numLocals = parseVarDecl();
-
-  int jmpLocaton = linenumber++;
-  parseProcDecl();
-  insertInstruction(JMP, 0, (linenumber)*3, jmpLocaton);
-  insertInstruction(INC, 0, numLocals, linenumber++);
-
-  parseStatement();
+  node_list[block].op = parseVarDecl();
+  node_list[block].left = parseProcDecl();
+  node_list[block].right = parseStatement();
   markSymbolsAt(currentLevel);
+  scopeHash = savedScope; //the block's symbols are out of scope again
+
+  return block;
 }
 
 void parseConstDecl()
@@ -561,27 +1174,58 @@ int parseVarDecl()
   return numvars;
 }
 
-void parseProcDecl()
+//returns the first procedure, the rest are chained through next
+int parseProcDecl()
 {
+  int first = 0, last = 0;
   while(token_list[tokenindex].type == procsym)
   {
-    ++tokenindex;
+    int header = tokenindex++;
     if(token_list[tokenindex].type != identsym) printErrorAndHalt(IdentifierMissing);//insert error
     if(isValidDecl(token_list[tokenindex].name) == 0) printErrorAndHalt(SymbolPreviouslyDeclared);//insert error
-    insertProc(linenumber*3, token_list[tokenindex].name);
+    insertProc(0, token_list[tokenindex].name); //address is filled in by genProcedure
+    int procsymbol = lookupSymbol(token_list[tokenindex].name);
+    if(objectOutput && currentLevel == 0)
+      defineExternal(token_list[tokenindex].name, procsymbol);
     ++tokenindex;
-    
-    ++currentLevel;
-    if(token_list[tokenindex++].type != semicolonsym) printErrorAndHalt(ProcDeclarationNoSemicolon);//insert error
-    parseBlock();
-    if(token_list[tokenindex++].type != semicolonsym) printErrorAndHalt(ProcDeclarationNoSemicolon);//insert error
-    insertInstruction(OPR, 0, RTN, linenumber++);  
-    --currentLevel;
+
+    int proc;
+    unsigned long long key = 0;
+    int fragment = incremental ? reuseProcedure(header, &key) : -1;
+    if(fragment != -1)
+    {
+      //generated from elf.cache, nothing declared in it is entered
+      proc = newNode(BlockNode);
+      node_list[proc].level = currentLevel + 1;
+      node_list[proc].fragment = fragment + 1;
+      ++proceduresReused;
+    }
+    else
+    {
+      ++currentLevel;
+      if(token_list[tokenindex++].type != semicolonsym) printErrorAndHalt(ProcDeclarationNoSemicolon);//insert error
+      proc = parseBlock();
+      if(token_list[tokenindex++].type != semicolonsym) printErrorAndHalt(ProcDeclarationNoSemicolon);//insert error
+      --currentLevel;
+      ++proceduresParsed;
+    }
+    node_list[proc].symbol = procsymbol;
+    node_list[proc].first = header;
+    node_list[proc].last = header + 2;
+    node_list[proc].key = key;
+
+    if(first == 0) first = proc;
+    else node_list[last].next = proc;
+    last = proc;
   }
+
+  return first;
 }
 
-void parseStatement()
+int parseStatement()
 {
+  int statement = 0;
+  int first = tokenindex, last = -1;
   switch(token_list[tokenindex++].type)
   { 
     case identsym:
@@ -592,57 +1236,64 @@ void parseStatement()
     if(symbol_table[symbolindex].kind != Variable) printErrorAndHalt(NonVarAltered);
     if(token_list[tokenindex++].type != becomessym) printErrorAndHalt(WrongAssignmentSymbol);
 
-    parseExpression();
-    insertInstruction(STO, currentLevel - symbol_table[symbolindex].level, symbol_table[symbolindex].addr, linenumber++);
+    statement = newSymbolNode(AssignNode, symbolindex);
+    node_list[statement].left = parseExpression();
     }
     break;
 
     case callsym:
     {
       int symbolindex = lookupSymbol(token_list[tokenindex++].name);
+      if(symbolindex == -1 && objectOutput && token_list[tokenindex-1].type == identsym)
+        symbolindex = insertExternal(token_list[tokenindex-1].name);
       if(symbolindex == -1) printErrorAndHalt(UndeclaredIdentifier);
       if(symbol_table[symbolindex].kind != Procedure) printErrorAndHalt(CallOnNonProc);
-      insertInstruction(CAL,  currentLevel - symbol_table[symbolindex].level, symbol_table[symbolindex].addr, linenumber++); //tentative
+      statement = newSymbolNode(CallNode, symbolindex);
     }
     break;
 
     
     case beginsym:
-    parseStatement();
-    while(token_list[tokenindex].type == semicolonsym)
     {
+    statement = newNode(BeginNode);
+    int last = 0;
+    int child = parseStatement();
+    while(1)
+    {
+      //empty statements generate nothing and are left out of the list
+      if(child != 0)
+      {
+        if(last == 0) node_list[statement].left = child;
+        else node_list[last].next = child;
+        last = child;
+      }
+
+      if(token_list[tokenindex].type != semicolonsym) break;
       tokenindex++;
-      parseStatement();
+      child = parseStatement();
     }
     if(token_list[tokenindex++].type != endsym) printErrorAndHalt(BeginNoEnd);
+    }
     break;
 
     case ifsym:
-    {
-    parseCondition();
+    statement = newNode(IfNode);
+    node_list[statement].left = parseCondition();
     if(token_list[tokenindex++].type != thensym) printErrorAndHalt(IfNoThen);
-    int tmp = linenumber++;
-    parseStatement();
-    insertInstruction(JPC, 0, (linenumber+1)*3, tmp);
-    int tmp2 = linenumber++;
+    last = tokenindex - 1;
+    node_list[statement].right = parseStatement();
     if(token_list[tokenindex++].type != elsesym) printErrorAndHalt(IfNoElse);
-    parseStatement();
-    insertInstruction(JMP, 0, (linenumber)*3, tmp2);
+    node_list[statement].third = parseStatement();
     if(token_list[tokenindex++].type != fisym) printErrorAndHalt(ElseNoFi);
-    }
     break;
 
 
     case whilesym:
-    {
-    int precondition = linenumber;
-    parseCondition();
-    int postcondition = linenumber++;
+    statement = newNode(WhileNode);
+    node_list[statement].left = parseCondition();
     if(token_list[tokenindex++].type != dosym) printErrorAndHalt(WhileNoDo);
-    parseStatement();
-    insertInstruction(JMP, 0, precondition*3, linenumber++);
-    insertInstruction(JPC, 0, linenumber*3, postcondition);
-    }
+    last = tokenindex - 1;
+    node_list[statement].right = parseStatement();
     break;
 
     case readsym:
@@ -651,14 +1302,13 @@ void parseStatement()
     if(symbolindex == -1) printErrorAndHalt(UndeclaredIdentifier);
     if(symbol_table[symbolindex].kind != Variable) printErrorAndHalt(NonVarAltered);
 
-    insertInstruction(SYS, 0, 2, linenumber++);
-    insertInstruction(STO, currentLevel - symbol_table[symbolindex].level, symbol_table[symbolindex].addr, linenumber++);
+    statement = newSymbolNode(ReadNode, symbolindex);
     }
     break;
     
     case writesym:
-    parseExpression();
-    insertInstruction(SYS, 0, 1, linenumber++);
+    statement = newNode(WriteNode);
+    node_list[statement].left = parseExpression();
     break;
 
 
@@ -667,19 +1317,27 @@ void parseStatement()
     --tokenindex; //didn't use token
     break;
   }
+
+  if(statement != 0)
+  {
+    node_list[statement].first = first;
+    node_list[statement].last = last != -1 ? last : tokenindex - 1;
+  }
+  return statement;
 }
 
-void parseCondition()
+int parseCondition()
 {
   if(token_list[tokenindex].type == evensym)
   {
     tokenindex++;
-    parseExpression();
-    insertInstruction(OPR, 0, EVEN, linenumber++);
+    int condition = newNode(EvenNode);
+    node_list[condition].left = parseExpression();
+    return condition;
   }
   else
   {
-    parseExpression();
+    int left = parseExpression();
     TokenType comparisontype = token_list[tokenindex++].type;
     enum Instructions comparisonopr;
     switch(comparisontype)
@@ -702,49 +1360,45 @@ void parseCondition()
     break;
     }
 
-    parseExpression();
-    insertInstruction(OPR, 0, comparisonopr, linenumber++);
+    return newBinaryNode(comparisonopr, left, parseExpression());
   }
 }
 
-void parseExpression()
+int parseExpression()
 {
-  parseTerm();
+  int expression = parseTerm();
 
   TokenType type = token_list[tokenindex].type; 
   while(type == plussym || type == minussym)
   {
     tokenindex++;
-    parseTerm();
-    if(type == plussym)
-      insertInstruction(OPR, 0, ADD, linenumber++);
-    else
-      insertInstruction(OPR, 0, SUB, linenumber++);
+    expression = newBinaryNode(type == plussym ? ADD : SUB, expression, parseTerm());
 
     type = token_list[tokenindex].type;
   } 
+
+  return expression;
 }
 
-void parseTerm()
+int parseTerm()
 {
-  parseFactor();
+  int term = parseFactor();
 
   TokenType type = token_list[tokenindex].type; 
   while(type == multsym || type == slashsym)
   {
     tokenindex++;
-    parseFactor();
-    if(type == multsym)
-      insertInstruction(OPR, 0, MUL, linenumber++);
-    else
-      insertInstruction(OPR, 0, DIV, linenumber++);
+    term = newBinaryNode(type == multsym ? MUL : DIV, term, parseFactor());
 
     type = token_list[tokenindex].type;
   }
+
+  return term;
 }
 
-void parseFactor()
+int parseFactor()
 {
+  int factor = 0;
   switch(token_list[tokenindex].type)
   {
     case identsym:
@@ -753,20 +1407,23 @@ void parseFactor()
       if(symbolindex == -1) printErrorAndHalt(UndeclaredIdentifier);
 
       if(symbol_table[symbolindex].kind == Variable)
-        insertInstruction(LOD, currentLevel - symbol_table[symbolindex].level, symbol_table[symbolindex].addr, linenumber++);
+        factor = newSymbolNode(VarNode, symbolindex);
       else // const
-        insertInstruction(LIT, 0, symbol_table[symbolindex].val, linenumber++);
+      {
+        factor = newNode(NumberNode);
+        node_list[factor].op = symbol_table[symbolindex].val;
+      }
     }
     break;
 
     case numbersym:
-    tokenindex++;
-    insertInstruction(LIT, 0, token_list[tokenindex].value, linenumber++);
+    factor = newNode(NumberNode);
+    node_list[factor].op = token_list[tokenindex++].value;
     break;
 
     case lparentsym:
     tokenindex++;
-    parseExpression();
+    factor = parseExpression();
     if(token_list[tokenindex++].type != rparentsym) printErrorAndHalt(14);
     break;
 
@@ -775,61 +1432,1309 @@ void parseFactor()
     break;
   }
 
+  return factor;
 }
 /*----- Grammar Checking -----*/
 
 
-int main()
+
+
+/*----- Local Value Numbering -----*/
+//Only run with -O. A basic block here is a run of assignments, reads, writes, and calls,
+//optionally ended by the condition of an if. Every expression node gets a value number,
+//variables remember which value they were last assigned, and stores/reads/calls kill
+//whatever they may have changed. A value computed twice in the block is reused either
+//from a variable that still holds it, with DUP when both operands of an operator are the
+//same value, or from a frame temporary when recomputing it would cost more than saving it.
+
+int isComputedValue(int _node)
 {
+  return node_list[_node].kind == BinaryNode || node_list[_node].kind == EvenNode;
+}
 
-  /*----- Open Input File -----*/
-  FILE* fp = fopen("token_list.txt", "r");
-  if(fp == NULL)
+int isCommutative(int _op)
+{
+  return _op == ADD || _op == MUL || _op == EQL || _op == NEQ;
+}
+
+int newValue(int _kind, int _op, int _a, int _b);
+
+//returns the value number of kind/op/a/b, creating it if it doesn't exist yet
+int lookupValue(int _kind, int _op, int _a, int _b)
+{
+  for(int i=0; i<valueCount; ++i)
   {
-    printf("Input file unable to be created\n");
-    exit(1);
+    Value v = value_table[i];
+    if(v.kind == _kind && v.op == _op && v.a == _a && v.b == _b)
+      return i;
   }
-  /*----- Open Input File -----*/
 
-  /*----- Read Tokens and Store -----*/
-  while(readToken(fp) == 0);
+  return newValue(_kind, _op, _a, _b);
+}
 
-  fclose(fp);
-  /*----- Read Tokens and Store -----*/
+int newValue(int _kind, int _op, int _a, int _b)
+{
+  if(valueCount == MAX_VALUE_TABLE_SIZE) exit(-1); //can't happen, see MAX_VALUE_TABLE_SIZE
+
+  Value v;
+  v.kind = _kind;
+  v.op = _op;
+  v.a = _a;
+  v.b = _b;
+
+  value_table[valueCount] = v;
+  valueComputed[valueCount] = 0;
+  valueRecomputed[valueCount] = 0;
+  valueCost[valueCount] = 0;
+  valueTemp[valueCount] = -1;
+  valueReady[valueCount] = 0;
+  return valueCount++;
+}
 
+//a fresh value nothing else can be equal to, used for variables with unknown contents
+int unknownValue(int _symbol)
+{
+  return newValue(VarNode, _symbol, valueCount, 0);
+}
 
-  isProgram(); //will exit program if error is found, not running remainder of main function.
+void killAllValues()
+{
+  for(int i=0; i<symbolCount; ++i)
+    currentValue[i] = -1;
+}
 
-  /*----- Print To File and Console -----*/
-  fp = fopen("elf.txt", "w");
+void beginBasicBlock()
+{
+  valueCount = 0;
+  killAllValues();
+}
 
-  printf("Assembly Code:\n\n"); //headers
-  printf("Line\t%4s%5s%5s\n", "OP", "L", "M"); //headers
+//number of instructions the expression takes when generated plainly
+int expressionCost(int _node)
+{
+  Node n = node_list[_node];
+  switch(n.kind)
+  {
+    case BinaryNode: return expressionCost(n.left) + expressionCost(n.right) + 1;
+    case EvenNode: return expressionCost(n.left) + 1;
+    default: return 1;
+  }
+}
 
-  for(int i=0; i<MAX_INSTRUCTION_TABLE_SIZE; ++i)
+void numberExpression(int _node)
+{
+  Node* n = &node_list[_node];
+  n->holder = -1;
+  n->dupRight = 0;
+
+  switch(n->kind)
   {
-    if(instruction_list[i].op == 0)
+    case NumberNode:
+      n->vn = lookupValue(NumberNode, n->op, 0, 0);
       break;
 
-    fprintf(fp,"%d %d %d\n", instruction_list[i].op, instruction_list[i].l, instruction_list[i].m);
+    case VarNode:
+      if(currentValue[n->symbol] == -1)
+        currentValue[n->symbol] = unknownValue(n->symbol);
+      n->vn = currentValue[n->symbol];
+      break;
 
-    printf("%3d", i);
-    printOP(instruction_list[i].op);
-    printf("%5d%5d\n", instruction_list[i].l, instruction_list[i].m);
-  }
+    case BinaryNode:
+    {
+      numberExpression(n->left);
+      numberExpression(n->right);
+      int a = node_list[n->left].vn;
+      int b = node_list[n->right].vn;
+      if(isCommutative(n->op) && b < a) { int tmp = a; a = b; b = tmp; }
+      n->vn = lookupValue(BinaryNode, n->op, a, b);
+    }
+    break;
 
-  fclose(fp);
+    case EvenNode:
+      numberExpression(n->left);
+      n->vn = lookupValue(EvenNode, EVEN, node_list[n->left].vn, 0);
+      break;
 
-  printf("\nSymbol Table:\n\n");
-  printf("Kind | Name        | Value | Level | Address | Mark\n");
-  printf("---------------------------------------------------\n");
+    case TempNode:
+      n->vn = lookupValue(TempNode, n->op, 0, 0);
+      break;
+
+    default:
+      break;
+  }
+}
 
+int findHolder(int _vn)
+{
   for(int i=0; i<MAX_SYMBOL_TABLE_SIZE; ++i)
   {
-    Symbol s = symbol_table[i]; if(s.kind == 0) break;
+    if(symbol_table[i].kind == 0)
+      break;
 
-    printf("%4d | %11s | %5d | %5d | %7d | %4d\n", s.kind, s.name, s.val, s.level, s.addr, s.mark);
+    if(currentValue[i] == _vn)
+      return i;
   }
+
+  return -1;
+}
+
+//walks the expression the way genExpression will, counting values that get computed more than once
+void countExpression(int _node)
+{
+  Node* n = &node_list[_node];
+  if(isComputedValue(_node))
+  {
+    n->holder = findHolder(n->vn);
+    if(n->holder != -1)
+      return;
+
+    if(valueComputed[n->vn])
+    {
+      valueRecomputed[n->vn]++;
+      return;
+    }
+
+    valueComputed[n->vn] = 1;
+    valueCost[n->vn] = expressionCost(_node);
+  }
+
+  if(n->kind == BinaryNode)
+  {
+    countExpression(n->left);
+    if(node_list[n->left].vn == node_list[n->right].vn && node_list[n->right].kind != NumberNode)
+      n->dupRight = 1;
+    else
+      countExpression(n->right);
+  }
+  else if(n->kind == EvenNode)
+    countExpression(n->left);
+}
+
+void analyzeExpression(int _node)
+{
+  numberExpression(_node);
+  countExpression(_node);
+}
+
+void analyzeStatement(int _node)
+{
+  Node n = node_list[_node];
+  switch(n.kind)
+  {
+    case AssignNode:
+      analyzeExpression(n.left);
+      currentValue[n.symbol] = node_list[n.left].vn;
+      break;
+
+    case WriteNode:
+      analyzeExpression(n.left);
+      break;
+
+    case ReadNode:
+      currentValue[n.symbol] = unknownValue(n.symbol);
+      break;
+
+    case CallNode:
+      killAllValues(); //the callee may store to anything it can see
+      break;
+
+    default:
+      break;
+  }
+}
+
+//saving a value costs a DUP and a STO, each reuse then costs a LOD instead of the whole expression
+void assignTemporaries()
+{
+  int used = 0;
+  for(int i=0; i<valueCount; ++i)
+  {
+    if(valueRecomputed[i] * (valueCost[i] - 1) <= 2)
+      continue;
+
+    valueTemp[i] = frameLocals + tempBase + used++;
+  }
+
+  if(tempBase + used > frameTemps)
+    frameTemps = tempBase + used;
+}
+
+int isStraightLine(int _node)
+{
+  NodeKind kind = node_list[_node].kind;
+  return kind == AssignNode || kind == WriteNode || kind == ReadNode || kind == CallNode;
+}
+/*----- Local Value Numbering -----*/
+
+
+
+
+/*----- Loop Invariant Code Motion -----*/
+void genExpression(int _node);
+void genVariable(int _op, int _level, int _addr);
+
+//Only run with -O. Before a while loop is generated, every maximal expression in its
+//condition and body that only reads constants and variables the loop never stores to is
+//moved into a preheader that runs once before the loop and saves it in a frame temporary.
+//Calls are accounted for through the set of variables each procedure may store to.
+//Loops are handled outermost first, so an expression invariant in several nested loops
+//ends up in the outermost preheader it can reach.
+
+//adds every variable the statement may store to into _set, returns whether _set changed
+int statementModifies(int _node, char* _set)
+{
+  int changed = 0;
+  Node n = node_list[_node];
+  switch(n.kind)
+  {
+    case AssignNode:
+    case ReadNode:
+      changed = !_set[n.symbol];
+      _set[n.symbol] = 1;
+      break;
+
+    case CallNode:
+      for(int i=0; i<symbolCount; ++i)
+      {
+        if(procModifies[n.symbol][i] && !_set[i])
+        {
+          _set[i] = 1;
+          changed = 1;
+        }
+      }
+      break;
+
+    case BeginNode:
+      for(int child = n.left; child != 0; child = node_list[child].next)
+        changed |= statementModifies(child, _set);
+      break;
+
+    case IfNode:
+      changed |= statementModifies(n.right, _set);
+      changed |= statementModifies(n.third, _set);
+      break;
+
+    case WhileNode:
+      changed |= statementModifies(n.right, _set);
+      break;
+
+    default:
+      break;
+  }
+
+  return changed;
+}
+
+int blockModifies(int _block)
+{
+  int changed = 0;
+  for(int proc = node_list[_block].left; proc != 0; proc = node_list[proc].next)
+  {
+    changed |= blockModifies(proc);
+    changed |= statementModifies(node_list[proc].right, procModifies[node_list[proc].symbol]);
+  }
+
+  return changed;
+}
+
+//procedures can call themselves and their earlier siblings, so iterate until nothing grows
+void computeModifies(int _program)
+{
+  while(blockModifies(_program));
+}
+
+int isInvariant(int _node)
+{
+  Node n = node_list[_node];
+  switch(n.kind)
+  {
+    case NumberNode:
+    case TempNode: //only written by the preheader of an enclosing loop
+      return 1;
+    case VarNode:
+      return !loopModifies[n.symbol];
+    case BinaryNode:
+      return isInvariant(n.left) && isInvariant(n.right);
+    case EvenNode:
+      return isInvariant(n.left);
+    default:
+      return 0;
+  }
+}
+
+//division by anything but a nonzero literal may trap, so it must not run more often than before
+int mayTrap(int _node)
+{
+  Node n = node_list[_node];
+  if(n.kind == BinaryNode)
+  {
+    if(n.op == DIV && !(node_list[n.right].kind == NumberNode && node_list[n.right].op != 0))
+      return 1;
+    return mayTrap(n.left) || mayTrap(n.right);
+  }
+  if(n.kind == EvenNode)
+    return mayTrap(n.left);
+  return 0;
+}
+
+int sameExpression(int _a, int _b)
+{
+  Node a = node_list[_a], b = node_list[_b];
+  if(a.kind != b.kind || a.op != b.op || a.symbol != b.symbol)
+    return 0;
+  if(a.kind == BinaryNode)
+    return sameExpression(a.left, b.left) && sameExpression(a.right, b.right);
+  if(a.kind == EvenNode)
+    return sameExpression(a.left, b.left);
+  return 1;
+}
+
+//_alwaysRuns is set for the loop condition, which is evaluated at least once whenever the preheader is
+void hoistFromExpression(int _node, int _alwaysRuns)
+{
+  Node* n = &node_list[_node];
+  if(!isComputedValue(_node))
+    return;
+
+  if(!isInvariant(_node) || (!_alwaysRuns && mayTrap(_node)))
+  {
+    hoistFromExpression(n->left, _alwaysRuns);
+    if(n->kind == BinaryNode)
+      hoistFromExpression(n->right, _alwaysRuns);
+    return;
+  }
+
+  int slot = -1;
+  for(int i=0; i<hoistedCount; ++i)
+  {
+    if(sameExpression(hoisted[i], _node))
+      slot = frameLocals + tempBase + i;
+  }
+
+  if(slot == -1)
+  {
+    if(hoistedCount == MAX_HOISTED_PER_LOOP)
+      return;
+
+    //the preheader gets a copy, the expression inside the loop becomes a load of the temporary
+    int copy = newNode(NullNode);
+    node_list[copy] = *n;
+    slot = frameLocals + tempBase + hoistedCount;
+    hoisted[hoistedCount++] = copy;
+  }
+
+  n->kind = TempNode;
+  n->op = slot;
+  n->left = n->right = 0;
+}
+
+void hoistFromStatement(int _node)
+{
+  Node n = node_list[_node];
+  switch(n.kind)
+  {
+    case AssignNode:
+    case WriteNode:
+      hoistFromExpression(n.left, 0);
+      break;
+
+    case BeginNode:
+      for(int child = n.left; child != 0; child = node_list[child].next)
+        hoistFromStatement(child);
+      break;
+
+    case IfNode:
+      hoistFromExpression(n.left, 0);
+      hoistFromStatement(n.right);
+      hoistFromStatement(n.third);
+      break;
+
+    case WhileNode:
+      hoistFromExpression(n.left, 0);
+      hoistFromStatement(n.right);
+      break;
+
+    default:
+      break;
+  }
+}
+
+//emits the preheader of the loop and reserves its temporaries until the loop is generated
+void hoistLoopInvariants(int _loop)
+{
+  memset(loopModifies, 0, sizeof(loopModifies));
+  statementModifies(_loop, loopModifies);
+
+  hoistedCount = 0;
+  hoistFromExpression(node_list[_loop].left, 1);
+  hoistFromStatement(node_list[_loop].right);
+
+  int firstSlot = frameLocals + tempBase;
+  tempBase += hoistedCount;
+
+  //the preheader is straight-line code, so it is value numbered like any other basic block
+  beginBasicBlock();
+  for(int i=0; i<hoistedCount; ++i)
+    analyzeExpression(hoisted[i]);
+  assignTemporaries();
+
+  for(int i=0; i<hoistedCount; ++i)
+  {
+    genExpression(hoisted[i]);
+    genVariable(STO, genLevel, firstSlot + i);
+  }
+}
+/*----- Loop Invariant Code Motion -----*/
+
+
+
+
+/*----- Code Generation -----*/
+void genBlock(int _block);
+void genProcedure(int _proc);
+void genSequence(int _first);
+void genStatement(int _node);
+void genExpression(int _node);
+
+//LOD/STO of a variable declared at _level. With -O, accesses that don't need the static chain
+//use the direct forms: globals from inside procedures use LDG/STG, locals use LDL/STL
+void genVariable(int _op, int _level, int _addr)
+{
+  int l = genLevel - _level;
+  if(optimize && l == 0)
+    _op = (_op == LOD) ? LDL : STL;
+  else if(optimize && _level == 0)
+    _op = (_op == LOD) ? LDG : STG;
+
+  globalAccess[linenumber] = _level == 0;
+  insertInstruction(_op, (_op == LOD || _op == STO) ? l : 0, _addr, linenumber++);
+}
+
+//the range of _node, where the instructions generated for it come from
+SourceRange nodeSource(int _node)
+{
+  SourceRange range;
+  range.first = node_list[_node].first;
+  range.last = node_list[_node].last;
+  return range;
+}
+
+void genBlock(int _block)
+{
+  Node block = node_list[_block];
+  currentSource = nodeSource(_block);
+
+  int jmpLocaton = linenumber++;
+  for(int proc = block.left; proc != 0; proc = node_list[proc].next)
+    genProcedure(proc);
+  insertInstruction(JMP, 0, (linenumber)*3, jmpLocaton);
+
+  //temporaries are only known once the body is generated, so INC is filled in afterwards
+  int savedLocals = frameLocals, savedTemps = frameTemps, savedBase = tempBase;
+  frameLocals = block.op;
+  frameTemps = 0;
+  tempBase = 0;
+
+  int incLocation = linenumber++;
+  genSequence(block.right);
+  insertInstruction(INC, 0, frameLocals + frameTemps, incLocation);
+
+  frameLocals = savedLocals;
+  frameTemps = savedTemps;
+  tempBase = savedBase;
+}
+
+void genProcedure(int _proc)
+{
+  Node proc = node_list[_proc];
+  symbol_table[proc.symbol].addr = linenumber*3;
+
+  //written back to elf.cache with -i, enclosing procedures first
+  int compiled = -1;
+  unsigned long long savedEnclosing = enclosingKey;
+  if(proc.key != 0)
+  {
+    compiled = compiledCount++;
+    compiled_list[compiled].key = proc.key;
+    compiled_list[compiled].parent = enclosingKey;
+    compiled_list[compiled].start = linenumber;
+    compiled_list[compiled].header = proc.first;
+  }
+  enclosingKey = proc.key;
+
+  SourceRange savedSource = currentSource;
+  ++genLevel;
+  if(proc.fragment != 0)
+    genFragment(_proc);
+  else
+  {
+    genBlock(_proc);
+    insertInstruction(OPR, 0, RTN, linenumber++);  
+  }
+  --genLevel;
+  currentSource = savedSource;
+
+  if(compiled != -1)
+    compiled_list[compiled].count = linenumber - compiled_list[compiled].start;
+  enclosingKey = savedEnclosing;
+}
+
+void genSequence(int _first)
+{
+  int statement = _first;
+  while(statement != 0)
+  {
+    if(!optimize || !(isStraightLine(statement) || node_list[statement].kind == IfNode))
+    {
+      genStatement(statement);
+      statement = node_list[statement].next;
+      continue;
+    }
+
+    //analyze the whole basic block first so reused values know to save themselves
+    beginBasicBlock();
+    int end = statement;
+    while(end != 0 && isStraightLine(end))
+    {
+      analyzeStatement(end);
+      end = node_list[end].next;
+    }
+    if(end != 0 && node_list[end].kind == IfNode)
+    {
+      analyzeExpression(node_list[end].left);
+      end = node_list[end].next;
+    }
+    assignTemporaries();
+
+    for(; statement != end; statement = node_list[statement].next)
+      genStatement(statement);
+  }
+}
+
+void genStatement(int _node)
+{
+  Node n = node_list[_node];
+  SourceRange savedSource = currentSource;
+  currentSource = nodeSource(_node);
+  switch(n.kind)
+  {
+    case AssignNode:
+    genExpression(n.left);
+    genVariable(STO, symbol_table[n.symbol].level, symbol_table[n.symbol].addr);
+    break;
+
+    case CallNode:
+    calledSymbol[linenumber] = n.symbol + 1;
+    insertInstruction(CAL, genLevel - symbol_table[n.symbol].level, symbol_table[n.symbol].addr, linenumber++);
+    break;
+
+    case BeginNode:
+    genSequence(n.left);
+    break;
+
+    case IfNode:
+    {
+    genExpression(n.left);
+    int tmp = linenumber++;
+    genSequence(n.right);
+    insertInstruction(JPC, 0, (linenumber+1)*3, tmp);
+    int tmp2 = linenumber++;
+    genSequence(n.third);
+    insertInstruction(JMP, 0, (linenumber)*3, tmp2);
+    }
+    break;
+
+    case WhileNode:
+    {
+    int savedBase = tempBase;
+    if(optimize)
+    {
+      hoistLoopInvariants(_node);
+
+      beginBasicBlock();
+      analyzeExpression(n.left);
+      assignTemporaries();
+    }
+
+    int precondition = linenumber;
+    genExpression(n.left);
+    int postcondition = linenumber++;
+    genSequence(n.right);
+    insertInstruction(JMP, 0, precondition*3, linenumber++);
+    insertInstruction(JPC, 0, linenumber*3, postcondition);
+    tempBase = savedBase;
+    }
+    break;
+
+    case ReadNode:
+    insertInstruction(SYS, 0, 2, linenumber++);
+    genVariable(STO, symbol_table[n.symbol].level, symbol_table[n.symbol].addr);
+    break;
+
+    case WriteNode:
+    genExpression(n.left);
+    insertInstruction(SYS, 0, 1, linenumber++);
+    break;
+
+    default:
+    break;
+  }
+  currentSource = savedSource;
+}
+
+void genExpression(int _node)
+{
+  Node n = node_list[_node];
+
+  if(optimize && isComputedValue(_node))
+  {
+    if(n.holder != -1)
+    {
+      genVariable(LOD, symbol_table[n.holder].level, symbol_table[n.holder].addr);
+      return;
+    }
+
+    if(valueTemp[n.vn] != -1 && valueReady[n.vn])
+    {
+      genVariable(LOD, genLevel, valueTemp[n.vn]);
+      return;
+    }
+  }
+
+  switch(n.kind)
+  {
+    case NumberNode:
+    insertInstruction(LIT, 0, n.op, linenumber++);
+    break;
+
+    case VarNode:
+    genVariable(LOD, symbol_table[n.symbol].level, symbol_table[n.symbol].addr);
+    break;
+
+    case BinaryNode:
+    genExpression(n.left);
+    if(n.dupRight)
+      insertInstruction(OPR, 0, DUP, linenumber++);
+    else
+      genExpression(n.right);
+    insertInstruction(OPR, 0, n.op, linenumber++);
+    break;
+
+    case EvenNode:
+    genExpression(n.left);
+    insertInstruction(OPR, 0, EVEN, linenumber++);
+    break;
+
+    case TempNode:
+    genVariable(LOD, genLevel, n.op);
+    break;
+
+    default:
+    break;
+  }
+
+  //first computation of a value that will be reused, keep a copy in its temporary
+  if(optimize && isComputedValue(_node) && valueTemp[n.vn] != -1)
+  {
+    insertInstruction(OPR, 0, DUP, linenumber++);
+    genVariable(STO, genLevel, valueTemp[n.vn]);
+    valueReady[n.vn] = 1;
+  }
+}
+/*----- Code Generation -----*/
+
+
+
+
+/*----- Register Backend -----*/
+//Selected with -r instead of the PM/0 code above. Expressions are generated into virtual
+//registers one statement at a time, then a linear scan allocates them onto the register file
+//of rvm.c. Virtual registers never live past the statement that computes them, so each
+//statement's code is allocated on its own, and the ones that don't fit are spilled to frame
+//temporaries past the locals. Variables themselves still live in activation records laid out
+//exactly like PM/0 ones.
+
+int regUses(int _op)
+{
+  switch(_op)
+  {
+    case RST: case RJPZ: return 1;
+    case RSYS: return 2; //PRINT only, see regDefines
+    case REVEN: return 2;
+    default:
+      if(_op >= RADD && _op <= RGEQ) return 2 | 4;
+      if(_op >= RADDI && _op <= RGEQI) return 2;
+      return 0;
+  }
+}
+
+//_a is needed because READ defines b while PRINT uses it
+int regDefines(int _op, int _a)
+{
+  if(_op == RLI || _op == RLD || _op == REVEN) return 1;
+  if(_op >= RADD && _op <= RGEQI) return 1;
+  if(_op == RSYS && _a == READ) return 2;
+  return 0;
+}
+
+void insertRegInstruction(int _op, int _a, int _b, int _c)
+{
+  if(reglinenumber == MAX_REG_INSTRUCTION_TABLE_SIZE)
+  {
+    printf("Error: program is too large for the register backend\n");
+    exit(1);
+  }
+
+  RegInstruction newinstruction;
+  newinstruction.op = _op;
+  newinstruction.a = _a;
+  newinstruction.b = _b;
+  newinstruction.c = _c;
+  reg_list[reglinenumber++] = newinstruction;
+}
+
+void insertVirtual(int _op, int _a, int _b, int _c)
+{
+  if(virtualCount == MAX_VIRTUAL_TABLE_SIZE) exit(-1); //statement is absurdly long
+
+  RegInstruction newinstruction;
+  newinstruction.op = _op;
+  newinstruction.a = _a;
+  newinstruction.b = _b;
+  newinstruction.c = _c;
+  virtual_list[virtualCount++] = newinstruction;
+}
+
+int newVirtualRegister()
+{
+  if(vregCount == MAX_VIRTUAL_TABLE_SIZE) exit(-1);
+  return vregCount++;
+}
+
+int regExpression(int _node)
+{
+  Node n = node_list[_node];
+  int v;
+  switch(n.kind)
+  {
+    case NumberNode:
+      v = newVirtualRegister();
+      insertVirtual(RLI, v, n.op, 0);
+      return v;
+
+    case VarNode:
+      v = newVirtualRegister();
+      insertVirtual(RLD, v, genLevel - symbol_table[n.symbol].level, symbol_table[n.symbol].addr);
+      return v;
+
+    case BinaryNode:
+    {
+      //constant operands become immediates
+      if(node_list[n.right].kind == NumberNode)
+      {
+        int left = regExpression(n.left);
+        v = newVirtualRegister();
+        insertVirtual(RADDI - ADD + n.op, v, left, node_list[n.right].op);
+        return v;
+      }
+      if(node_list[n.left].kind == NumberNode && isCommutative(n.op))
+      {
+        int right = regExpression(n.right);
+        v = newVirtualRegister();
+        insertVirtual(RADDI - ADD + n.op, v, right, node_list[n.left].op);
+        return v;
+      }
+
+      int left = regExpression(n.left);
+      int right = regExpression(n.right);
+      v = newVirtualRegister();
+      insertVirtual(RADD - ADD + n.op, v, left, right);
+      return v;
+    }
+
+    case EvenNode:
+    {
+      int left = regExpression(n.left);
+      v = newVirtualRegister();
+      insertVirtual(REVEN, v, left, 0);
+      return v;
+    }
+
+    default:
+      return -1;
+  }
+}
+
+//operand field _field (0 = a, 1 = b, 2 = c) of a virtual instruction
+int* regField(RegInstruction* _instruction, int _field)
+{
+  return _field == 0 ? &_instruction->a : (_field == 1 ? &_instruction->b : &_instruction->c);
+}
+
+//linear scan over the buffered statement, then emits it with spill code
+void flushVirtual()
+{
+  int start[MAX_VIRTUAL_TABLE_SIZE], end[MAX_VIRTUAL_TABLE_SIZE];
+  int physical[MAX_VIRTUAL_TABLE_SIZE], spillSlot[MAX_VIRTUAL_TABLE_SIZE];
+
+  for(int i=0; i<virtualCount; ++i)
+  {
+    RegInstruction instruction = virtual_list[i];
+    int uses = regUses(instruction.op), defines = regDefines(instruction.op, instruction.a);
+    if(instruction.op == RSYS && instruction.a != PRINT) uses = 0;
+
+    for(int f=0; f<3; ++f)
+    {
+      if(uses & (1 << f)) end[*regField(&instruction, f)] = i;
+      if(defines & (1 << f)) start[*regField(&instruction, f)] = end[*regField(&instruction, f)] = i;
+    }
+  }
+
+  //virtual registers are numbered in the order they are defined, so they are already sorted by start
+  int active[ALLOCATABLE_REGISTERS]; //sorted by end
+  int activeCount = 0;
+  int freeRegister[ALLOCATABLE_REGISTERS];
+  int spills = 0;
+  for(int r=0; r<ALLOCATABLE_REGISTERS; ++r)
+    freeRegister[r] = 1;
+
+  for(int v=0; v<vregCount; ++v)
+  {
+    spillSlot[v] = -1;
+
+    //an operand whose last use is the instruction defining v can share its register
+    int kept = 0;
+    for(int i=0; i<activeCount; ++i)
+    {
+      if(end[active[i]] <= start[v])
+        freeRegister[physical[active[i]]] = 1;
+      else
+        active[kept++] = active[i];
+    }
+    activeCount = kept;
+
+    int reg = -1;
+    for(int r=0; r<ALLOCATABLE_REGISTERS && reg == -1; ++r)
+      if(freeRegister[r]) reg = r;
+
+    if(reg == -1)
+    {
+      //spill whichever interval ends last
+      int last = active[activeCount-1];
+      if(end[last] > end[v])
+      {
+        reg = physical[last];
+        spillSlot[last] = frameLocals + tempBase + spills++;
+        --activeCount;
+      }
+      else
+      {
+        spillSlot[v] = frameLocals + tempBase + spills++;
+        continue;
+      }
+    }
+
+    physical[v] = reg;
+    freeRegister[reg] = 0;
+
+    int pos = activeCount++;
+    while(pos > 0 && end[active[pos-1]] > end[v])
+    {
+      active[pos] = active[pos-1];
+      --pos;
+    }
+    active[pos] = v;
+  }
+
+  if(tempBase + spills > frameTemps)
+    frameTemps = tempBase + spills;
+
+  for(int i=0; i<virtualCount; ++i)
+  {
+    RegInstruction instruction = virtual_list[i];
+    int uses = regUses(instruction.op), defines = regDefines(instruction.op, instruction.a);
+    if(instruction.op == RSYS && instruction.a != PRINT) uses = 0;
+
+    int scratch = ALLOCATABLE_REGISTERS;
+    for(int f=0; f<3; ++f)
+    {
+      if(!(uses & (1 << f))) continue;
+      int* field = regField(&instruction, f);
+      if(spillSlot[*field] != -1)
+      {
+        insertRegInstruction(RLD, scratch, 0, spillSlot[*field]);
+        *field = scratch++;
+      }
+      else
+        *field = physical[*field];
+    }
+
+    int spilledDef = -1;
+    for(int f=0; f<3; ++f)
+    {
+      if(!(defines & (1 << f))) continue;
+      int* field = regField(&instruction, f);
+      spilledDef = spillSlot[*field];
+      *field = (spilledDef != -1) ? ALLOCATABLE_REGISTERS : physical[*field];
+    }
+
+    insertRegInstruction(instruction.op, instruction.a, instruction.b, instruction.c);
+    if(spilledDef != -1)
+      insertRegInstruction(RST, ALLOCATABLE_REGISTERS, 0, spilledDef);
+  }
+
+  virtualCount = 0;
+  vregCount = 0;
+}
+
+void regBlock(int _block);
+void regSequence(int _first);
+void regStatement(int _node);
+
+void regBlock(int _block)
+{
+  Node block = node_list[_block];
+
+  int jmpLocation = reglinenumber;
+  insertRegInstruction(RJMP, 0, 0, 0);
+  for(int proc = block.left; proc != 0; proc = node_list[proc].next)
+  {
+    symbol_table[node_list[proc].symbol].addr = reglinenumber;
+    ++genLevel;
+    regBlock(proc);
+    insertRegInstruction(RRTN, 0, 0, 0);
+    --genLevel;
+  }
+  reg_list[jmpLocation].a = reglinenumber;
+
+  int savedLocals = frameLocals, savedTemps = frameTemps, savedBase = tempBase;
+  frameLocals = block.op;
+  frameTemps = 0;
+  tempBase = 0;
+
+  int incLocation = reglinenumber;
+  insertRegInstruction(RINC, 0, 0, 0);
+  regSequence(block.right);
+  reg_list[incLocation].a = frameLocals + frameTemps;
+
+  frameLocals = savedLocals;
+  frameTemps = savedTemps;
+  tempBase = savedBase;
+}
+
+void regSequence(int _first)
+{
+  for(int statement = _first; statement != 0; statement = node_list[statement].next)
+    regStatement(statement);
+}
+
+//returns the location of the JPZ so the caller can fill in its target
+int regCondition(int _node)
+{
+  insertVirtual(RJPZ, regExpression(_node), 0, 0);
+  flushVirtual();
+  return reglinenumber - 1;
+}
+
+void regStatement(int _node)
+{
+  Node n = node_list[_node];
+  switch(n.kind)
+  {
+    case AssignNode:
+    insertVirtual(RST, regExpression(n.left), genLevel - symbol_table[n.symbol].level, symbol_table[n.symbol].addr);
+    flushVirtual();
+    break;
+
+    case CallNode:
+    insertRegInstruction(RCAL, symbol_table[n.symbol].addr, genLevel - symbol_table[n.symbol].level, 0);
+    break;
+
+    case BeginNode:
+    regSequence(n.left);
+    break;
+
+    case IfNode:
+    {
+    int jpz = regCondition(n.left);
+    regSequence(n.right);
+    int jmp = reglinenumber;
+    insertRegInstruction(RJMP, 0, 0, 0);
+    reg_list[jpz].b = reglinenumber;
+    regSequence(n.third);
+    reg_list[jmp].a = reglinenumber;
+    }
+    break;
+
+    case WhileNode:
+    {
+    int precondition = reglinenumber;
+    int jpz = regCondition(n.left);
+    regSequence(n.right);
+    insertRegInstruction(RJMP, precondition, 0, 0);
+    reg_list[jpz].b = reglinenumber;
+    }
+    break;
+
+    case ReadNode:
+    {
+    int v = newVirtualRegister();
+    insertVirtual(RSYS, READ, v, 0);
+    insertVirtual(RST, v, genLevel - symbol_table[n.symbol].level, symbol_table[n.symbol].addr);
+    flushVirtual();
+    }
+    break;
+
+    case WriteNode:
+    insertVirtual(RSYS, PRINT, regExpression(n.left), 0);
+    flushVirtual();
+    break;
+
+    default:
+    break;
+  }
+}
+
+void printRegOP(int _op)
+{
+  static const char* names[] = {"", "LI", "LD", "ST", "CAL", "INC", "JMP", "JPZ", "SYS", "RTN",
+    "ADD", "SUB", "MUL", "DIV", "EQL", "NEQ", "LSS", "LEQ", "GTR", "GEQ",
+    "ADDI", "SUBI", "MULI", "DIVI", "EQLI", "NEQI", "LSSI", "LEQI", "GTRI", "GEQI", "EVEN"};
+
+  if(_op > 0 && _op <= REVEN)
+    printf("%9s", names[_op]);
+  else
+    printf("PRINTING ERROR");
+}
+/*----- Register Backend -----*/
+
+
+
+/*----- Executable -----*/
+//elf.bin, packed as executable.h lays it out with the source ranges of
+//elf.map built in. vm.c maps it whole and unpacks it without parsing anything.
+void writeExecutable(FILE* _fp)
+{
+  const char* path = sourcePath[0] != '\0' ? sourcePath : NULL;
+  unsigned* body = allocateExecutable(linenumber, path);
+  int* ranges = malloc(4*sizeof(int)*linenumber + 1);
+  if(body == NULL || ranges == NULL)
+  {
+    printf("Unable to allocate the executable\n");
+    exit(1);
+  }
+
+  int constantCount = 0;
+  for(unsigned i=0; i<linenumber; ++i)
+  {
+    packInstruction(body, linenumber, i, &constantCount, instruction_list[i].op, instruction_list[i].l, instruction_list[i].m);
+
+    Token first = token_list[source_list[i].first], last = token_list[source_list[i].last];
+    ranges[4*i] = first.line;
+    ranges[4*i + 1] = first.column;
+    ranges[4*i + 2] = last.line;
+    ranges[4*i + 3] = last.column + (last.length > 0 ? last.length - 1 : 0);
+  }
+
+  writeExecutableFile(_fp, body, linenumber, constantCount, path, ranges);
+  free(body);
+  free(ranges);
+}
+/*----- Executable -----*/
+
+
+
+/*----- Object -----*/
+//elf.o (-c): the module's code as in elf.txt, with what pl0ld needs to place
+//it next to other modules' and call between them. Every procedure declared at
+//level 0 is exported, and every call to one that isn't declared is left to be
+//resolved against the other modules' exports. The main block's variables are
+//laid out after the other modules' in one main activation record, so every
+//instruction addressing it is relocated, and the main block's statements run
+//one module after another in the order pl0ld is given them.
+//  pl0 object 1
+//  code <instructions>, then one "op l m" line each
+//  export <procedure> <index of its first instruction>
+//  relocate code <index>        m is an address in this module's code
+//  relocate data <index>        m is an offset into the main activation record
+//  relocate call <index> <name> CAL of a procedure another module exports
+void writeObject(FILE* _fp)
+{
+  fprintf(_fp, "pl0 object 1\ncode %u\n", linenumber);
+  for(unsigned i=0; i<linenumber; ++i)
+    fprintf(_fp, "%d %d %d\n", instruction_list[i].op, instruction_list[i].l, instruction_list[i].m);
+
+  for(int i=0; i<MAX_SYMBOL_TABLE_SIZE && symbol_table[i].kind != 0; ++i)
+    if(symbol_table[i].kind == Procedure && symbol_table[i].level == 0 && !symbol_table[i].external)
+      fprintf(_fp, "export %s %d\n", symbol_table[i].name, symbol_table[i].addr / 3);
+
+  for(unsigned i=0; i<linenumber; ++i)
+  {
+    int op = instruction_list[i].op;
+    if(op == CAL && symbol_table[calledSymbol[i] - 1].external && !symbol_table[calledSymbol[i] - 1].definition)
+      fprintf(_fp, "relocate call %u %s\n", i, symbol_table[calledSymbol[i] - 1].name);
+    else if(op == JMP || op == JPC || op == CAL)
+      fprintf(_fp, "relocate code %u\n", i);
+    else if(globalAccess[i])
+      fprintf(_fp, "relocate data %u\n", i);
+  }
+}
+/*----- Object -----*/
+
+
+int main(int argc, char** argv)
+{
+  for(int i=1; i<argc; ++i)
+  {
+    if(strcmp(argv[i], "-O") == 0)
+      optimize = 1;
+    else if(strcmp(argv[i], "-r") == 0)
+      registerBackend = 1;
+    else if(strcmp(argv[i], "-b") == 0)
+      binaryOutput = 1;
+    else if(strcmp(argv[i], "-c") == 0)
+      objectOutput = 1;
+    else if(strcmp(argv[i], "-i") == 0)
+      incremental = 1;
+    else
+    {
+      printf("Unknown option %s\n", argv[i]);
+      exit(1);
+    }
+  }
+  if(objectOutput && (registerBackend || binaryOutput))
+  {
+    printf("-c can't be combined with -r or -b\n");
+    exit(1);
+  }
+  if(incremental && (optimize || registerBackend || objectOutput))
+  {
+    printf("-i can't be combined with -O, -r, or -c\n");
+    exit(1);
+  }
+
+  /*----- Open Input File -----*/
+  FILE* fp = fopen("token_list.txt", "r");
+  if(fp == NULL)
+  {
+    printf("Input file unable to be created\n");
+    exit(1);
+  }
+  /*----- Open Input File -----*/
+
+  /*----- Read Tokens and Store -----*/
+  //token positions are optional, without them no elf.map is written
+  FILE* map = fopen("token_map.txt", "r");
+  if(map != NULL && (fgets(sourcePath, sizeof(sourcePath), map) == NULL || sourcePath[0] == '\n'))
+  {
+    fclose(map);
+    map = NULL;
+  }
+  if(map != NULL)
+    sourcePath[strcspn(sourcePath, "\n")] = '\0';
+  else
+    sourcePath[0] = '\0';
+
+  while(readToken(fp, map) == 0);
+
+  fclose(fp);
+  if(map != NULL)
+    fclose(map);
+
+  if(incremental)
+    readCache();
+  /*----- Read Tokens and Store -----*/
+
+
+  int program = isProgram(); //will exit program if error is found, not running remainder of main function.
+
+  /*----- Generate Code -----*/
+  if(registerBackend)
+  {
+    regBlock(program);
+    insertRegInstruction(RSYS, HALT, 0, 0);
+
+    fp = fopen("relf.txt", "w");
+
+    printf("Register Code:\n\n"); //headers
+    printf("Line\t%4s%5s%5s%5s\n", "OP", "A", "B", "C"); //headers
+
+    for(int i=0; i<reglinenumber; ++i)
+    {
+      RegInstruction r = reg_list[i];
+      fprintf(fp, "%d %d %d %d\n", r.op, r.a, r.b, r.c);
+
+      printf("%3d", i);
+      printRegOP(r.op);
+      printf("%5d%5d%5d\n", r.a, r.b, r.c);
+    }
+
+    fclose(fp);
+    printSymbolTable();
+    return 0;
+  }
+
+  if(optimize)
+    computeModifies(program);
+
+  genBlock(program);
+  currentSource.first = currentSource.last = node_list[program].last; //HALT comes from the final period
+  insertInstruction(SYS, 0, 3, linenumber++);
+
+  //calls to procedures of this module made before they were declared, see defineExternal
+  for(unsigned i=0; objectOutput && i<linenumber; ++i)
+    if(instruction_list[i].op == CAL && symbol_table[calledSymbol[i] - 1].definition)
+      instruction_list[i].m = symbol_table[symbol_table[calledSymbol[i] - 1].definition - 1].addr;
+  /*----- Generate Code -----*/
+
+  /*----- Print To File and Console -----*/
+  fp = fopen(objectOutput ? "elf.o" : binaryOutput ? "elf.bin" : "elf.txt", binaryOutput ? "wb" : "w");
+
+  printf("Assembly Code:\n\n"); //headers
+  printf("Line\t%4s%5s%5s\n", "OP", "L", "M"); //headers
+
+  for(int i=0; i<MAX_INSTRUCTION_TABLE_SIZE; ++i)
+  {
+    if(instruction_list[i].op == 0)
+      break;
+
+    if(!binaryOutput && !objectOutput)
+      fprintf(fp,"%d %d %d\n", instruction_list[i].op, instruction_list[i].l, instruction_list[i].m);
+
+    printf("%3d", i);
+    printOP(instruction_list[i].op);
+    printf("%5d%5d\n", instruction_list[i].l, instruction_list[i].m);
+  }
+
+  if(binaryOutput)
+    writeExecutable(fp);
+  if(objectOutput)
+    writeObject(fp);
+  fclose(fp);
+
+  //elf.map: the source path, then for every line of elf.txt the source range it was
+  //generated from as first line, first column, last line, last column
+  if(sourcePath[0] != '\0' && !binaryOutput && !objectOutput)
+  {
+    fp = fopen("elf.map", "w");
+    fprintf(fp, "%s\n", sourcePath);
+    for(int i=0; i<linenumber; ++i)
+    {
+      Token first = token_list[source_list[i].first], last = token_list[source_list[i].last];
+      fprintf(fp, "%d %d %d %d\n", first.line, first.column, last.line, last.column + (last.length > 0 ? last.length - 1 : 0));
+    }
+    fclose(fp);
+  }
+
+  if(incremental)
+  {
+    fp = fopen("elf.cache", "wb");
+    writeCache(fp);
+    fclose(fp);
+    printf("\nProcedures: %d reused from elf.cache, %d compiled\n", proceduresReused, proceduresParsed);
+  }
+
+  printSymbolTable();
   /*----- Print To File and Console -----*/
 
 
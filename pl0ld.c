@@ -0,0 +1,415 @@
+/*
+  PL/0 Linker
+
+  Links modules compiled on their own with parsercodegen_complete.c -c into
+  one program for vm.c. Each module's procedures are laid out one after
+  another, then a single main block runs the main blocks of all of them in
+  the order they were given, every module's variables side by side in its
+  activation record. Calls a module left unresolved are pointed at the
+  procedure another module exports under that name.
+
+  To Compile:
+    gcc -O2 -std=c11 -o pl0ld pl0ld.c
+
+  To Execute:
+    ./lex a.txt && ./parsercodegen_complete -c && mv elf.o a.o
+    ./lex b.txt && ./parsercodegen_complete -c && mv elf.o b.o
+    ./pl0ld [-t] [-o elf.bin] a.o b.o
+    ./vm -p elf.bin
+
+  Notes:
+    - The output is a binary executable (vm.c's Executables), -t writes the
+      text format of elf.txt instead
+    - Modules only share procedures: every procedure a module declares at
+      level 0 is exported under its name, variables and constants stay private
+    - A procedure exported by two modules, or called but exported by none, is
+      an error that names the modules involved
+    - Modules can be compiled in parallel and only recompiled when they
+      change, linking only reads the objects (see bench/link.sh)
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "executable.h"
+
+
+
+
+
+/*----- ENUMERATIONS -----*/
+enum INSTRUCTIONS
+{
+  LIT = 1,
+  OPR,
+  LOD,
+  STO,
+  CAL,
+  INC,
+  JMP,
+  JPC,
+  SYS = 9
+};
+
+enum SYSCALLS
+{
+  HALT = 3
+};
+
+enum RELOCATIONS
+{
+  CODE,
+  DATA,
+  CALL
+};
+/*----- ENUMERATIONS -----*/
+
+typedef struct Instruction
+{
+  int op;
+  int l;
+  int m;
+}Instruction;
+
+typedef struct Export
+{
+  char name[12];
+  int index;
+  int module;
+}Export;
+
+typedef struct Relocation
+{
+  int kind;
+  int index;
+  char name[12]; //CALL only
+}Relocation;
+
+typedef struct Module
+{
+  const char* path;
+  Instruction* code;
+  int codeLength;
+  Export* exports;
+  int exportCount;
+  Relocation* relocations;
+  int relocationCount;
+
+  //the object's layout: JMP to the main block, the procedures, then the
+  //main block's INC, statements, and HALT
+  int main;
+  int data; //words of the main activation record past the links
+
+  //where it lands in the program
+  int procedureBase;
+  int mainBase;
+  int dataBase;
+}Module;
+
+
+
+
+
+/*----- Globals -----*/
+Module* modules;
+int moduleCount;
+Export* exports; //every module's, sorted by name
+int exportCount;
+Instruction* program;
+int programLength;
+/*----- Globals -----*/
+
+
+
+
+/*----- Objects -----*/
+//grows *_array of _size byte entries to hold one more than _count
+void* grow(void* _array, int _count, size_t _size)
+{
+  if(_count & (_count - 1))
+    return _array;
+  void* grown = realloc(_array, (_count ? 2*_count : 1)*_size);
+  if(grown == NULL)
+  {
+    printf("Unable to allocate the object's exports and relocations\n");
+    exit(1);
+  }
+  return grown;
+}
+
+//the object at _path into _module, 0 saying why if it isn't a well formed one
+int loadObject(Module* _module, const char* _path)
+{
+  memset(_module, 0, sizeof(Module));
+  _module->path = _path;
+  FILE* fp = fopen(_path, "r");
+  if(fp == NULL)
+  {
+    printf("%s: unable to be opened\n", _path);
+    return 0;
+  }
+
+  int version = 0;
+  int ok = fscanf(fp, "pl0 object %d code %d", &version, &_module->codeLength) == 2 && version == 1 && _module->codeLength >= 3;
+  if(ok)
+    _module->code = malloc(_module->codeLength*sizeof(Instruction));
+  ok = ok && _module->code != NULL;
+  for(int i=0; i<_module->codeLength && ok; ++i)
+    ok = fscanf(fp, "%d %d %d", &_module->code[i].op, &_module->code[i].l, &_module->code[i].m) == 3;
+
+  char word[16], name[16];
+  int index;
+  while(ok && fscanf(fp, "%15s", word) == 1)
+  {
+    if(strcmp(word, "export") == 0 && fscanf(fp, "%11s %d", name, &index) == 2)
+    {
+      _module->exports = grow(_module->exports, _module->exportCount, sizeof(Export));
+      Export* e = &_module->exports[_module->exportCount++];
+      strcpy(e->name, name);
+      e->index = index;
+      e->module = _module - modules;
+    }
+    else if(strcmp(word, "relocate") == 0 && fscanf(fp, "%15s %d", word, &index) == 2)
+    {
+      _module->relocations = grow(_module->relocations, _module->relocationCount, sizeof(Relocation));
+      Relocation* r = &_module->relocations[_module->relocationCount++];
+      r->index = index;
+      r->name[0] = '\0';
+      if(strcmp(word, "code") == 0)
+        r->kind = CODE;
+      else if(strcmp(word, "data") == 0)
+        r->kind = DATA;
+      else if(strcmp(word, "call") == 0 && fscanf(fp, "%11s", r->name) == 1)
+        r->kind = CALL;
+      else
+        ok = 0;
+      ok = ok && index >= 0 && index < _module->codeLength;
+    }
+    else
+      ok = 0;
+  }
+  fclose(fp);
+
+  //the layout parsercodegen_complete.c generates for a program
+  Instruction* code = _module->code;
+  int n = _module->codeLength;
+  if(ok)
+  {
+    _module->main = code[0].m / 3;
+    ok = code[0].op == JMP && code[0].m % 3 == 0 && _module->main > 0 && _module->main < n - 1 &&
+         code[_module->main].op == INC && code[_module->main].m >= 3 &&
+         code[n-1].op == SYS && code[n-1].m == HALT;
+  }
+  for(int i=0; i<_module->exportCount && ok; ++i)
+    ok = _module->exports[i].index > 0 && _module->exports[i].index < _module->main;
+  if(!ok)
+  {
+    printf("%s: not a PL/0 object\n", _path);
+    return 0;
+  }
+  _module->data = code[_module->main].m - 3;
+  return 1;
+}
+/*----- Objects -----*/
+
+
+
+
+/*----- Linking -----*/
+//where instruction _index of _module ends up, -1 for the JMP to its main
+//block, which nothing jumps to. Its INC and HALT give way to the statements
+//that run next, so jumps to them land there
+int place(const Module* _module, int _index)
+{
+  if(_index <= 0 || _index >= _module->codeLength)
+    return -1;
+  if(_index < _module->main)
+    return _module->procedureBase + _index - 1;
+  if(_index == _module->main)
+    return _module->mainBase;
+  return _module->mainBase + _index - _module->main - 1;
+}
+
+int compareExports(const void* _a, const void* _b)
+{
+  const Export* a = _a;
+  const Export* b = _b;
+  int order = strcmp(a->name, b->name);
+  return order != 0 ? order : a->module - b->module;
+}
+
+//the module exporting _name, NULL if none does
+const Module* exporter(const char* _name, int* _index)
+{
+  int low = 0, high = exportCount;
+  while(low < high)
+  {
+    int middle = (low + high) / 2;
+    if(strcmp(exports[middle].name, _name) < 0)
+      low = middle + 1;
+    else
+      high = middle;
+  }
+  if(low == exportCount || strcmp(exports[low].name, _name) != 0)
+    return NULL;
+  *_index = exports[low].index;
+  return &modules[exports[low].module];
+}
+
+int linkModules()
+{
+  //every procedure in one place, no two modules exporting it
+  for(int k=0; k<moduleCount; ++k)
+    exportCount += modules[k].exportCount;
+  exports = malloc((exportCount + 1)*sizeof(Export));
+  if(exports == NULL)
+  {
+    printf("Unable to allocate the exports\n");
+    return 0;
+  }
+  exportCount = 0;
+  for(int k=0; k<moduleCount; ++k)
+  {
+    memcpy(exports + exportCount, modules[k].exports, modules[k].exportCount*sizeof(Export));
+    exportCount += modules[k].exportCount;
+  }
+  qsort(exports, exportCount, sizeof(Export), compareExports);
+  for(int i=1; i<exportCount; ++i)
+    if(strcmp(exports[i-1].name, exports[i].name) == 0)
+    {
+      printf("Procedure %s is exported by both %s and %s\n", exports[i].name, modules[exports[i-1].module].path, modules[exports[i].module].path);
+      return 0;
+    }
+
+  //JMP to the main block, every module's procedures, then one main block
+  int at = 1, data = 0;
+  for(int k=0; k<moduleCount; ++k)
+  {
+    modules[k].procedureBase = at;
+    at += modules[k].main - 1;
+  }
+  int mainBlock = at++;
+  for(int k=0; k<moduleCount; ++k)
+  {
+    modules[k].mainBase = at;
+    at += modules[k].codeLength - modules[k].main - 2;
+    modules[k].dataBase = data;
+    data += modules[k].data;
+  }
+  programLength = at + 1;
+  program = malloc(programLength*sizeof(Instruction));
+  if(program == NULL)
+  {
+    printf("Unable to allocate the program\n");
+    return 0;
+  }
+
+  program[0] = (Instruction){JMP, 0, 3*mainBlock};
+  program[mainBlock] = (Instruction){INC, 0, 3 + data};
+  program[programLength - 1] = (Instruction){SYS, 0, HALT};
+  for(int k=0; k<moduleCount; ++k)
+  {
+    Module* module = &modules[k];
+    for(int i=1; i<module->codeLength - 1; ++i)
+      if(i != module->main)
+        program[place(module, i)] = module->code[i];
+
+    for(int r=0; r<module->relocationCount; ++r)
+    {
+      Relocation* relocation = &module->relocations[r];
+      int to = place(module, relocation->index);
+      if(to == -1 || relocation->index == module->main)
+        continue; //left out with the code it was for
+      Instruction* in = &program[to];
+
+      const Module* target = module;
+      int index = in->m / 3;
+      if(relocation->kind == CALL && (target = exporter(relocation->name, &index)) == NULL)
+      {
+        printf("%s: procedure %s isn't exported by any module\n", module->path, relocation->name);
+        return 0;
+      }
+      if(relocation->kind == DATA)
+        in->m += module->dataBase;
+      else if(relocation->kind == CODE && (in->m % 3 != 0 || place(module, index) == -1))
+      {
+        printf("%s: jump out of the module at %d\n", module->path, relocation->index);
+        return 0;
+      }
+      else
+        in->m = 3*place(target, index);
+    }
+  }
+  return 1;
+}
+/*----- Linking -----*/
+
+
+
+
+/*----- Output -----*/
+//the program packed as executable.h lays it out, without a debug map since
+//the modules come from different sources
+int writeExecutable(FILE* _fp)
+{
+  unsigned* body = allocateExecutable(programLength, NULL);
+  if(body == NULL)
+    return 0;
+  int constantCount = 0;
+  for(int i=0; i<programLength; ++i)
+    packInstruction(body, programLength, i, &constantCount, program[i].op, program[i].l, program[i].m);
+
+  int ok = writeExecutableFile(_fp, body, programLength, constantCount, NULL, NULL);
+  free(body);
+  return ok;
+}
+
+int writeText(FILE* _fp)
+{
+  for(int i=0; i<programLength; ++i)
+    fprintf(_fp, "%d %d %d\n", program[i].op, program[i].l, program[i].m);
+  return !ferror(_fp);
+}
+/*----- Output -----*/
+
+
+
+int main(int argc, char* argv[])
+{
+  const char* output = NULL;
+  int text = 0;
+  int valid = 1;
+  modules = calloc(argc, sizeof(Module));
+  const char** paths = calloc(argc, sizeof(char*));
+  for(int i=1; i<argc; ++i)
+  {
+    if(strcmp(argv[i], "-t") == 0)
+      text = 1;
+    else if(i + 1 < argc && strcmp(argv[i], "-o") == 0)
+      output = argv[++i];
+    else if(argv[i][0] != '-')
+      paths[moduleCount++] = argv[i];
+    else
+      valid = 0;
+  }
+  if(!valid || moduleCount == 0)
+  {
+    printf("Usage: ./pl0ld [-t] [-o elf.bin] module.o...\n");
+    return 1;
+  }
+  if(output == NULL)
+    output = text ? "elf.txt" : "elf.bin";
+
+  for(int k=0; k<moduleCount; ++k)
+    if(!loadObject(&modules[k], paths[k]))
+      return 1;
+  if(!linkModules())
+    return 1;
+
+  FILE* fp = fopen(output, text ? "w" : "wb");
+  if(fp == NULL || !(text ? writeText(fp) : writeExecutable(fp)) || fclose(fp) != 0)
+  {
+    printf("Unable to write %s\n", output);
+    return 1;
+  }
+  return 0;
+}
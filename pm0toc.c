@@ -0,0 +1,448 @@
+/*
+  PM/0 to C Translator
+
+  Translates elf.txt into a C program that behaves like ./vm -m quiet on it:
+  the same prompts and output, the same stack overflow message and exit
+  status, and the same final registers and stack with -f. Each instruction
+  becomes a line or two of straight-line C, jump targets and return sites
+  become labels, and PAS is a local array of the generated main(), so gcc -O2
+  turns the program into native code with no interpreter left in it.
+
+  To Compile:
+    gcc -O2 -std=c11 -DVM_LIBRARY -o pm0toc pm0toc.c vm.c
+
+  To Execute:
+    ./pm0toc [-s words] [-d calls] [-o elf.c] [elf.txt]
+    gcc -O2 -o program elf.c
+    ./program [-f]
+
+  Notes:
+    - -s and -d are vm.c's memory size and call depth limit (defaults 500 and
+      100), fixed in the generated program
+    - The program is loaded and verified by vm.c (vm.h), so it can be elf.txt
+      or elf.bin, and only code its verifier accepts is translated: every
+      instruction has one operand stack depth, so each operand lives at a
+      fixed offset from BP and SP is only computed for HALT
+    - Return addresses stay PM/0 code addresses in PAS, RTN switches on them
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "vm.h"
+
+
+
+
+
+/*----- ENUMERATIONS -----*/
+enum INSTRUCTIONS
+{
+  LIT = 1,
+  OPR,
+  LOD,
+  STO,
+  CAL,
+  INC,
+  JMP,
+  JPC,
+  SYS = 9,
+  LDL = 10, //PAS[BP - M], LOD/STO with L = 0
+  STL,
+  LDG = 12, //PAS[GP - M], globals of the main activation record
+  STG = 13
+};
+
+enum OPERATIONS
+{
+  RTN = 0,
+  ADD,
+  SUB,
+  MUL,
+  DIV,
+  EQL,
+  NEQ,
+  LSS,
+  LEQ,
+  GTR,
+  GEQ,
+  EVEN = 11,
+  DUP = 12
+};
+
+enum SYSCALLS
+{
+  PRINT = 1,
+  READ,
+  HALT = 3
+};
+/*----- ENUMERATIONS -----*/
+
+typedef struct Instruction
+{
+  int op;
+  int l;
+  int m;
+}Instruction;
+
+Instruction* code;
+int codeLength;
+
+int memorySize = 500;
+int maxDepth = 100;
+
+//code index of a PM/0 code address, and back, as in vm.c
+#define CODE_INDEX(address) ((memorySize - 1 - (address)) / 3)
+#define CODE_ADDRESS(index) (memorySize - 1 - 3*(index))
+
+
+
+/*----- Stack Depths -----*/
+//Only vm.c's verifier decides what is safe to run unchecked, so the program
+//is loaded and verified by vm.c built as a library (vm.h) and its procedures,
+//owners, and stack depths are copied out of the VM. Labels are what jumps,
+//calls, and returns reach.
+VMProcedure* procedures;
+int* owner;   //procedure each instruction belongs to, -1 if unreachable
+int* height;  //operand stack depth before each instruction, -1 in prologues
+int* isLabel; //jumped to, called, or returned to
+
+//code index of a jump or call destination, verified to be an instruction
+int targetIndex(int _m)
+{
+  return _m/3;
+}
+
+//the program at _path verified into code[] and the arrays above, 0 saying why not
+int analyze(const char* _path)
+{
+  VM* vm = vm_create(memorySize, maxDepth);
+  if(vm == NULL)
+  {
+    printf("Unable to allocate %d words of memory\n", memorySize);
+    return 0;
+  }
+  if(!vm_load(vm, _path, 1))
+  {
+    vm_destroy(vm);
+    return 0;
+  }
+
+  VMInstruction ir;
+  VMProcedure proc;
+  int procedureCount = 0;
+  for(codeLength = 0; vm_instruction(vm, codeLength, &ir); ++codeLength);
+  while(vm_procedure(vm, procedureCount, &proc))
+    ++procedureCount;
+
+  code = malloc(codeLength*sizeof(Instruction));
+  owner = malloc(codeLength*sizeof(int));
+  height = malloc(codeLength*sizeof(int));
+  isLabel = calloc(codeLength + 1, sizeof(int));
+  procedures = malloc(procedureCount*sizeof(VMProcedure));
+  if(code == NULL || owner == NULL || height == NULL || isLabel == NULL || procedures == NULL)
+  {
+    printf("Unable to allocate the program\n");
+    vm_destroy(vm);
+    return 0;
+  }
+
+  for(int i=0; i<codeLength; ++i)
+  {
+    vm_instruction(vm, i, &ir);
+    code[i] = (Instruction){ir.op, ir.l, ir.m};
+    owner[i] = ir.procedure;
+    height[i] = ir.height;
+  }
+  for(int p=0; p<procedureCount; ++p)
+    vm_procedure(vm, p, &procedures[p]);
+  vm_destroy(vm);
+
+  for(int i=0; i<codeLength; ++i)
+  {
+    if(owner[i] == -1)
+      continue;
+    if(code[i].op == JMP || code[i].op == JPC)
+      isLabel[targetIndex(code[i].m)] = 1;
+    else if(code[i].op == CAL)
+    {
+      isLabel[targetIndex(code[i].m)] = 1;
+      isLabel[i + 1] = 1;
+    }
+  }
+  return 1;
+}
+/*----- Stack Depths -----*/
+
+
+
+/*----- Translation -----*/
+FILE* out;
+
+//operand _slot of code[_index] (1 is the bottom), sp is BP + 1 - frame - height
+void operand(int _index, int _slot)
+{
+  fprintf(out, "PAS[bp%+d]", 1 - procedures[owner[_index]].frame - _slot);
+}
+
+//base of the record _levels down the static chain
+void chainBase(int _levels)
+{
+  for(int l=0; l<_levels; ++l)
+    fprintf(out, "PAS[");
+  fprintf(out, "bp");
+  for(int l=0; l<_levels; ++l)
+    fprintf(out, "]");
+}
+
+//the word at offset _m of the record _levels down, GP's for _levels == -1
+void variable(int _levels, int _m)
+{
+  if(_levels == -1)
+    fprintf(out, "PAS[%d]", CODE_ADDRESS(codeLength) - _m);
+  else
+  {
+    fprintf(out, "PAS[");
+    chainBase(_levels);
+    fprintf(out, "-%d]", _m);
+  }
+}
+
+void translateInstruction(int _i)
+{
+  const Instruction* ir = &code[_i];
+  const VMProcedure* proc = &procedures[owner[_i]];
+  int h = height[_i];
+
+  fprintf(out, "  ");
+  switch(ir->op)
+  {
+    case LIT:
+      operand(_i, h + 1);
+      fprintf(out, " = %d;\n", ir->m);
+      return;
+
+    case LOD: case LDL: case LDG:
+      operand(_i, h + 1);
+      fprintf(out, " = ");
+      variable(ir->op == LDG ? -1 : ir->op == LOD ? ir->l : 0, ir->m);
+      fprintf(out, ";\n");
+      return;
+
+    case STO: case STL: case STG:
+      variable(ir->op == STG ? -1 : ir->op == STO ? ir->l : 0, ir->m);
+      fprintf(out, " = ");
+      operand(_i, h);
+      fprintf(out, ";\n");
+      return;
+
+    case CAL:
+      fprintf(out, "if(topARs == MAX_DEPTH) goto overflow;\n  ");
+      operand(_i, h + 1);
+      fprintf(out, " = ");
+      chainBase(ir->l);
+      fprintf(out, ";\n  ");
+      operand(_i, h + 2);
+      fprintf(out, " = bp;\n  ");
+      operand(_i, h + 3);
+      fprintf(out, " = %d;\n", CODE_ADDRESS(_i + 1));
+      fprintf(out, "  bp += %d;\n", -proc->frame - h);
+      fprintf(out, "  ARS[topARs++] = bp;\n");
+      fprintf(out, "  goto L%d;\n", targetIndex(ir->m));
+      return;
+
+    case INC:
+      //the same bound as vm.c: the frame plus its deepest operand stack and a call's links
+      fprintf(out, "if(bp %+d < 0) goto overflow;\n", 1 - proc->frame - (proc->maxStack + 3));
+      return;
+
+    case JMP:
+      fprintf(out, "goto L%d;\n", targetIndex(ir->m));
+      return;
+
+    case JPC:
+      fprintf(out, "if(");
+      operand(_i, h);
+      fprintf(out, " == 0) goto L%d;\n", targetIndex(ir->m));
+      return;
+
+    case SYS:
+      if(ir->m == PRINT)
+      {
+        fprintf(out, "printf(\"Output result is: %%d\\n\", ");
+        operand(_i, h);
+        fprintf(out, ");\n");
+      }
+      else if(ir->m == READ)
+      {
+        fprintf(out, "printf(\"Please Enter an Integer: \");\n");
+        fprintf(out, "  if(scanf(\"%%d\", &input) != 1) input = 0;\n  ");
+        operand(_i, h + 1);
+        fprintf(out, " = input;\n");
+      }
+      else
+        fprintf(out, "PC = %d; BP = bp; SP = bp %+d; goto halt;\n", CODE_ADDRESS(_i + 1), 1 - proc->frame - h);
+      return;
+  }
+
+  static const char* operators[] = {"", "+", "-", "*", "/", "==", "!=", "<", "<=", ">", ">="};
+  switch(ir->m)
+  {
+    case RTN:
+      fprintf(out, "ra = PAS[bp-2]; bp = PAS[bp-1]; ARS[topARs] = 0; --topARs; goto ret;\n");
+      return;
+
+    case EVEN:
+      operand(_i, h);
+      fprintf(out, " = (");
+      operand(_i, h);
+      fprintf(out, " %% 2 == 0);\n");
+      return;
+
+    case DUP:
+      operand(_i, h + 1);
+      fprintf(out, " = ");
+      operand(_i, h);
+      fprintf(out, ";\n");
+      return;
+
+    default:
+      operand(_i, h - 1);
+      fprintf(out, " = ");
+      operand(_i, h - 1);
+      fprintf(out, " %s ", operators[ir->m]);
+      operand(_i, h);
+      fprintf(out, ";\n");
+      return;
+  }
+}
+
+//writes the program in code[] as a C translation unit
+void translate()
+{
+  fprintf(out, "/* Translated from PM/0 by pm0toc, build with gcc -O2 */\n");
+  fprintf(out, "#include <stdio.h>\n#include <string.h>\n\n");
+  fprintf(out, "#define MEMORY_SIZE %d\n#define MAX_DEPTH %d\n\n", memorySize, maxDepth);
+
+  //printStack() of vm.c
+  fprintf(out,
+    "static int base(const int* PAS, int b, int l)\n"
+    "{\n"
+    "  while(l-- > 0)\n"
+    "    b = PAS[b];\n"
+    "  return b;\n"
+    "}\n\n"
+    "static void printStack(const int* PAS, const int* ARS, int topARs, int BP, int SP)\n"
+    "{\n"
+    "  int baseOfStack;\n"
+    "  for(int ARs=0; ; ++ARs)\n"
+    "    if(base(PAS, BP, ARs) == 0)\n"
+    "    {\n"
+    "      baseOfStack = base(PAS, BP, --ARs);\n"
+    "      break;\n"
+    "    }\n\n"
+    "  int tmp2 = 0;\n"
+    "  for(int i=baseOfStack; i>=SP; --i)\n"
+    "  {\n"
+    "    if(ARS[tmp2] == i && tmp2 < topARs)\n"
+    "    {\n"
+    "      printf(\"| \");\n"
+    "      ++tmp2;\n"
+    "    }\n"
+    "    printf(\"%%-2d \", PAS[i]);\n"
+    "  }\n"
+    "  printf(\"\\n\");\n"
+    "}\n\n");
+
+  int returns = 0, reads = 0;
+  for(int i=0; i<codeLength; ++i)
+  {
+    if(owner[i] != -1 && code[i].op == OPR && code[i].m == RTN)
+      returns = 1;
+    if(owner[i] != -1 && code[i].op == SYS && code[i].m == READ)
+      reads = 1;
+  }
+
+  fprintf(out, "int main(int argc, char* argv[])\n{\n");
+  fprintf(out, "  int showFinal = argc > 1 && strcmp(argv[1], \"-f\") == 0;\n");
+  //big memories go in static storage instead of the C stack
+  fprintf(out, "  %sint PAS[MEMORY_SIZE] = {0};\n", memorySize > 65536 ? "static " : "");
+  fprintf(out, "  %sint ARS[MAX_DEPTH + 1] = {0};\n", maxDepth > 65536 ? "static " : "");
+  fprintf(out, "  int topARs = 0;\n");
+  fprintf(out, "  int bp = %d, PC, BP, SP;\n", CODE_ADDRESS(codeLength));
+  if(reads)
+    fprintf(out, "  int input;\n");
+  if(returns)
+    fprintf(out, "  int ra;\n");
+  fprintf(out, "\n");
+
+  for(int i=0; i<codeLength; ++i)
+  {
+    if(owner[i] == -1)
+      continue;
+    if(isLabel[i])
+      fprintf(out, "L%d:\n", i);
+    translateInstruction(i);
+  }
+
+  if(returns)
+  {
+    //only CAL writes return addresses, RTN goes back to the instruction after one
+    fprintf(out, "\nret:\n  switch(ra)\n  {\n");
+    for(int i=0; i<codeLength; ++i)
+      if(owner[i] != -1 && code[i].op == CAL)
+        fprintf(out, "    case %d: goto L%d;\n", CODE_ADDRESS(i + 1), i + 1);
+    fprintf(out, "  }\n  return 1;\n");
+  }
+
+  fprintf(out, "\noverflow:\n");
+  fprintf(out, "  printf(\"Stack overflow (memory %%d words, call depth %%d)\\n\", MEMORY_SIZE, MAX_DEPTH);\n");
+  fprintf(out, "  return 2;\n");
+  fprintf(out, "\nhalt:\n");
+  fprintf(out, "  if(showFinal)\n  {\n");
+  fprintf(out, "    printf(\"Final values:\\t   %%5d%%5d%%5d  \", PC, BP, SP);\n");
+  fprintf(out, "    printStack(PAS, ARS, topARs, BP, SP);\n");
+  fprintf(out, "  }\n  return 0;\n}\n");
+}
+/*----- Translation -----*/
+
+
+
+int main(int argc, char* argv[])
+{
+  const char* input = "elf.txt";
+  const char* output = "elf.c";
+  int valid = 1;
+  for(int i=1; i<argc; ++i)
+  {
+    if(i + 1 < argc && strcmp(argv[i], "-s") == 0)
+      memorySize = atoi(argv[++i]);
+    else if(i + 1 < argc && strcmp(argv[i], "-d") == 0)
+      maxDepth = atoi(argv[++i]);
+    else if(i + 1 < argc && strcmp(argv[i], "-o") == 0)
+      output = argv[++i];
+    else if(argv[i][0] != '-')
+      input = argv[i];
+    else
+      valid = 0;
+  }
+  if(!valid || memorySize < 4 || maxDepth < 1)
+  {
+    printf("Usage: ./pm0toc [-s words] [-d calls] [-o elf.c] [elf.txt]\n");
+    return 1;
+  }
+
+  /*----- Loading Text Segment -----*/
+  if(!analyze(input))
+    return 1;
+  /*----- Loading Text Segment -----*/
+
+  out = fopen(output, "w");
+  if(out == NULL)
+  {
+    printf("File unable to be opened\n");
+    return 1;
+  }
+  translate();
+  fclose(out);
+  return 0;
+}
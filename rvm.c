@@ -0,0 +1,306 @@
+/*
+  Register Virtual Machine
+
+  Runs the three-address register code parsercodegen_complete.c writes to
+  relf.txt when given -r, as an alternative to the PM/0 stack machine in vm.c.
+
+  To Compile:
+    gcc -O2 -std=c11 -o rvm rvm.c
+
+  To Execute:
+    ./lex <input_file.txt>
+    ./parsercodegen_complete -r
+    ./rvm [-s words] [-d calls] [-c]
+
+  Notes:
+    - Reads relf.txt, one "OP A B C" instruction per line
+    - -c prints the number of instructions executed to stderr when the program halts
+    - -s <words> -d <calls> set the data memory size (default 500) and the call
+      depth limit (default 100), running out of either stops the program with
+      "Stack overflow" and exit status 2, as in vm.c
+    - Activation records have the same layout as PM/0 (static link, dynamic link,
+      return address, then locals), only expression temporaries live in registers
+    - Output and input prompts match vm.c
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+
+
+/*----- ENUMERATIONS -----*/
+enum INSTRUCTIONS
+{
+  LI = 1, //R[a] = b
+  LD,     //R[a] = DATA[base(b) - c]
+  ST,     //DATA[base(b) - c] = R[a]
+  CAL,    //call address a, static link b levels down
+  INC,    //SP -= a
+  JMP,    //PC = a
+  JPZ,    //if R[a] == 0, PC = b
+  SYS,    //a = PRINT/READ/HALT, b = register
+  RTN,
+  ADD = 10, //R[a] = R[b] op R[c]
+  SUB,
+  MUL,
+  DIV,
+  EQL,
+  NEQ,
+  LSS,
+  LEQ,
+  GTR,
+  GEQ,
+  ADDI = 20, //R[a] = R[b] op c
+  SUBI,
+  MULI,
+  DIVI,
+  EQLI,
+  NEQI,
+  LSSI,
+  LEQI,
+  GTRI,
+  GEQI,
+  EVEN = 30 //R[a] = R[b] is even
+};
+
+enum SYSCALLS
+{
+  PRINT = 1,
+  READ,
+  HALT = 3
+};
+/*----- ENUMERATIONS -----*/
+
+#define CODE_SIZE 32768 //MAX_REG_INSTRUCTION_TABLE_SIZE of parsercodegen_complete.c
+#define REGISTER_COUNT 8
+
+
+
+
+
+typedef struct Instruction
+{
+  int op;
+  int a;
+  int b;
+  int c;
+}Instruction;
+
+Instruction CODE[CODE_SIZE];
+int* DATA;
+int memorySize = 500;
+int maxDepth = 100;
+
+//registers
+int R[REGISTER_COUNT];
+int PC;
+int SP;
+int BP;
+
+//display of record bases by static depth, see vm.c
+int* display;
+int depth;
+
+//display entry and depth each CAL replaced, restored by its RTN
+int* savedDisplay;
+int* savedDepth;
+int topARs;
+
+
+
+/* Find base L levels down from the current activation record */
+int base(int numlevels)
+{
+  if(numlevels <= depth)
+    return display[depth - numlevels];
+
+  int arb = BP;
+  while (numlevels>0) 
+  {
+    arb = DATA[arb];
+    numlevels--;
+  }
+
+  return arb;
+}
+
+
+//exit status of a run that ran out of memory or call depth, as in vm.c
+int stackOverflow()
+{
+  printf("Stack overflow (memory %d words, call depth %d)\n", memorySize, maxDepth);
+  return 2;
+}
+
+
+int main(int argc, char* argv[])
+{
+  int reportCount = 0;
+  int valid = 1;
+  for(int i=1; i<argc; ++i)
+  {
+    if(strcmp(argv[i], "-c") == 0)
+      reportCount = 1;
+    else if(i + 1 < argc && strcmp(argv[i], "-s") == 0)
+      memorySize = atoi(argv[++i]);
+    else if(i + 1 < argc && strcmp(argv[i], "-d") == 0)
+      maxDepth = atoi(argv[++i]);
+    else
+      valid = 0;
+  }
+  if(!valid || memorySize < 1 || maxDepth < 1)
+  {
+    printf("Usage: ./rvm [-s words] [-d calls] [-c]\n");
+    return 1;
+  }
+
+  DATA = calloc(memorySize, sizeof(int));
+  display = calloc(maxDepth + 1, sizeof(int));
+  savedDisplay = calloc(maxDepth, sizeof(int));
+  savedDepth = calloc(maxDepth, sizeof(int));
+  if(DATA == NULL || display == NULL || savedDisplay == NULL || savedDepth == NULL)
+  {
+    printf("Unable to allocate %d words of memory\n", memorySize);
+    return 1;
+  }
+
+  /*----- Opening and Verifying File -----*/
+  FILE* fp = fopen("relf.txt", "r");
+  if(fp == NULL)
+  {
+    printf("File unable to be opened\n");
+    return 1;
+  }
+  /*----- Opening and Verifying File -----*/
+  
+
+  /*----- Loading Text Segment -----*/
+  int codeLength = 0;
+  while(codeLength < CODE_SIZE && fscanf(fp, "%d %d %d %d", &CODE[codeLength].op, &CODE[codeLength].a, &CODE[codeLength].b, &CODE[codeLength].c) == 4)
+    ++codeLength;
+
+  fclose(fp);
+
+  BP = memorySize - 1;
+  SP = BP + 1;
+  PC = 0;
+  display[0] = BP;
+  /*----- Loading Text Segment -----*/
+
+  long long executed = 0;
+
+  
+  /*----- Main Loop -----*/
+  int continueProgram = 1;
+  while(continueProgram)
+  {
+    Instruction IR = CODE[PC++];
+    ++executed;
+
+    switch(IR.op)
+    {
+      case LI:
+        R[IR.a] = IR.b;
+        break;
+
+      case LD:
+        R[IR.a] = DATA[base(IR.b) - IR.c];
+        break;
+
+      case ST:
+        DATA[base(IR.b) - IR.c] = R[IR.a];
+        break;
+
+      case CAL:
+      {
+        if(topARs == maxDepth || SP < 3)
+          return stackOverflow();
+
+        DATA[SP-1] = base(IR.b);
+        DATA[SP-2] = BP;
+        DATA[SP-3] = PC;
+        BP = SP - 1;
+        PC = IR.a;
+
+        int calleeDepth = IR.b > depth ? 0 : depth - IR.b + 1;
+        savedDisplay[topARs] = display[calleeDepth];
+        savedDepth[topARs] = depth;
+        display[calleeDepth] = BP;
+        depth = calleeDepth;
+        ++topARs;
+      }
+        break;
+
+      case RTN:
+        SP = BP + 1;
+        BP = DATA[SP-2];
+        PC = DATA[SP-3];
+        --topARs;
+        display[depth] = savedDisplay[topARs];
+        depth = savedDepth[topARs];
+        break;
+
+      case INC:
+        SP -= IR.a;
+        if(SP < 0)
+          return stackOverflow();
+        break;
+
+      case JMP:
+        PC = IR.a;
+        break;
+
+      case JPZ:
+        if(R[IR.a] == 0) PC = IR.b;
+        break;
+
+      case SYS:
+        if(IR.a == PRINT)
+          printf("Output result is: %d\n", R[IR.b]);
+        else if(IR.a == READ)
+        {
+          printf("Please Enter an Integer: ");
+          scanf("%d", &R[IR.b]);
+        }
+        else // HALT
+          continueProgram = 0;
+        break;
+
+      case ADD:  R[IR.a] = R[IR.b] + R[IR.c]; break;
+      case SUB:  R[IR.a] = R[IR.b] - R[IR.c]; break;
+      case MUL:  R[IR.a] = R[IR.b] * R[IR.c]; break;
+      case DIV:  R[IR.a] = R[IR.b] / R[IR.c]; break;
+      case EQL:  R[IR.a] = R[IR.b] == R[IR.c]; break;
+      case NEQ:  R[IR.a] = R[IR.b] != R[IR.c]; break;
+      case LSS:  R[IR.a] = R[IR.b] < R[IR.c]; break;
+      case LEQ:  R[IR.a] = R[IR.b] <= R[IR.c]; break;
+      case GTR:  R[IR.a] = R[IR.b] > R[IR.c]; break;
+      case GEQ:  R[IR.a] = R[IR.b] >= R[IR.c]; break;
+
+      case ADDI: R[IR.a] = R[IR.b] + IR.c; break;
+      case SUBI: R[IR.a] = R[IR.b] - IR.c; break;
+      case MULI: R[IR.a] = R[IR.b] * IR.c; break;
+      case DIVI: R[IR.a] = R[IR.b] / IR.c; break;
+      case EQLI: R[IR.a] = R[IR.b] == IR.c; break;
+      case NEQI: R[IR.a] = R[IR.b] != IR.c; break;
+      case LSSI: R[IR.a] = R[IR.b] < IR.c; break;
+      case LEQI: R[IR.a] = R[IR.b] <= IR.c; break;
+      case GTRI: R[IR.a] = R[IR.b] > IR.c; break;
+      case GEQI: R[IR.a] = R[IR.b] >= IR.c; break;
+
+      case EVEN: R[IR.a] = (R[IR.b] % 2 == 0); break;
+
+      default:
+        printf("How did you get here? %d %d %d %d\n", IR.op, IR.a, IR.b, IR.c);
+        return 1;
+    }
+  }
+  /*----- Main Loop -----*/
+
+  if(reportCount)
+    fprintf(stderr, "Instructions executed: %lld\n", executed);
+
+  return 0;
+}
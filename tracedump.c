@@ -0,0 +1,219 @@
+/*
+  Binary Trace Decoder
+
+  Renders a trace.bin written by ./vm -m binary-trace as the exact text
+  ./vm prints in its default trace mode.
+
+  To Compile:
+    gcc -O2 -std=c11 -o tracedump tracedump.c
+
+  To Execute:
+    ./vm -m binary-trace
+    ./tracedump [trace.bin]
+
+  Notes:
+    - Record layout and handler numbering must match vm.c
+    - Each record carries the registers after one instruction plus the one
+      memory word it wrote, the stack is rebuilt by replaying those writes
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TRACE_MAGIC 0x54304d50 //"PM0T"
+
+//handler numbering of vm.c
+enum HANDLERS
+{
+  H_ILLEGAL = 0,
+  H_LIT,
+  H_LOD,
+  H_STO,
+  H_CAL,
+  H_INC,
+  H_JMP,
+  H_JPC,
+  H_LDL,
+  H_STL,
+  H_LDG,
+  H_STG,
+  H_PRINT,
+  H_READ,
+  H_HALT,
+  H_RTN,
+  H_ADD,
+  H_SUB,
+  H_MUL,
+  H_DIV,
+  H_EQL,
+  H_NEQ,
+  H_LSS,
+  H_LEQ,
+  H_GTR,
+  H_GEQ,
+  H_EVEN,
+  H_DUP,
+  H_BADOPR,
+  HANDLER_COUNT
+};
+
+const char* handlerNames[HANDLER_COUNT] = {
+  "", "LIT", "LOD", "STO", "CAL", "INC", "JMP", "JPC", "LDL", "STL", "LDG", "STG",
+  "SYS", "SYS", "SYS", "RTN", "ADD", "SUB", "MUL", "DIV", "EQL", "NEQ", "LSS", "LEQ",
+  "GTR", "GEQ", "EVEN", "DUP", ""
+};
+
+typedef struct TraceHeader
+{
+  int magic;
+  int memorySize;
+  int pc;
+  int bp;
+  int sp;
+}TraceHeader;
+
+typedef struct TraceRecord
+{
+  int handler;
+  int l;
+  int m;
+  int pc;
+  int bp;
+  int sp;
+  int address;
+  int value;
+}TraceRecord;
+
+int* PAS; //sized by the trace header
+int* ARS; //every call takes at least 3 words, so memorySize entries is plenty
+int topARs;
+
+
+
+/* Find base L levels down from the current activation record */
+int base (int base, int numlevels) 
+{
+  int arb = base;
+
+  while (numlevels>0) 
+  {
+    arb = PAS[arb];
+    numlevels--;
+  }
+
+  return arb;
+}
+
+//same output as printTrace in vm.c
+void printTrace(const TraceRecord* _r)
+{
+  printf("%s", _r->handler < HANDLER_COUNT ? handlerNames[_r->handler] : "");
+  printf("\t%d\t%-2d %5d%5d%5d  ", _r->l, _r->m, _r->pc, _r->bp, _r->sp);
+
+  int baseOfStack;
+  for(int ARs=0; ; ++ARs)
+  {
+    if(base(_r->bp, ARs) == 0)
+    {
+      baseOfStack = base(_r->bp, --ARs);
+      break;
+    }
+  }
+
+  int tmp2 = 0;
+  for(int i=baseOfStack; i>=_r->sp; --i)
+  {
+    if(ARS[tmp2] == i && tmp2 <topARs)
+    {
+      printf("| ");
+      ++tmp2;
+    }
+    printf("%-2d ", PAS[i]);
+  }
+
+  printf("\n");
+}
+
+
+int main(int argc, char* argv[])
+{
+  /*----- Opening and Verifying File -----*/
+  FILE* fp = fopen(argc > 1 ? argv[1] : "trace.bin", "rb");
+  if(fp == NULL)
+  {
+    printf("File unable to be opened\n");
+    return 1;
+  }
+
+  TraceHeader header;
+  if(fread(&header, sizeof(TraceHeader), 1, fp) != 1 || header.magic != TRACE_MAGIC || header.memorySize < 1)
+  {
+    printf("Not a binary trace\n");
+    fclose(fp);
+    return 1;
+  }
+  /*----- Opening and Verifying File -----*/
+
+  PAS = calloc(header.memorySize, sizeof(int));
+  ARS = calloc(header.memorySize, sizeof(int));
+  if(PAS == NULL || ARS == NULL)
+  {
+    printf("Unable to allocate %d words of memory\n", header.memorySize);
+    fclose(fp);
+    return 1;
+  }
+
+  //headers
+  printf("\n\tL\tM    %s   %s   %s   %s\n", "PC", "BP", "SP", "stack");
+  printf("Initial values:\t   %5d%5d%5d\n", header.pc, header.bp, header.sp);
+
+  int pc = header.pc, bp = header.bp;
+
+  /*----- Replay -----*/
+  TraceRecord block[4096];
+  size_t count;
+  while((count = fread(block, sizeof(TraceRecord), 4096, fp)) > 0)
+  {
+    for(size_t i=0; i<count; ++i)
+    {
+      TraceRecord* r = &block[i];
+
+      if(r->address >= 0 && r->address < header.memorySize)
+        PAS[r->address] = r->value;
+
+      switch(r->handler)
+      {
+        case H_CAL:
+          //the record holds the static link, the rest of the frame is implied
+          PAS[r->address-1] = bp;
+          PAS[r->address-2] = pc - 3;
+          ARS[topARs++] = r->bp;
+          break;
+
+        case H_RTN:
+          ARS[topARs] = 0;
+          --topARs;
+          break;
+
+        case H_PRINT:
+          printf("Output result is: %d\n", r->value);
+          break;
+
+        case H_READ:
+          printf("Please Enter an Integer: ");
+          break;
+
+        default:
+          break;
+      }
+
+      printTrace(r);
+      pc = r->pc;
+      bp = r->bp;
+    }
+  }
+  /*----- Replay -----*/
+
+  fclose(fp);
+  return 0;
+}
@@ -31,6 +31,50 @@
     - Supports procedures, call statements, and if-then-else
     - Generates PM/0 assembly code (see Appendix A for ISA)
     - VM must support EVEN instruction (OPR 0 11)
+    - vm.c also runs the -O forms: DUP (OPR 0 12), LDL/STL, LDG/STG
+    - ./vm -m quiet|trace|binary-trace picks the execution mode, trace (the
+      format above) is the default, quiet only prints SYS output, and
+      binary-trace writes trace.bin for ./tracedump to render
+    - elf.txt is verified before it runs (see Verifier), programs that fail
+      are rejected with the reason, ./vm -u skips that and runs with checks
+    - ./vm -m jit compiles verified code to x86-64 (vm_jit.h) and runs it
+      natively, anything it can't compile runs quiet on the interpreter,
+      ./vm -f prints the final registers and stack after HALT
+    - ./vm -m tiered interprets until a loop or procedure gets hot, then
+      moves it to the JIT (see Tiered Execution), -l <loops> -c <calls> set
+      the thresholds (default 1000) and -t prints the time in each tier
+    - ./vm -m profile counts instructions, calls, and time per procedure into
+      profile.txt and profile.folded (see Profiler), with an elf.map from the
+      code generator it also reports hits per PL/0 source line
+    - ./vm -g prints the source line before its instructions in the trace
+    - Verified quiet runs cache the top of stack and fuse the most common
+      sequences into superinstructions, -DVM_NO_TOS_CACHE and
+      -DVM_NO_SUPERINSTRUCTIONS build without them
+    - ./vm -s <words> -d <calls> sets the memory size (default 500) and the
+      call depth limit (default 100), running out of either stops the program
+      with "Stack overflow" and exit status 2
+    - ./vm -n <instructions> -e <ms> stop a run that goes on past either
+      limit with "Out of fuel" and exit status 5 (see Fuel), only backward
+      jumps and calls check them
+    - ./vm -k <file> runs quietly up to the first READ, or to where -n or -e
+      stop it, and writes a snapshot of the machine there, ./vm -r <file>
+      goes on from a snapshot instead of loading elf.txt (see Snapshots)
+    - ./vm -p <program> runs program instead of elf.txt, either text or the
+      binary executable parsercodegen_complete.c -b writes to elf.bin, told
+      apart by its first bytes (see Executables), ./vm -w <file> writes the
+      program as an executable instead of running it
+    - ./vm -b runs in batch mode: no prompts, input read all at once and
+      parsed in memory, and output through a 1 MB buffer flushed when full
+      or at exit (see Input and Output), -i <file> reads input from file
+      instead of stdin
+    - All machine state lives in a VM (vm.h), -DVM_LIBRARY builds vm.c
+      without main as a library, ./vmbatch runs many programs or inputs on
+      one VM per thread
+    - vm_run_lanes() runs a verified program on many inputs at once in
+      lockstep, with the lanes' data in vectors (vm_lanes.h), ./vmbatch -w
+    - vm_step() runs a machine for a budget of instructions and vm_feed()
+      gives it input in pieces, a READ with none yet suspends it, ./vmserve
+      schedules thousands of such machines on a few threads with epoll
     - All development and testing performed on Eustis
 
   Class: COP3402 - System Software - Fall 2025
@@ -39,8 +83,23 @@
   
   Due Date: Friday, November 21, 2025 at 11:59 PM ET
 */
+#define _DEFAULT_SOURCE //mmap and sigsetjmp under -std=c11
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "vm.h"
+#include "executable.h"
+#if defined(__x86_64__)
+#include <x86intrin.h> //__rdtsc for the profiler
+#endif
 
 
 
@@ -64,7 +123,11 @@ enum INSTRUCTIONS
   INC,
   JMP,
   JPC,
-  SYS = 9
+  SYS = 9,
+  LDL = 10, //PAS[BP - M], LOD/STO with L = 0
+  STL,
+  LDG = 12, //PAS[GP - M], globals of the main activation record
+  STG = 13
 };
 
 enum OPERATIONS
@@ -80,7 +143,8 @@ enum OPERATIONS
   LEQ,
   GTR,
   GEQ,
-  EVEN = 11
+  EVEN = 11,
+  DUP = 12
 };
 
 enum SYSCALLS
@@ -95,274 +159,2751 @@ enum SYSCALLS
 
 
 
-int PAS[500];
+/*----- Machine -----*/
+//Everything one running program owns, so any number of them can run side by
+//side (see vm.h). Functions that touch a machine take it as their first
+//argument, vm. The tracing, profiling, and JIT modes of ./vm keep their own
+//state in globals and only ever run one machine per process.
+struct VM
+{
+  int* PAS; //memorySize words, see allocateMemory
+
+  //registers
+  int PC;
+  int SP;
+  int BP;
+  int GP; //BP of the main activation record, fixed after loading
+
+  //display[d] is the base of the active record at static depth d, so
+  //base(BP, L) == display[depth - L] for every L <= depth
+  int* display;
+  int depth;
+
+  int* ARS; //stupid stupid stupid stupid stupid stupid stupid stupid
+  int topARs;
+
+  //display entry and depth each CAL replaced, restored by its RTN
+  int* savedDisplay;
+  int* savedDepth;
+
+  //see Memory
+  int memorySize;
+  int maxDepth;
+  char* guardLow; //first byte of each guard page
+  char* guardHigh;
+  size_t mapped; //bytes of PAS and its guard pages
+  sigjmp_buf overflowJump;
+
+  //see Predecoded Instructions
+  struct Decoded* code; //code[codeLength] is always illegal, bad jumps land there
+  int codeLength;
+  void** threadedLabels; //label table code[].target was last filled from, NULL after a rewrite
+  int verified; //verify() accepted the code
+  int prepared; //the quiet loop's rewrites of code are done
+  int used; //PAS has been run on since the last reset
+
+  //see Verifier
+  struct Procedure* procedures;
+  int procedureCount;
+  int* procedureAt; //procedure entered at each code index, -1 if none
+  int* owner;       //procedure each instruction belongs to, -1 if unreachable
+  int* height;      //operand stack depth before each instruction, -1 in prologues
+  int* worklist;
+  int worklistCount;
+
+  int* hotness; //arrivals counted at each instruction, see Tiered Execution
+
+  //SYS reads from input and prints to output, and so do messages and traces
+  FILE* input;
+  FILE* output;
+
+  //see Input and Output
+  int batch;             //no prompts, input parsed from memory
+  const char* inputData; //all of the input in batch mode, NULL until the first READ
+  size_t inputSize;
+  size_t inputAt;        //where the next READ starts parsing
+  char* ownedInput;      //inputData when it was read from input or fed
+  size_t inputCapacity;  //of ownedInput while fed
+  int feeding;           //input comes from vm_feed()
+  int inputClosed;       //and there won't be any more
+  int prompted;          //a READ printed its prompt and is waiting for input
+  long long inputDropped; //fed input already parsed and dropped from ownedInput
+  long long inputSkip;    //input a restored run had read, passed over by the next READ
+
+  //see vm_step
+  long long budget; //instructions left in this step
+  int stopped;      //result of the run once it has ended, -1 until then
+
+  //see Fuel
+  long long fuel;             //left to burn before refuel()
+  long long fuelLeft;         //of the instruction limit, not yet handed to fuel
+  long long instructionLimit; //vm_limit(), 0 for none
+  long long timeLimit;        //in ms, 0 for none
+  double deadline;            //milliseconds() the run has to end by, 0 for none
+};
 
-//registers
-int PC = 499;
-int SP;
-int BP;
-int IR[3];
+//machine running on this thread, for overflowHandler
+_Thread_local VM* runningVM;
+/*----- Machine -----*/
 
 
 
-/* Find base L levels down from the current activation record */
-int base (int base, int numlevels) 
+/*----- Memory -----*/
+//The stack grows down towards PAS[0]. Pushes move SP one word at a time, so
+//instead of checking every push PAS sits between two inaccessible guard pages
+//and a push past either end faults into overflowHandler. Only the jumps that
+//can skip a whole page are checked in the loop: INC (M words at once) and CAL
+//(against the call depth limit), once per frame.
+long pageSize;
+
+//SIGSEGV goes to the thread that faulted, so the machine it was running is runningVM
+void overflowHandler(int _signal, siginfo_t* _info, void* _context)
 {
-  int arb = base;
+  char* address = (char*)_info->si_addr;
+  VM* vm = runningVM;
+  if(vm != NULL && ((address >= vm->guardLow && address < vm->guardLow + pageSize) ||
+                    (address >= vm->guardHigh && address < vm->guardHigh + pageSize)))
+    siglongjmp(vm->overflowJump, 1);
+
+  //not ours, let it crash as usual
+  signal(_signal, SIG_DFL);
+}
 
-  while (numlevels>0) 
+int allocateMemory(VM* vm)
+{
+  pageSize = sysconf(_SC_PAGESIZE);
+  size_t dataBytes = ((size_t)vm->memorySize*sizeof(int) + pageSize - 1) / pageSize * pageSize;
+
+  char* region = mmap(NULL, dataBytes + 2*pageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(region == MAP_FAILED)
+    return 0;
+
+  vm->mapped = dataBytes + 2*pageSize;
+  vm->guardLow = region;
+  vm->guardHigh = region + pageSize + dataBytes;
+  if(mprotect(vm->guardLow, pageSize, PROT_NONE) != 0 || mprotect(vm->guardHigh, pageSize, PROT_NONE) != 0)
+    return 0;
+  vm->PAS = (int*)(region + pageSize);
+
+  //static depth never exceeds the number of active calls, plus main
+  vm->display = calloc(vm->maxDepth + 1, sizeof(int));
+  vm->ARS = calloc(vm->maxDepth + 1, sizeof(int));
+  vm->savedDisplay = calloc(vm->maxDepth + 1, sizeof(int));
+  vm->savedDepth = calloc(vm->maxDepth + 1, sizeof(int));
+  if(vm->display == NULL || vm->ARS == NULL || vm->savedDisplay == NULL || vm->savedDepth == NULL)
+    return 0;
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = overflowHandler;
+  action.sa_flags = SA_SIGINFO | SA_NODEFER;
+  sigemptyset(&action.sa_mask);
+  return sigaction(SIGSEGV, &action, NULL) == 0;
+}
+
+void freeMemory(VM* vm)
+{
+  if(vm->guardLow != NULL)
+    munmap(vm->guardLow, vm->mapped);
+  free(vm->display);
+  free(vm->ARS);
+  free(vm->savedDisplay);
+  free(vm->savedDepth);
+}
+
+//exit status of a run that overflowed
+#define STACK_OVERFLOW VM_STACK_OVERFLOW
+
+int stackOverflow(VM* vm)
+{
+  fprintf(vm->output, "Stack overflow (memory %d words, call depth %d)\n", vm->memorySize, vm->maxDepth);
+  return STACK_OVERFLOW;
+}
+/*----- Memory -----*/
+
+
+
+/*----- Input and Output -----*/
+//Interactive runs prompt before every READ and scanf one integer from input.
+//In batch mode (vm_batch(), ./vm -b) there are no prompts: the first READ
+//takes all of input into memory at once, or the buffer given to
+//vm_input_buffer(), and every READ after that parses the next integer in
+//place. PRINT formats its line itself either way and writes it in one call,
+//so with a large buffer on output (./vm -b sets one) a run does no I/O
+//until the buffer fills or the program exits.
+//
+//Input can also be fed in pieces with vm_feed(), for programs reading from
+//pipes and sockets a scheduler multiplexes (vmserve.c): a READ that gets
+//ahead of the input suspends the stepped run instead of blocking.
+//
+//A run restored from a snapshot (see Snapshots) goes on reading where the
+//saved run stopped: its first READ passes over as many bytes as that run had
+//used, so it expects the same input stream from its start.
+#define INPUT_CHUNK 65536
+
+//all of input into ownedInput, 0 if memory runs out
+int loadInput(VM* vm)
+{
+  size_t capacity = 0, size = 0;
+  char* data = NULL;
+  for(;;)
   {
-    arb = PAS[arb];
-    numlevels--;
+    if(size == capacity)
+    {
+      capacity += capacity < INPUT_CHUNK ? INPUT_CHUNK : capacity;
+      char* grown = realloc(data, capacity);
+      if(grown == NULL)
+      {
+        free(data);
+        return 0;
+      }
+      data = grown;
+    }
+
+    size_t got = fread(data + size, 1, capacity - size, vm->input);
+    size += got;
+    if(got == 0)
+      break;
   }
 
-  return arb;
+  vm->ownedInput = data;
+  vm->inputData = data;
+  vm->inputSize = size;
+  vm->inputAt = 0;
+  return 1;
 }
 
+void dropInput(VM* vm)
+{
+  free(vm->ownedInput);
+  vm->ownedInput = NULL;
+  vm->inputData = NULL;
+  vm->inputSize = vm->inputAt = vm->inputCapacity = 0;
+  vm->inputDropped = 0;
+  vm->feeding = vm->inputClosed = 0;
+}
 
-int main(int argc, char* argv[])
+//appends fed input, dropping what READ has already parsed
+int feedInput(VM* vm, const char* _data, size_t _size)
 {
-  /*----- Opening and Verifying File -----*/
-  FILE* fp = fopen("elf.txt", "r");
-  if(fp == NULL)
+  if(vm->inputAt > 0)
+  {
+    memmove(vm->ownedInput, vm->ownedInput + vm->inputAt, vm->inputSize - vm->inputAt);
+    vm->inputDropped += vm->inputAt;
+    vm->inputSize -= vm->inputAt;
+    vm->inputAt = 0;
+  }
+
+  if(vm->inputSize + _size > vm->inputCapacity)
+  {
+    size_t capacity = vm->inputCapacity ? vm->inputCapacity : 256;
+    while(capacity < vm->inputSize + _size)
+      capacity *= 2;
+    char* grown = realloc(vm->ownedInput, capacity);
+    if(grown == NULL)
+      return 0;
+    vm->ownedInput = grown;
+    vm->inputCapacity = capacity;
+  }
+
+  memcpy(vm->ownedInput + vm->inputSize, _data, _size);
+  vm->inputSize += _size;
+  vm->inputData = vm->ownedInput;
+  return 1;
+}
+
+//the next integer as scanf("%d") would read it: spaces skipped, an optional
+//sign, then digits, which wrap past the range of an int like the arithmetic
+//does. 0 when there are no digits, and a READ after that fails again at the
+//same place, as scanf would.
+int parseInteger(VM* vm)
+{
+  if(vm->inputData == NULL) //fed nothing before the input closed
+    return 0;
+
+  const char* at = vm->inputData + vm->inputAt;
+  const char* end = vm->inputData + vm->inputSize;
+  while(at < end && (*at == ' ' || (*at >= '\t' && *at <= '\r')))
+    ++at;
+
+  int negative = 0;
+  if(at < end && (*at == '-' || *at == '+'))
+    negative = *at++ == '-';
+
+  unsigned int value = 0;
+  while(at < end && *at >= '0' && *at <= '9')
+    value = value*10 + (unsigned int)(*at++ - '0');
+
+  vm->inputAt = at - vm->inputData;
+  return (int)(negative ? 0u - value : value);
+}
+
+//bytes of input READs have used, -1 if the stream can't tell (scanf from a pipe)
+long long inputCursor(VM* vm)
+{
+  long long used;
+  if(vm->feeding)
+    used = vm->inputDropped + vm->inputAt;
+  else if(vm->inputData != NULL || vm->batch)
+    used = vm->inputAt;
+  else
+    used = ftell(vm->input);
+  return used < 0 ? -1 : used + vm->inputSkip;
+}
+
+//passes over what inputSkip says a restored run had read, as far as the input goes
+void skipInput(VM* vm)
+{
+  if(vm->inputData != NULL)
+  {
+    size_t left = vm->inputSize - vm->inputAt;
+    size_t skipped = (unsigned long long)vm->inputSkip < left ? (size_t)vm->inputSkip : left;
+    vm->inputAt += skipped;
+    vm->inputSkip -= skipped;
+  }
+  else if(!vm->feeding && !vm->batch)
   {
-    printf("File unable to be opened\n");
+    if(fseek(vm->input, vm->inputSkip, SEEK_CUR) != 0)
+    {
+      while(vm->inputSkip > 0 && getc(vm->input) != EOF)
+        --vm->inputSkip;
+    }
+    vm->inputSkip = 0;
+  }
+}
+
+//Stepped runs only READ once this says the input is there. Fed input can run
+//dry, so a READ there waits until the next integer has arrived whole
+//(something follows its last digit) or the input is closed. The prompt goes
+//out before the wait, not again when the READ runs.
+int inputReady(VM* vm)
+{
+  if(!vm->feeding || vm->inputClosed)
     return 1;
+
+  if(vm->inputSkip > 0)
+    skipInput(vm);
+  if(vm->inputData != NULL && vm->inputSkip == 0)
+  {
+    const char* at = vm->inputData + vm->inputAt;
+    const char* end = vm->inputData + vm->inputSize;
+    while(at < end && (*at == ' ' || (*at >= '\t' && *at <= '\r')))
+      ++at;
+    if(at < end && (*at == '-' || *at == '+'))
+      ++at;
+    while(at < end && *at >= '0' && *at <= '9')
+      ++at;
+    if(at < end)
+      return 1;
   }
-  /*----- Opening and Verifying File -----*/
-  
 
-  /*----- Loading Text Segment -----*/
-  while(fscanf(fp, "%d %d %d", &PAS[PC], &PAS[PC-1], &PAS[PC-2]) == 3)
-    PC -= 3;
+  if(!vm->batch && !vm->prompted)
+  {
+    fprintf(vm->output, "Please Enter an Integer: ");
+    vm->prompted = 1;
+  }
+  return 0;
+}
+
+int readInput(VM* vm)
+{
+  if(!vm->batch && !vm->prompted)
+    fprintf(vm->output, "Please Enter an Integer: ");
+  vm->prompted = 0;
+
+  if(vm->batch && !vm->feeding && vm->inputData == NULL && !loadInput(vm))
+    return 0;
+  if(vm->inputSkip > 0)
+    skipInput(vm);
+  if(vm->feeding || vm->batch)
+    return parseInteger(vm);
+
+  int input = 0;
+  fscanf(vm->input, "%d", &input);
+  return input;
+}
+
+void writeOutput(VM* vm, int _value)
+{
+  static const char prefix[] = "Output result is: ";
+  char line[sizeof(prefix) + 12];
+  memcpy(line, prefix, sizeof(prefix) - 1);
+
+  //digits backwards from the end of the line, then moved up against the prefix
+  char digits[12];
+  int at = sizeof(digits);
+  unsigned int magnitude = _value < 0 ? 0u - (unsigned int)_value : (unsigned int)_value;
+  do
+  {
+    digits[--at] = (char)('0' + magnitude % 10);
+    magnitude /= 10;
+  } while(magnitude != 0);
+  if(_value < 0)
+    digits[--at] = '-';
+
+  size_t length = sizeof(prefix) - 1;
+  memcpy(line + length, digits + at, sizeof(digits) - at);
+  length += sizeof(digits) - at;
+  line[length++] = '\n';
+  fwrite(line, 1, length, vm->output);
+}
+/*----- Input and Output -----*/
 
-  BP = PC;
-  SP = BP + 1;
-  PC = 499;
 
-  fclose(fp);
-  /*----- Loading Text Segment -----*/
 
-  //headers
-  printf("\n\tL\tM    %s   %s   %s   %s\n", "PC", "BP", "SP", "stack");
-  printf("Initial values:\t   %5d%5d%5d\n", PC, BP, SP);
+/*----- Predecoded Instructions -----*/
+//Every opcode, OPR sub-op, and SYS call gets its own handler so executing an
+//instruction takes exactly one dispatch. With GCC/Clang the interpreter is
+//direct-threaded through computed goto, anything else falls back to a switch.
+#if defined(__GNUC__) && !defined(VM_SWITCH_DISPATCH)
+#define VM_THREADED_DISPATCH
+#endif
 
-  int ARS[100]; //stupid stupid stupid stupid stupid stupid stupid stupid
-  memset(ARS, 0, 100*sizeof(int));
-  int topARs = 0;
+enum HANDLERS
+{
+  H_ILLEGAL = 0, //unknown opcode
+  H_LIT,
+  H_LOD,
+  H_STO,
+  H_CAL,
+  H_INC,
+  H_JMP,
+  H_JPC,
+  H_LDL,
+  H_STL,
+  H_LDG,
+  H_STG,
+  H_PRINT,
+  H_READ,
+  H_HALT,
+  H_RTN,
+  H_ADD,
+  H_SUB,
+  H_MUL,
+  H_DIV,
+  H_EQL,
+  H_NEQ,
+  H_LSS,
+  H_LEQ,
+  H_GTR,
+  H_GEQ,
+  H_EVEN,
+  H_DUP,
+  H_BADOPR, //unknown OPR sub-op
+  H_LIT_EMPTY, //top of stack cache, operand stack empty before a push or after a pop
+  H_LOD_EMPTY,
+  H_LDL_EMPTY,
+  H_LDG_EMPTY,
+  H_READ_EMPTY,
+  H_STO_EMPTY,
+  H_STL_EMPTY,
+  H_STG_EMPTY,
+  H_JPC_EMPTY,
+  H_PRINT_EMPTY,
+  H_CAL_EMPTY,
+  H_BRANCH_EQL, //superinstructions, see Superinstructions
+  H_BRANCH_NEQ,
+  H_BRANCH_LSS,
+  H_BRANCH_LEQ,
+  H_BRANCH_GTR,
+  H_BRANCH_GEQ,
+  H_ADD_CONST,
+  H_ADD_CONST_JMP,
+  H_ADD_LOCALS,
+  H_COPY_LOCAL,
+  H_SET_LOCAL,
+  HANDLER_COUNT
+};
 
-  
-  /*----- Main Loop -----*/
-  int continueProgram = 1;
-  while(continueProgram)
-  {
-    /* Fetch */
-    IR[OP] = PAS[PC];
-    IR[L] = PAS[--PC];
-    IR[M] = PAS[--PC];
-    --PC;
-    
-    /* Execute */
-    switch(IR[OP])
-    {
-      case LIT:
-        SP -= 1;
-        PAS[SP] = IR[M];
-        printf("LIT");
-        break;
+const char* handlerNames[HANDLER_COUNT] = {
+  "", "LIT", "LOD", "STO", "CAL", "INC", "JMP", "JPC", "LDL", "STL", "LDG", "STG",
+  "SYS", "SYS", "SYS", "RTN", "ADD", "SUB", "MUL", "DIV", "EQL", "NEQ", "LSS", "LEQ",
+  "GTR", "GEQ", "EVEN", "DUP", "",
+  "LIT", "LOD", "LDL", "LDG", "SYS", "STO", "STL", "STG", "JPC", "SYS", "CAL",
+  "LDL", "LDL", "LDL", "LDL", "LDL", "LDL", "LDL", "LDL", "LDL", "LDL", "LIT"
+};
 
+typedef struct Decoded
+{
+  void* target; //handler address when threaded
+  union
+  {
+    const struct Decoded* jump; //JMP, JPC, and CAL destination, resolved at load time
+    int reserve; //prologue INC of a verified procedure: words its frame can use below SP
+  };
+  int handler;
+  int op;
+  int l;
+  int m;
+}Decoded;
+
+//Code lives in its own array, PAS only holds data. Data addresses and the PC
+//values in the trace and in return addresses are still the ones the code would
+//have had in PAS, so output and stack contents are unchanged.
+
+int decodeHandler(int _op, int _m)
+{
+  switch(_op)
+  {
+    case LIT: return H_LIT;
+    case LOD: return H_LOD;
+    case STO: return H_STO;
+    case CAL: return H_CAL;
+    case INC: return H_INC;
+    case JMP: return H_JMP;
+    case JPC: return H_JPC;
+    case LDL: return H_LDL;
+    case STL: return H_STL;
+    case LDG: return H_LDG;
+    case STG: return H_STG;
+    case SYS:
+      if(_m == PRINT) return H_PRINT;
+      if(_m == READ) return H_READ;
+      return H_HALT; //anything else halts, as before
+    case OPR:
+      if(_m >= RTN && _m <= DUP) return H_RTN + _m;
+      return H_BADOPR;
+    default:
+      return H_ILLEGAL;
+  }
+}
+/*----- Predecoded Instructions -----*/
 
-      case LOD:
-        PAS[--SP] = PAS[base(BP, IR[L]) - IR[M]];
-        printf("LOD");
-        break;
 
-      case STO:
-        PAS[base(BP, IR[L]) - IR[M]] = PAS[SP];
-        SP = SP + 1;
-        printf("STO");
-        break;
+/*----- Verifier -----*/
+//Run once at load time so the interpreter doesn't have to check at run time:
+//jumps and calls land on instructions, every opcode, OPR, and SYS code exists,
+//the operand stack has one known depth at each instruction, and L never goes
+//past main. A procedure is entered through a run of JMPs ending in the INC that
+//allocates its frame, and every instruction belongs to exactly one procedure.
+typedef struct Procedure
+{
+  int entry;    //code index of the CAL target, 0 for main
+  int prologue; //code index of its INC
+  int parent;   //procedure the static link points at, -1 for main
+  int depth;    //static nesting depth, main is 0
+  int frame;    //words allocated by the INC, links included
+  int maxStack; //deepest the operand stack gets on top of the frame
+}Procedure;
 
-      case CAL:
-        PAS[SP-1] = base(BP, IR[L]);
-        PAS[SP-2] = BP;
-        PAS[SP-3] = PC;
-        BP = SP - 1;
-        PC = 499 - IR[M];
 
-        ARS[topARs] = BP;
-        topARs++;
-        printf("CAL");
-        break;
+int verifyError(VM* vm, int _index, const char* _reason)
+{
+  fprintf(vm->output, "Verification failed at line %d (%d %d %d): %s\n", _index, vm->code[_index].op, vm->code[_index].l, vm->code[_index].m, _reason);
+  return 0;
+}
 
-      case INC:
-        SP -= IR[M];
-        printf("INC");
-        break;
+//code index of a jump or call destination, -1 if it isn't an instruction
+int jumpTarget(VM* vm, int _m)
+{
+  if(_m < 0 || _m % 3 != 0 || _m/3 >= vm->codeLength)
+    return -1;
+  return _m/3;
+}
 
-      case JMP:
-        PC = 499 - IR[M];
-        printf("JMP");
-        break;
+int ancestor(VM* vm, int _procedure, int _levels)
+{
+  while(_levels-- > 0)
+    _procedure = vm->procedures[_procedure].parent;
+  return _procedure;
+}
 
-      case JPC:
-        if(PAS[SP] == 0) PC = 499 - IR[M];
-        SP += 1;
-        printf("JPC");
-        break;
+//procedure entered at _entry with the given static parent, -1 if it conflicts
+int addProcedure(VM* vm, int _entry, int _parent)
+{
+  int p = vm->procedureAt[_entry];
+  if(p != -1)
+    return vm->procedures[p].parent == _parent ? p : -1;
+
+  p = vm->procedureCount++;
+  vm->procedures[p].entry = _entry;
+  vm->procedures[p].parent = _parent;
+  vm->procedures[p].depth = _parent == -1 ? 0 : vm->procedures[_parent].depth + 1;
+  vm->procedures[p].maxStack = 0;
+  vm->procedureAt[_entry] = p;
+  return p;
+}
+
+//mark _index as reached by _procedure with _height operands, queueing it the first time
+int claim(VM* vm, int _from, int _index, int _procedure, int _height)
+{
+  if(_index == vm->codeLength)
+    return verifyError(vm, _from, "runs off the end of the code");
+
+  if(vm->owner[_index] == -1)
+  {
+    vm->owner[_index] = _procedure;
+    vm->height[_index] = _height;
+    if(_height >= 0)
+      vm->worklist[vm->worklistCount++] = _index;
+    return 1;
+  }
+
+  if(vm->owner[_index] != _procedure)
+    return verifyError(vm, _from, "jumps into another procedure");
+  if(vm->height[_index] != _height)
+    return verifyError(vm, _from, "reaches an instruction with a different stack depth");
+  return 1;
+}
+
+int verifyProcedure(VM* vm, int _procedure)
+{
+  Procedure* proc = &vm->procedures[_procedure];
+
+  //prologue: JMPs over the nested procedures, then INC
+  int i = proc->entry;
+  while(vm->code[i].handler == H_JMP)
+  {
+    if(!claim(vm, i, i, _procedure, -1))
+      return 0;
+    int target = jumpTarget(vm, vm->code[i].m);
+    if(target == -1)
+      return verifyError(vm, i, "jump target is not an instruction");
+    if(vm->owner[target] == _procedure)
+      return verifyError(vm, i, "procedure never allocates its frame");
+    i = target;
+  }
+  if(vm->code[i].handler != H_INC || vm->code[i].m < 3)
+    return verifyError(vm, i, "procedure does not start with INC of at least 3");
+  if(!claim(vm, i, i, _procedure, -1))
+    return 0;
+  proc->prologue = i;
+  proc->frame = vm->code[i].m;
+
+  vm->worklistCount = 0;
+  if(!claim(vm, i, i + 1, _procedure, 0))
+    return 0;
+
+  while(vm->worklistCount > 0)
+  {
+    i = vm->worklist[--vm->worklistCount];
+    const Decoded* d = &vm->code[i];
+    int pops = 0, pushes = 0, next = i + 1, target = -1;
 
-      case SYS:
-      
-        if(IR[M] == PRINT)
-        {
-          printf("Output result is: %d\n", PAS[SP++]);
-          printf("SYS");
-        }
-        else if(IR[M] == READ)
-        {
-          printf("Please Enter an Integer: ");
-          int input;
-          scanf("%d", &input);
-          PAS[--SP] = input;
-          printf("SYS");
-        }
-        else // HALT
-        {
-          printf("SYS");
-          continueProgram = 0;
-        }
+    switch(d->handler)
+    {
+      case H_LIT: case H_READ:
+        pushes = 1;
         break;
-      
-
-      case OPR:
-        switch(IR[M])
-        {
-          case RTN:
-            SP = BP + 1;
-            BP = PAS[SP-2];
-            PC = PAS[SP-3];
-            ARS[topARs] = 0;
-            --topARs;
-            printf("RTN");
-            break;
-
-          case ADD:
-            PAS[SP+1] = PAS[SP+1] + PAS[SP];
-            ++SP;
-            printf("ADD");
-            break;
-
-          case SUB:
-            PAS[SP+1] = PAS[SP+1] - PAS[SP];
-            ++SP;
-            printf("SUB");
-            break;
-
-          case MUL:
-            PAS[SP+1] = PAS[SP+1] * PAS[SP];
-            ++SP;
-            printf("MUL");
-            break;
-
-          case DIV:
-            PAS[SP+1] = PAS[SP+1] / PAS[SP];
-            ++SP;
-            printf("DIV");
-            break;
-
-          case EQL:
-            PAS[SP+1] = PAS[SP+1] == PAS[SP];
-            ++SP;
-            printf("EQL");
-            break;
-
-          case NEQ:
-            PAS[SP+1] = PAS[SP+1] != PAS[SP];
-            ++SP;
-            printf("NEQ");
-            break;
-
-          case LSS:
-            PAS[SP+1] = PAS[SP+1] < PAS[SP];
-            ++SP;
-            printf("LSS");
-            break;
-
-          case LEQ:
-            PAS[SP+1] = PAS[SP+1] <= PAS[SP];
-            ++SP;
-            printf("LEQ");
-            break;
-
-          case GTR:
-            PAS[SP+1] = PAS[SP+1] > PAS[SP];
-            ++SP;
-            printf("GTR");
-            break;
-
-          case GEQ:
-            PAS[SP+1] = PAS[SP+1] >= PAS[SP];
-            ++SP;
-            printf("GEQ");
-            break;
-
-          case EVEN:
-            PAS[SP] = (PAS[SP] % 2 == 0);
-            printf("EVEN");
-            break;
-
-          default:
-            printf("How did you get here? %d %d %d\n", IR[OP], IR[L], IR[M]);
-            return 1;
-            break;
-        }
+      case H_LOD: case H_STO:
+        if(d->l < 0 || d->l > proc->depth)
+          return verifyError(vm, i, "L is deeper than the procedure is nested");
+        pops = d->handler == H_STO;
+        pushes = d->handler == H_LOD;
         break;
-
-      default:
-        return 1;
+      case H_LDL: case H_LDG:
+        pushes = 1;
+        break;
+      case H_STL: case H_STG: case H_PRINT:
+        pops = 1;
+        break;
+      case H_ADD: case H_SUB: case H_MUL: case H_DIV: case H_EQL: case H_NEQ:
+      case H_LSS: case H_LEQ: case H_GTR: case H_GEQ:
+        pops = 2;
+        pushes = 1;
+        break;
+      case H_EVEN:
+        pops = 1;
+        pushes = 1;
+        break;
+      case H_DUP:
+        pops = 1;
+        pushes = 2;
+        break;
+      case H_JPC:
+        pops = 1;
+        if((target = jumpTarget(vm, d->m)) == -1)
+          return verifyError(vm, i, "jump target is not an instruction");
+        break;
+      case H_JMP:
+        if((target = jumpTarget(vm, d->m)) == -1)
+          return verifyError(vm, i, "jump target is not an instruction");
+        next = -1;
         break;
+      case H_CAL:
+      {
+        int entry = jumpTarget(vm, d->m);
+        if(entry == -1)
+          return verifyError(vm, i, "call target is not an instruction");
+        if(d->l < 0 || d->l > proc->depth)
+          return verifyError(vm, i, "L is deeper than the procedure is nested");
+        if(addProcedure(vm, entry, ancestor(vm, _procedure, d->l)) == -1)
+          return verifyError(vm, i, "procedure is called with different static links");
+        proc = &vm->procedures[_procedure];
+        break;
+      }
+      case H_RTN:
+        if(_procedure == 0)
+          return verifyError(vm, i, "RTN in the main program");
+        next = -1;
+        break;
+      case H_HALT:
+        if(d->m != HALT)
+          return verifyError(vm, i, "unknown SYS call");
+        next = -1;
+        break;
+      case H_INC:
+        return verifyError(vm, i, "INC outside a procedure prologue");
+      case H_BADOPR:
+        return verifyError(vm, i, "unknown OPR operation");
+      default:
+        return verifyError(vm, i, "unknown opcode");
+    }
+
+    int h = vm->height[i];
+    if(h < pops)
+      return verifyError(vm, i, "operand stack underflow");
+    h += pushes - pops;
+    if(h > proc->maxStack)
+      proc->maxStack = h;
+
+    if(next != -1 && !claim(vm, i, next, _procedure, h))
+      return 0;
+    if(target != -1 && !claim(vm, i, target, _procedure, h))
+      return 0;
+  }
+
+  return 1;
+}
+
+//frame offsets can only be checked once every procedure's frame is known
+int verifyAddresses(VM* vm)
+{
+  for(int i=0; i<vm->codeLength; ++i)
+  {
+    if(vm->owner[i] == -1)
+      continue;
+
+    int frame;
+    int write = 0;
+    switch(vm->code[i].handler)
+    {
+      case H_STO: write = 1; //fallthrough
+      case H_LOD: frame = vm->procedures[ancestor(vm, vm->owner[i], vm->code[i].l)].frame; break;
+      case H_STL: write = 1; //fallthrough
+      case H_LDL: frame = vm->procedures[vm->owner[i]].frame; break;
+      case H_STG: write = 1; //fallthrough
+      case H_LDG: frame = vm->procedures[0].frame; break;
+      default: continue;
     }
 
+    if(vm->code[i].m < 0 || vm->code[i].m >= frame)
+      return verifyError(vm, i, "address outside the frame");
+    if(write && vm->code[i].m < 3)
+      return verifyError(vm, i, "overwrites a static link, dynamic link, or return address");
+  }
+  return 1;
+}
+
+int verify(VM* vm)
+{
+  vm->procedures = malloc(vm->codeLength*sizeof(Procedure));
+  vm->procedureAt = malloc(vm->codeLength*sizeof(int));
+  vm->owner = malloc(vm->codeLength*sizeof(int));
+  vm->height = malloc(vm->codeLength*sizeof(int));
+  vm->worklist = malloc(vm->codeLength*sizeof(int));
+  if(vm->codeLength == 0 || vm->procedures == NULL || vm->procedureAt == NULL || vm->owner == NULL || vm->height == NULL || vm->worklist == NULL)
+  {
+    fprintf(vm->output, "Verification failed: no code\n");
+    return 0;
+  }
+
+  for(int i=0; i<vm->codeLength; ++i)
+  {
+    vm->procedureAt[i] = -1;
+    vm->owner[i] = -1;
+  }
+
+  //procedures are discovered by the CALs of ones already checked
+  addProcedure(vm, 0, -1);
+  for(int p=0; p<vm->procedureCount; ++p)
+    if(!verifyProcedure(vm, p))
+      return 0;
+
+  if(!verifyAddresses(vm))
+    return 0;
+
+  //a CAL takes 3 words below the operands
+  for(int p=0; p<vm->procedureCount; ++p)
+    vm->code[vm->procedures[p].prologue].reserve = vm->procedures[p].maxStack + 3;
+  return 1;
+}
 
-    /* Printing */
-    printf("\t%d\t%-2d %5d%5d%5d  ", IR[L], IR[M], PC, BP, SP);
+//The top of stack cache can't spill into or refill from PAS[sp] while the
+//operand stack is empty, since that word is a variable then. The verified
+//stack depths say where that happens, so those instructions get handlers
+//that skip it. Required before running the cached loop.
+void specializeEmptyStack(VM* vm)
+{
+  for(int i=0; i<vm->codeLength; ++i)
+  {
+    if(vm->owner[i] == -1 || vm->height[i] < 0)
+      continue;
 
-    int baseOfStack;
-    //finds # of activation records for printing purposes
-    for(int ARs=0; ; ++ARs)
+    int* h = &vm->code[i].handler;
+    if(vm->height[i] == 0)
     {
-      if(base(BP, ARs) == 0)
+      switch(*h)
       {
-        baseOfStack = base(BP, --ARs);
-        break;
+        case H_LIT: *h = H_LIT_EMPTY; break;
+        case H_LOD: *h = H_LOD_EMPTY; break;
+        case H_LDL: *h = H_LDL_EMPTY; break;
+        case H_LDG: *h = H_LDG_EMPTY; break;
+        case H_READ: *h = H_READ_EMPTY; break;
+        case H_CAL: *h = H_CAL_EMPTY; break;
       }
     }
+    else if(vm->height[i] == 1)
+    {
+      switch(*h)
+      {
+        case H_STO: *h = H_STO_EMPTY; break;
+        case H_STL: *h = H_STL_EMPTY; break;
+        case H_STG: *h = H_STG_EMPTY; break;
+        case H_JPC: *h = H_JPC_EMPTY; break;
+        case H_PRINT: *h = H_PRINT_EMPTY; break;
+      }
+    }
+  }
+  vm->threadedLabels = NULL;
+}
+/*----- Verifier -----*/
+
+
+
+/*----- Superinstructions -----*/
+//Statement-sized sequences that dominate bench/sequences.sh profiles of the
+//bench programs, each run by one handler in verified quiet runs. A sequence
+//only fuses where the operand stack starts empty, so it never has to touch
+//the top of stack cache. Its first instruction gets the fused handler and
+//reads the rest of its operands from the instructions after it, which keep
+//their own handlers, so jumping into the middle of a sequence still works.
+//LOD and STO with L = 0 count as LDL and STL.
+enum SEQUENCE_OPS
+{
+  S_LOCAL_LOAD = 100, //matches LDL or LOD 0
+  S_LOCAL_STORE,      //matches STL or STO 0
+  S_LIT,
+  S_ADD,
+  S_COMPARE,          //EQL through GEQ
+  S_JPC,
+  S_JMP,
+  S_END = 0
+};
+
+typedef struct Superinstruction
+{
+  int handler;
+  int ops[6];
+}Superinstruction;
+
+//longest first, so a sequence isn't fused into one of its prefixes
+const Superinstruction superinstructions[] = {
+  {H_ADD_CONST_JMP, {S_LOCAL_LOAD, S_LIT, S_ADD, S_LOCAL_STORE, S_JMP}},   //i := i + 1 at the end of a loop
+  {H_BRANCH_EQL, {S_LOCAL_LOAD, S_LOCAL_LOAD, S_COMPARE, S_JPC}},          //while i < n do, offset by the comparison
+  {H_ADD_CONST, {S_LOCAL_LOAD, S_LIT, S_ADD, S_LOCAL_STORE}},
+  {H_ADD_LOCALS, {S_LOCAL_LOAD, S_LOCAL_LOAD, S_ADD, S_LOCAL_STORE}},
+  {H_COPY_LOCAL, {S_LOCAL_LOAD, S_LOCAL_STORE}},
+  {H_SET_LOCAL, {S_LIT, S_LOCAL_STORE}}
+};
+
+int matchesOp(const Decoded* _d, int _op)
+{
+  switch(_op)
+  {
+    case S_LOCAL_LOAD: return _d->op == LDL || (_d->op == LOD && _d->l == 0);
+    case S_LOCAL_STORE: return _d->op == STL || (_d->op == STO && _d->l == 0);
+    case S_LIT: return _d->op == LIT;
+    case S_ADD: return _d->op == OPR && _d->m == ADD;
+    case S_COMPARE: return _d->op == OPR && _d->m >= EQL && _d->m <= GEQ;
+    case S_JPC: return _d->op == JPC;
+    case S_JMP: return _d->op == JMP;
+  }
+  return 0;
+}
+
+//number of instructions fused at _index, 0 if none
+int fuseAt(VM* vm, int _index)
+{
+  if(vm->owner[_index] == -1 || vm->height[_index] != 0)
+    return 0;
+
+  for(int s=0; s<(int)(sizeof(superinstructions)/sizeof(Superinstruction)); ++s)
+  {
+    const int* ops = superinstructions[s].ops;
+    int length = 0;
+    while(ops[length] != S_END && _index + length < vm->codeLength &&
+          vm->owner[_index + length] == vm->owner[_index] && matchesOp(&vm->code[_index + length], ops[length]))
+      ++length;
+    if(ops[length] != S_END)
+      continue;
+
+    int handler = superinstructions[s].handler;
+    if(handler == H_BRANCH_EQL) //one handler per comparison
+      handler += vm->code[_index + 2].m - EQL;
+    vm->code[_index].handler = handler;
+    return length;
+  }
+  return 0;
+}
+
+//after specializeEmptyStack(), so instructions inside a sequence keep the handler
+//the top of stack cache needs when they are jumped to directly
+int fuseSuperinstructions(VM* vm)
+{
+  int fused = 0;
+  for(int i=0; i<vm->codeLength; ++i)
+  {
+    int length = fuseAt(vm, i);
+    if(length > 0)
+    {
+      ++fused;
+      i += length - 1;
+    }
+  }
+  vm->threadedLabels = NULL;
+  return fused;
+}
+/*----- Superinstructions -----*/
+
+
+
+/*----- Executables -----*/
+//elf.bin from parsercodegen_complete.c -b, laid out as executable.h
+//describes, mapped whole and checked before it's unpacked.
+
+//the executable open on fd mapped whole, NULL if it's damaged, saying why on
+//_errors unless that's NULL. unmapExecutable() once done with it
+const ExecutableHeader* mapExecutable(int _fd, FILE* _errors)
+{
+  struct stat file;
+  if(fstat(_fd, &file) != 0 || file.st_size < (off_t)sizeof(ExecutableHeader))
+  {
+    if(_errors != NULL)
+      fprintf(_errors, "Executable is damaged\n");
+    return NULL;
+  }
+  void* image = mmap(NULL, file.st_size, PROT_READ, MAP_PRIVATE, _fd, 0);
+  if(image == MAP_FAILED)
+  {
+    if(_errors != NULL)
+      fprintf(_errors, "Executable unable to be mapped\n");
+    return NULL;
+  }
+
+  const ExecutableHeader* header = image;
+  size_t body = file.st_size - sizeof(ExecutableHeader);
+  const char* problem = NULL;
+  if(header->magic != EXECUTABLE_MAGIC || header->version != EXECUTABLE_VERSION)
+    problem = "Executable is from another version of the code generator\n";
+  else if(header->codeLength < 0 || header->constantCount < 0 || header->debugSize < 0 || header->debugSize % sizeof(int) != 0 ||
+          body != ((size_t)header->codeLength + header->constantCount)*sizeof(int) + header->debugSize ||
+          checksum((const unsigned*)(header + 1), body / sizeof(int)) != header->checksum)
+    problem = "Executable is damaged\n";
+  if(problem != NULL)
+  {
+    if(_errors != NULL)
+      fprintf(_errors, "%s", problem);
+    munmap(image, file.st_size);
+    return NULL;
+  }
+  return header;
+}
+
+void unmapExecutable(const ExecutableHeader* _header)
+{
+  munmap((void*)_header, sizeof(ExecutableHeader) + ((size_t)_header->codeLength + _header->constantCount)*sizeof(int) + _header->debugSize);
+}
+/*----- Executables -----*/
+
+
 
+/*----- Source Map -----*/
+//elf.map from the code generator, or the debug map of an executable: the
+//source file, then the range of it every instruction came from. The profiler adds hits up per source line, and -g
+//prints the line each traced instruction belongs to.
+typedef struct SourceRange
+{
+  int line;
+  int column;
+  int endLine;
+  int endColumn;
+}SourceRange;
+
+SourceRange* sourceMap; //one per instruction, NULL without a matching map
+char* sourcePath; //the map's source file
+char** sourceLines; //its lines, NULL if it can't be read
+int sourceLineCount;
+int annotateTrace; //-g
+int tracedLine;
+
+//the map built into an executable, NULL and sourceMap untouched for one
+//without a debug map
+char* loadExecutableMap(VM* vm, const char* _program)
+{
+  int fd = open(_program, O_RDONLY);
+  int magic = 0;
+  if(fd == -1)
+    return NULL;
+  const ExecutableHeader* header = NULL;
+  if(pread(fd, &magic, sizeof(int), 0) == sizeof(int) && magic == EXECUTABLE_MAGIC)
+    header = mapExecutable(fd, NULL);
+  close(fd);
+  if(header == NULL)
+    return NULL;
+
+  const int* ranges;
+  const char* source = executableSource(header, &ranges);
+  char* path = NULL;
+  if(source != NULL && header->codeLength == vm->codeLength && (sourceMap = calloc(vm->codeLength + 1, sizeof(SourceRange))) != NULL)
+  {
+    memcpy(sourceMap, ranges, vm->codeLength*sizeof(SourceRange));
+    path = strdup(source);
+  }
+  unmapExecutable(header);
+  return path;
+}
 
+//from the program's own debug map if it's an executable with one, elf.map otherwise
+int loadSourceMap(VM* vm, const char* _program)
+{
+  char* path = loadExecutableMap(vm, _program);
+  size_t size = 0;
+  ssize_t length;
+  if(path == NULL)
+  {
+    FILE* fp = fopen("elf.map", "r");
+    if(fp == NULL)
+      return 0;
+
+    length = getline(&path, &size, fp);
+    sourceMap = calloc(vm->codeLength + 1, sizeof(SourceRange));
+    int count = 0;
+    if(length > 0 && sourceMap != NULL)
+    {
+      path[strcspn(path, "\n")] = '\0';
+      SourceRange* r = sourceMap;
+      while(count < vm->codeLength && fscanf(fp, "%d %d %d %d", &r[count].line, &r[count].column, &r[count].endLine, &r[count].endColumn) == 4)
+        ++count;
+    }
+    fclose(fp);
 
+    //a map left over from another program is worse than none
+    if(count != vm->codeLength)
+    {
+      free(sourceMap);
+      sourceMap = NULL;
+      free(path);
+      return 0;
+    }
+  }
 
-    //weird code that prints from bottom to top of stack cause yall wanted that for some reason
-    //if printing the BP of an AR, adds | for formatting
-    int tmp = topARs;
-    int tmp2 = 0;
-    for(int i=baseOfStack; i>=SP; --i)
+  FILE* source = fopen(path, "r");
+  if(source != NULL)
+  {
+    int capacity = 0;
+    char* line = NULL;
+    size = 0;
+    while((length = getline(&line, &size, source)) >= 0)
     {
-      if(ARS[tmp2] == i && tmp2 <topARs)
+      if(sourceLineCount == capacity)
       {
-        printf("| ");
-        ++tmp2;
+        capacity = capacity ? 2*capacity : 64;
+        sourceLines = realloc(sourceLines, capacity*sizeof(char*));
       }
-      printf("%-2d ", PAS[i]);
+      line[strcspn(line, "\r\n")] = '\0';
+      sourceLines[sourceLineCount++] = line;
+      line = NULL;
+      size = 0;
     }
+    free(line);
+    fclose(source);
+  }
+  sourcePath = path;
+  return 1;
+}
+
+//the loaded program as an executable at _path, with the source map built in
+//if one is loaded (./vm -w), 0 if it can't be written
+int writeExecutable(VM* vm, const char* _path)
+{
+  const char* path = sourceMap != NULL ? sourcePath : NULL;
+  if(executableDebugSize(vm->codeLength, path) > INT_MAX)
+    return 0;
+
+  unsigned* body = allocateExecutable(vm->codeLength, path);
+  if(body == NULL)
+    return 0;
+  int constantCount = 0;
+  int ok = 1;
+  for(int i=0; i<vm->codeLength && ok; ++i)
+    ok = packInstruction(body, vm->codeLength, i, &constantCount, vm->code[i].op, vm->code[i].l, vm->code[i].m);
+
+  FILE* fp = ok ? fopen(_path, "wb") : NULL;
+  if(fp != NULL)
+  {
+    ok = writeExecutableFile(fp, body, vm->codeLength, constantCount, path, (const int*)sourceMap);
+    ok = fclose(fp) == 0 && ok;
+  }
+  free(body);
+  return fp != NULL && ok;
+}
 
+//whether a map entry's _line can be counted: at least 1, and in the source
+//when it could be read
+int profiledLine(int _line)
+{
+  return _line >= 1 && _line < INT_MAX && (sourceLineCount == 0 || _line <= sourceLineCount);
+}
+
+//text of source line _line without its indentation, "" if unknown
+const char* sourceText(int _line)
+{
+  if(_line < 1 || _line > sourceLineCount)
+    return "";
+  const char* text = sourceLines[_line - 1];
+  while(*text == ' ' || *text == '\t')
+    ++text;
+  return text;
+}
+
+//-g: a line of its own before the first instruction of every source line run
+void traceSourceLine(VM* vm, int _index)
+{
+  int line = sourceMap[_index].line;
+  if(line == tracedLine)
+    return;
+  tracedLine = line;
+  fprintf(vm->output, "line %d: %s\n", line, sourceText(line));
+}
+/*----- Source Map -----*/
+
+
+
+/* Find base L levels down from the current activation record */
+int base (VM* vm, int base, int numlevels) 
+{
+  int arb = base;
+
+  while (numlevels>0) 
+  {
+    arb = vm->PAS[arb];
+    numlevels--;
+  }
+
+  return arb;
+}
+
+/* base(BP, L) without walking the static chain */
+int frameBase(VM* vm, int bp, int numlevels)
+{
+  if(numlevels > vm->depth) //not a valid static chain, keep the old behaviour
+    return base(vm, bp, numlevels);
 
-    printf("\n");
-    
+  return vm->display[vm->depth - numlevels];
+}
+
+
+/* Prints the stack from the bottom of main's record up to SP */
+void printStack(VM* vm)
+{
+  int baseOfStack;
+  //finds # of activation records for printing purposes
+  for(int ARs=0; ; ++ARs)
+  {
+    if(base(vm, vm->BP, ARs) == 0)
+    {
+      baseOfStack = base(vm, vm->BP, --ARs);
+      break;
+    }
   }
-  /*----- Main Loop -----*/
 
 
 
 
-  return 0;
-}
\ No newline at end of file
+  //weird code that prints from bottom to top of stack cause yall wanted that for some reason
+  //if printing the BP of an AR, adds | for formatting
+  int tmp2 = 0;
+  for(int i=baseOfStack; i>=vm->SP; --i)
+  {
+    if(vm->ARS[tmp2] == i && tmp2 <vm->topARs)
+    {
+      fprintf(vm->output, "| ");
+      ++tmp2;
+    }
+    fprintf(vm->output, "%-2d ", vm->PAS[i]);
+  }
+
+
+  fprintf(vm->output, "\n");
+}
+
+void printTrace(VM* vm, const Decoded* _ir)
+{
+  if(annotateTrace && sourceMap != NULL)
+    traceSourceLine(vm, _ir - vm->code);
+
+  fprintf(vm->output, "%s", handlerNames[_ir->handler]);
+
+  /* Printing */
+  fprintf(vm->output, "\t%d\t%-2d %5d%5d%5d  ", _ir->l, _ir->m, vm->PC, vm->BP, vm->SP);
+  printStack(vm);
+}
+
+
+//code index of a PM/0 code address, and back
+#define CODE_INDEX(address) ((vm->memorySize - 1 - (address)) / 3)
+#define CODE_ADDRESS(index) (vm->memorySize - 1 - 3*(index))
+
+/*----- Binary Trace -----*/
+//Fixed-size records appended to a memory buffer and written out a block at a
+//time. tracedump.c replays them into the text trace: the registers come from the
+//record, the stack from applying each instruction's single memory write.
+#define TRACE_MAGIC 0x54304d50 //"PM0T"
+#define TRACE_BLOCK 4096
+
+typedef struct TraceHeader
+{
+  int magic;
+  int memorySize;
+  int pc;
+  int bp;
+  int sp;
+}TraceHeader;
+
+typedef struct TraceRecord
+{
+  int handler;
+  int l;
+  int m;
+  int pc; //registers after the instruction
+  int bp;
+  int sp;
+  int address; //memory word the instruction wrote, -1 if none (CAL: the static link)
+  int value;   //what was written there, or the value SYS PRINT printed
+}TraceRecord;
+
+TraceRecord traceBuffer[TRACE_BLOCK];
+int traceCount;
+FILE* traceFile;
+
+void flushTrace()
+{
+  fwrite(traceBuffer, sizeof(TraceRecord), traceCount, traceFile);
+  traceCount = 0;
+}
+
+void recordTrace(VM* vm, const Decoded* _ir, int _address, int _value)
+{
+  TraceRecord* r = &traceBuffer[traceCount];
+  r->handler = _ir->handler;
+  r->l = _ir->l;
+  r->m = _ir->m;
+  r->pc = vm->PC;
+  r->bp = vm->BP;
+  r->sp = vm->SP;
+  r->address = _address;
+  r->value = _value;
+
+  if(++traceCount == TRACE_BLOCK)
+    flushTrace();
+}
+/*----- Binary Trace -----*/
+
+
+
+/*----- Tiered Execution -----*/
+//./vm -m tiered starts on the plain interpreter (runCounting), which counts
+//backward jumps at their loop heads and calls at their procedure entries. The
+//first time one reaches its threshold the whole program is compiled by the
+//JIT, and from then on every hot arrival enters native code at that
+//instruction with the activation record as the interpreter left it. Native
+//code runs until that record returns, then the interpreter finishes the RTN
+//and carries on counting, so a short run never pays for compiling and a hot
+//procedure called from cold code moves back and forth once per call. Where
+//the JIT can't compile the program the first hot spot moves the rest of the
+//run to the quiet loop with superinstructions instead.
+#define TIER_UP 3 //runCounting result: PC is hot
+
+int loopThreshold = 1000; //-l, backward jumps to one loop head
+int callThreshold = 1000; //-c, calls to one procedure
+
+//-t timing, in ms
+enum TIER
+{
+  TIER_INTERPRETER,
+  TIER_COMPILE,
+  TIER_OPTIMISED,
+  TIER_COUNT
+};
+double tierTime[TIER_COUNT];
+int promotions;
+const char* optimisedTier = "native";
+
+double milliseconds()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec*1e3 + now.tv_nsec/1e6;
+}
+/*----- Tiered Execution -----*/
+
+
+
+/*----- Fuel -----*/
+//vm_limit() (./vm -n and -e) bounds the instructions and wall time a run can
+//take, for code that isn't trusted to end. Code only runs for longer than
+//its length by jumping backwards or calling, so nothing else is checked: a
+//backward jump burns the instructions from its target up to itself and a
+//call burns one, a subtract from fuel in the loops and in native code alike.
+//When fuel runs out refuel() hands out the next slice of the instruction
+//limit and reads the clock, so time is only checked once per FUEL_SLICE
+//instructions. A run over either limit stops at the jump or call, before
+//taking it, with VM_OUT_OF_FUEL.
+#define OUT_OF_FUEL VM_OUT_OF_FUEL
+#define FUEL_SLICE (1 << 20)
+
+//keeps the refuel out of the way of the loops' fast paths
+#if defined(__GNUC__)
+#define UNLIKELY(condition) __builtin_expect(!!(condition), 0)
+#else
+#define UNLIKELY(condition) (condition)
+#endif
+
+//fuel for a run starting now
+void startFuel(VM* vm)
+{
+  vm->fuelLeft = vm->instructionLimit;
+  vm->deadline = vm->timeLimit > 0 ? milliseconds() + vm->timeLimit : 0;
+  if(vm->instructionLimit > 0)
+    vm->fuel = 0; //the first check takes a slice
+  else
+    vm->fuel = vm->timeLimit > 0 ? FUEL_SLICE : LLONG_MAX;
+}
+
+//fuel ran out, 0 once there is more, OUT_OF_FUEL if a limit is reached
+int refuel(VM* vm)
+{
+  const char* limit = NULL;
+  if(vm->deadline > 0 && milliseconds() >= vm->deadline)
+    limit = "time";
+  else if(vm->instructionLimit == 0)
+    vm->fuel = vm->timeLimit > 0 ? FUEL_SLICE : LLONG_MAX;
+  else
+  {
+    //what the last burn overdrew comes out of the next slice
+    while(vm->fuel <= 0 && vm->fuelLeft > 0)
+    {
+      long long slice = vm->fuelLeft < FUEL_SLICE ? vm->fuelLeft : FUEL_SLICE;
+      vm->fuelLeft -= slice;
+      vm->fuel += slice;
+    }
+    if(vm->fuel < 0)
+      limit = "instruction";
+  }
+  if(limit == NULL)
+    return 0;
+
+  fprintf(vm->output, "Out of fuel (%s limit) at PC %d, SP %d, call depth %d\n", limit, vm->PC, vm->SP, vm->topARs);
+  return OUT_OF_FUEL;
+}
+/*----- Fuel -----*/
+
+
+
+/*----- Profiler -----*/
+//./vm -m profile runs verified code on its own copy of the loop (TRACE_PROFILE)
+//that counts the static chain levels LOD, STO, and CAL reach and follows CAL
+//and RTN through a tree of call paths. Per instruction it only bumps a
+//register: hits are counted where JMP, JPC, CAL, and RTN land, and every other
+//instruction runs as often as the one before it plus its own landings. Each path gets
+//the instructions and time spent while it was on top, charged at calls and
+//returns so the clock is only read there. Other modes run loops without any of this. After the
+//run profile.txt has the report, hottest first, and profile.folded has one
+//"main;proc@E;... instructions" line per call path for flamegraph tools.
+typedef struct ProfileNode
+{
+  int procedure;
+  int parent;  //node of the caller's path, -1 for main
+  int child;   //first callee path, -1 if none
+  int sibling; //next path with the same parent
+  long long calls;
+  long long instructions; //executed while this path was on top
+  long long ticks;
+}ProfileNode;
+
+ProfileNode* profileNodes;
+int profileNodeCount;
+int profileNodeCapacity;
+ProfileNode* profileTop; //path of the running procedure
+long long profileExecuted; //instructions run up to the last call or return
+long long profileCharged;  //of those, already charged to a path
+
+long long* profileArrivals; //times control landed on each instruction other than by falling through
+long long* chainWalks;  //LOD/STO/CAL executions by L
+long long profileClock; //ticks at the last call or return
+long long startTicks;
+long long startNanoseconds;
+
+long long nanoseconds()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec*1000000000LL + now.tv_nsec;
+}
+
+//read at every call and return, so the cycle counter where there is one,
+//scaled to nanoseconds over the whole run
+long long ticks()
+{
+#if defined(__x86_64__)
+  return (long long)__rdtsc();
+#else
+  return nanoseconds();
+#endif
+}
+
+int addProfileNode(int _procedure, int _parent)
+{
+  if(profileNodeCount == profileNodeCapacity)
+  {
+    int top = profileTop - profileNodes;
+    profileNodeCapacity = profileNodeCapacity ? 2*profileNodeCapacity : 64;
+    profileNodes = realloc(profileNodes, profileNodeCapacity*sizeof(ProfileNode));
+    if(profileNodes == NULL)
+    {
+      printf("Unable to allocate the profile\n");
+      exit(1);
+    }
+    profileTop = profileNodes + top;
+  }
+
+  ProfileNode* node = &profileNodes[profileNodeCount];
+  memset(node, 0, sizeof(ProfileNode));
+  node->procedure = _procedure;
+  node->parent = _parent;
+  node->child = -1;
+  node->sibling = -1;
+  if(_parent != -1)
+  {
+    node->sibling = profileNodes[_parent].child;
+    profileNodes[_parent].child = profileNodeCount;
+  }
+  return profileNodeCount++;
+}
+
+int startProfile(VM* vm)
+{
+  profileArrivals = calloc(vm->codeLength + 1, sizeof(long long));
+  chainWalks = calloc(vm->procedureCount, sizeof(long long)); //L never passes the deepest nesting
+  if(profileArrivals == NULL || chainWalks == NULL)
+    return 0;
+
+  int root = addProfileNode(0, -1);
+  profileTop = &profileNodes[root];
+  profileTop->calls = 1;
+  profileClock = startTicks = ticks();
+  startNanoseconds = nanoseconds();
+  return 1;
+}
+
+//charges the time and instructions since the last event to the path on top
+void profileEvent(long long _executed)
+{
+  long long now = ticks();
+  profileTop->ticks += now - profileClock;
+  profileTop->instructions += _executed - profileCharged;
+  profileClock = now;
+  profileCharged = profileExecuted = _executed;
+}
+
+void profileCall(VM* vm, int _entry, long long _executed)
+{
+  profileEvent(_executed);
+
+  int parent = profileTop - profileNodes;
+  int procedure = vm->procedureAt[_entry];
+  int n = profileTop->child;
+  while(n != -1 && profileNodes[n].procedure != procedure)
+    n = profileNodes[n].sibling;
+  if(n == -1)
+    n = addProfileNode(procedure, parent);
+
+  profileTop = &profileNodes[n];
+  ++profileTop->calls;
+}
+
+void profileReturn(long long _executed)
+{
+  profileEvent(_executed);
+  profileTop = &profileNodes[profileTop->parent];
+}
+
+//main, the name in its "procedure name;" header when the source is known, or
+//proc@ the code index it is called at
+const char* procedureName(VM* vm, int _procedure)
+{
+  static char name[32];
+  if(_procedure == 0)
+    return "main";
+
+  SourceRange header = sourceMap != NULL ? sourceMap[vm->procedures[_procedure].entry] : (SourceRange){0};
+  if(header.line >= 1 && header.line <= sourceLineCount && header.column >= 1 &&
+     (int)strlen(sourceLines[header.line - 1]) >= header.column - 1 &&
+     strncmp(sourceLines[header.line - 1] + header.column - 1, "procedure", 9) == 0)
+  {
+    const char* text = sourceLines[header.line - 1] + header.column - 1 + 9;
+    while(*text == ' ' || *text == '\t')
+      ++text;
+    int length = 0;
+    while(length < (int)sizeof(name) - 1 && ((text[length] >= 'a' && text[length] <= 'z') ||
+          (text[length] >= 'A' && text[length] <= 'Z') || (text[length] >= '0' && text[length] <= '9')))
+      ++length;
+    if(length > 0)
+    {
+      memcpy(name, text, length);
+      name[length] = '\0';
+      return name;
+    }
+  }
+
+  snprintf(name, sizeof(name), "proc@%d", vm->procedures[_procedure].entry);
+  return name;
+}
+
+//the call path of node _n, outermost first
+void printProfilePath(VM* vm, FILE* _out, int _n)
+{
+  if(profileNodes[_n].parent != -1)
+  {
+    printProfilePath(vm, _out, profileNodes[_n].parent);
+    fprintf(_out, ";");
+  }
+  fprintf(_out, "%s", procedureName(vm, profileNodes[_n].procedure));
+}
+
+//qsort orders for the report, descending
+const long long* sortKeys;
+int compareHottest(const void* _a, const void* _b)
+{
+  long long a = sortKeys[*(const int*)_a], b = sortKeys[*(const int*)_b];
+  return a < b ? 1 : a > b ? -1 : *(const int*)_a - *(const int*)_b;
+}
+
+void sortHottest(int* _order, const long long* _keys, int _count)
+{
+  for(int i=0; i<_count; ++i)
+    _order[i] = i;
+  sortKeys = _keys;
+  qsort(_order, _count, sizeof(int), compareHottest);
+}
+
+double percent(long long _part, long long _whole)
+{
+  return _whole ? 100.0*_part/_whole : 0.0;
+}
+
+int writeProfile(VM* vm)
+{
+  profileEvent(profileExecuted);
+  double scale = profileClock > startTicks ? (double)(nanoseconds() - startNanoseconds) / (profileClock - startTicks) : 1.0;
+
+  const char* opcodes[] = {"", "LIT", "OPR", "LOD", "STO", "CAL", "INC", "JMP", "JPC", "SYS", "LDL", "STL", "LDG", "STG"};
+  const char* operations[] = {"RTN", "ADD", "SUB", "MUL", "DIV", "EQL", "NEQ", "LSS", "LEQ", "GTR", "GEQ", "", "EVEN", "DUP"};
+  const char* calls[] = {"", "PRINT", "READ", "HALT"};
+
+  //per procedure: calls, self instructions and time, and time with callees (recursion counted once)
+  int kinds = 14 + 14 + 4; //opcodes, then OPR and SYS by M
+  long long* selfTime = calloc(vm->procedureCount, sizeof(long long));
+  long long* totalTime = calloc(vm->procedureCount, sizeof(long long));
+  long long* selfInstructions = calloc(vm->procedureCount, sizeof(long long));
+  long long* procedureCalls = calloc(vm->procedureCount, sizeof(long long));
+  int* seen = calloc(vm->procedureCount, sizeof(int));
+  long long* kindHits = calloc(kinds, sizeof(long long));
+  long long* hits = calloc(vm->codeLength + 1, sizeof(long long));
+  int* order = malloc((vm->codeLength + vm->procedureCount + kinds + 1)*sizeof(int));
+  FILE* report = fopen("profile.txt", "w");
+  FILE* folded = fopen("profile.folded", "w");
+  if(selfTime == NULL || totalTime == NULL || selfInstructions == NULL || procedureCalls == NULL ||
+     seen == NULL || kindHits == NULL || hits == NULL || order == NULL || report == NULL || folded == NULL)
+  {
+    printf("Unable to write the profile\n");
+    return 0;
+  }
+
+  long long executed = 0, elapsed = 0;
+  for(int n=0; n<profileNodeCount; ++n)
+  {
+    ProfileNode* node = &profileNodes[n];
+    long long nanoseconds = node->ticks*scale;
+    selfTime[node->procedure] += nanoseconds;
+    selfInstructions[node->procedure] += node->instructions;
+    procedureCalls[node->procedure] += node->calls;
+    executed += node->instructions;
+    elapsed += nanoseconds;
+
+    for(int a=n; a!=-1; a=profileNodes[a].parent)
+    {
+      int p = profileNodes[a].procedure;
+      if(seen[p] != n + 1)
+      {
+        seen[p] = n + 1;
+        totalTime[p] += nanoseconds;
+      }
+    }
+
+    if(node->instructions > 0)
+    {
+      printProfilePath(vm, folded, n);
+      fprintf(folded, " %lld\n", node->instructions);
+    }
+  }
+
+  //an unfinished block (stack overflow) counts as run
+  for(int i=0; i<vm->codeLength; ++i)
+  {
+    const Decoded* before = &vm->code[i > 0 ? i - 1 : 0];
+    int fallsThrough = i > 0 && before->op != JMP && before->op != JPC && before->op != CAL &&
+                       !(before->op == OPR && before->m == RTN) && !(before->op == SYS && before->m == HALT);
+    hits[i] = profileArrivals[i] + (fallsThrough ? hits[i-1] : 0);
+  }
+
+  fprintf(report, "%lld instructions in %.3f ms\n", executed, elapsed/1e6);
+
+  fprintf(report, "\nProcedures by time\n%-12s %10s %12s %8s %12s %14s\n", "procedure", "calls", "self ms", "self %", "total ms", "instructions");
+  sortHottest(order, selfTime, vm->procedureCount);
+  for(int k=0; k<vm->procedureCount; ++k)
+  {
+    int p = order[k];
+    fprintf(report, "%-12s %10lld %12.3f %7.1f%% %12.3f %14lld\n", procedureName(vm, p), procedureCalls[p], selfTime[p]/1e6,
+            percent(selfTime[p], elapsed), totalTime[p]/1e6, selfInstructions[p]);
+  }
+
+  //instruction hits by the source line they were generated from, skipping
+  //map entries that can't be a line of the source
+  if(sourceMap != NULL)
+  {
+    int lines = 1;
+    for(int i=0; i<vm->codeLength; ++i)
+      if(profiledLine(sourceMap[i].line) && sourceMap[i].line >= lines)
+        lines = sourceMap[i].line + 1;
+
+    long long* lineHits = calloc(lines, sizeof(long long));
+    int* lineOrder = malloc(lines*sizeof(int));
+    if(lineHits == NULL || lineOrder == NULL)
+    {
+      printf("Unable to write the profile\n");
+      free(lineHits);
+      free(lineOrder);
+      return 0;
+    }
+    for(int i=0; i<vm->codeLength; ++i)
+      if(profiledLine(sourceMap[i].line))
+        lineHits[sourceMap[i].line] += hits[i];
+
+    fprintf(report, "\nSource lines by hits\n%6s %14s %8s  %s\n", "source", "hits", "%", "text");
+    sortHottest(lineOrder, lineHits, lines);
+    for(int k=0; k<lines && lineHits[lineOrder[k]] > 0; ++k)
+    {
+      int line = lineOrder[k];
+      fprintf(report, "%6d %14lld %7.1f%%  %s\n", line, lineHits[line], percent(lineHits[line], executed), sourceText(line));
+    }
+    free(lineHits);
+    free(lineOrder);
+  }
+
+  fprintf(report, "\nInstructions by hits\n%6s %-10s %5s %6s %14s %8s%s\n", "line", "op", "L", "M", "hits", "%",
+          sourceMap != NULL ? "  source" : "");
+  sortHottest(order, hits, vm->codeLength);
+  for(int k=0; k<vm->codeLength && hits[order[k]] > 0; ++k)
+  {
+    const Decoded* d = &vm->code[order[k]];
+    fprintf(report, "%6d %-10s %5d %6d %14lld %7.1f%%", order[k], handlerNames[d->handler], d->l, d->m,
+            hits[order[k]], percent(hits[order[k]], executed));
+    if(sourceMap != NULL)
+      fprintf(report, "  %d:%d", sourceMap[order[k]].line, sourceMap[order[k]].column);
+    fprintf(report, "\n");
+  }
+
+  for(int i=0; i<vm->codeLength; ++i)
+  {
+    int op = vm->code[i].op, m = vm->code[i].m;
+    if(op == OPR && m >= 0 && m < 14)
+      kindHits[14 + m] += hits[i];
+    else if(op == SYS && m >= 1 && m <= 3)
+      kindHits[28 + m] += hits[i];
+    else if(op >= 1 && op < 14)
+      kindHits[op] += hits[i];
+  }
+  fprintf(report, "\nOpcodes by hits\n%-10s %14s %8s\n", "op", "hits", "%");
+  sortHottest(order, kindHits, kinds);
+  for(int k=0; k<kinds && kindHits[order[k]] > 0; ++k)
+  {
+    int kind = order[k];
+    char name[16];
+    if(kind >= 28)
+      snprintf(name, sizeof(name), "SYS %s", calls[kind - 28]);
+    else if(kind >= 14)
+      snprintf(name, sizeof(name), "OPR %s", operations[kind - 14]);
+    else
+      snprintf(name, sizeof(name), "%s", opcodes[kind]);
+    fprintf(report, "%-10s %14lld %7.1f%%\n", name, kindHits[kind], percent(kindHits[kind], executed));
+  }
+
+  fprintf(report, "\nStatic chain levels of LOD, STO, and CAL\n%5s %14s\n", "L", "executions");
+  for(int l=0; l<vm->procedureCount; ++l)
+    if(chainWalks[l] > 0)
+      fprintf(report, "%5d %14lld\n", l, chainWalks[l]);
+
+  fclose(report);
+  fclose(folded);
+  return 1;
+}
+/*----- Profiler -----*/
+
+
+//execution modes, macros rather than an enum since vm_run.h tests them with #if
+#define TRACE_NONE 0
+#define TRACE_TEXT 1
+#define TRACE_BINARY 2
+#define JIT 3 //quiet, compiled by vm_jit.h
+#define TIERS 4 //quiet, see Tiered Execution
+#define TRACE_PROFILE 5 //quiet, see Profiler
+
+//verified quiet runs keep the top of stack in a local, unless built with
+//-DVM_NO_TOS_CACHE to compare against the plain loop
+#ifdef VM_NO_TOS_CACHE
+#define CACHE_TOS 0
+#else
+#define CACHE_TOS 1
+#endif
+#define VERIFIED 1
+#define TIERED 0
+#define STEPPED 0
+#define RUN_FUNCTION runQuiet
+#define TRACE_MODE TRACE_NONE
+#include "vm_run.h"
+
+#define CACHE_TOS 0
+#define VERIFIED 1
+#define TIERED 0
+#define STEPPED 0
+#define RUN_FUNCTION runTrace
+#define TRACE_MODE TRACE_TEXT
+#include "vm_run.h"
+
+#define CACHE_TOS 0
+#define VERIFIED 1
+#define TIERED 0
+#define STEPPED 0
+#define RUN_FUNCTION runBinaryTrace
+#define TRACE_MODE TRACE_BINARY
+#include "vm_run.h"
+
+//-u skips the verifier and runs on these instead
+#define CACHE_TOS 0
+#define VERIFIED 0
+#define TIERED 0
+#define STEPPED 0
+#define RUN_FUNCTION runQuietChecked
+#define TRACE_MODE TRACE_NONE
+#include "vm_run.h"
+
+#define CACHE_TOS 0
+#define VERIFIED 0
+#define TIERED 0
+#define STEPPED 0
+#define RUN_FUNCTION runTraceChecked
+#define TRACE_MODE TRACE_TEXT
+#include "vm_run.h"
+
+#define CACHE_TOS 0
+#define VERIFIED 0
+#define TIERED 0
+#define STEPPED 0
+#define RUN_FUNCTION runBinaryTraceChecked
+#define TRACE_MODE TRACE_BINARY
+#include "vm_run.h"
+
+#ifdef VM_NO_TOS_CACHE
+#define CACHE_TOS 0
+#else
+#define CACHE_TOS 1
+#endif
+#define VERIFIED 1
+#define TIERED 0
+#define STEPPED 0
+#define RUN_FUNCTION runProfile
+#define TRACE_MODE TRACE_PROFILE
+#include "vm_run.h"
+
+//first tier of -m tiered, runQuiet's handlers are specialized for its cache
+#define CACHE_TOS 0
+#define VERIFIED 1
+#define TIERED 1
+#define STEPPED 0
+#define RUN_FUNCTION runCounting
+#define TRACE_MODE TRACE_NONE
+#include "vm_run.h"
+
+//vm_step(), also on code without runQuiet's rewrites
+#define CACHE_TOS 0
+#define VERIFIED 1
+#define TIERED 0
+#define STEPPED 1
+#define RUN_FUNCTION runStepping
+#define TRACE_MODE TRACE_NONE
+#include "vm_run.h"
+
+#define CACHE_TOS 0
+#define VERIFIED 0
+#define TIERED 0
+#define STEPPED 1
+#define RUN_FUNCTION runSteppingChecked
+#define TRACE_MODE TRACE_NONE
+#include "vm_run.h"
+
+#include "vm_jit.h"
+#include "vm_lanes.h"
+
+//runs verified code with tiers (see Tiered Execution)
+int runTiered(VM* vm)
+{
+  vm->hotness = calloc(vm->codeLength + 1, sizeof(int));
+  if(vm->hotness == NULL)
+  {
+    printf("Unable to allocate the tier counters\n");
+    return 1;
+  }
+
+  int compiled = -1; //until the first promotion
+  for(;;)
+  {
+    double start = milliseconds();
+    int result = runCounting(vm);
+    tierTime[TIER_INTERPRETER] += milliseconds() - start;
+    if(result != TIER_UP)
+      return result;
+    ++promotions;
+
+    if(compiled == -1)
+    {
+      start = milliseconds();
+      compiled = jitCompile(vm);
+      if(!compiled)
+      {
+        optimisedTier = "superinstructions";
+#if !defined(VM_NO_TOS_CACHE)
+        specializeEmptyStack(vm);
+#endif
+#if !defined(VM_NO_SUPERINSTRUCTIONS)
+        fuseSuperinstructions(vm);
+#endif
+      }
+      tierTime[TIER_COMPILE] += milliseconds() - start;
+    }
+
+    start = milliseconds();
+    if(!compiled)
+    {
+      //the rewritten handlers are runQuiet's, so there is no way back
+      result = runQuiet(vm);
+      tierTime[TIER_OPTIMISED] += milliseconds() - start;
+      return result;
+    }
+
+    int frame = vm->BP;
+    result = jitEnter(vm, CODE_INDEX(vm->PC));
+    tierTime[TIER_OPTIMISED] += milliseconds() - start;
+    if(result != JIT_RETURNED)
+      return result;
+
+    //native code ran until the record it entered returned, the rest of that RTN is the interpreter's
+    vm->SP = frame + 1;
+    vm->BP = vm->PAS[frame - 1];
+    vm->PC = vm->PAS[frame - 2];
+    vm->ARS[vm->topARs] = 0;
+    --vm->topARs;
+    vm->display[vm->depth] = vm->savedDisplay[vm->topARs];
+    vm->depth = vm->savedDepth[vm->topARs];
+  }
+}
+
+//quiet run from PC on the fastest loop the code allows
+int runFastest(VM* vm)
+{
+  if(!vm->verified)
+    return runQuietChecked(vm);
+
+  if(!vm->prepared)
+  {
+#if !defined(VM_NO_TOS_CACHE)
+    specializeEmptyStack(vm);
+#endif
+#if !defined(VM_NO_SUPERINSTRUCTIONS)
+    fuseSuperinstructions(vm);
+#endif
+    vm->prepared = 1;
+  }
+  return runQuiet(vm);
+}
+
+//back to the handlers decodeHandler() gave, for loops that can't run runFastest()'s rewrites
+void unprepareCode(VM* vm)
+{
+  for(int i=0; i<vm->codeLength; ++i)
+    vm->code[i].handler = decodeHandler(vm->code[i].op, vm->code[i].m);
+  vm->threadedLabels = NULL;
+  vm->prepared = 0;
+}
+
+
+
+/*----- Library -----*/
+//vm.h. A VM is only ever touched by the thread running it, so nothing here locks.
+
+//registers and memory as they are before the first instruction
+void resetMachine(VM* vm)
+{
+  vm->inputSkip = 0;
+  if(vm->used)
+  {
+    memset(vm->PAS, 0, vm->memorySize*sizeof(int));
+    memset(vm->display, 0, (vm->maxDepth + 1)*sizeof(int));
+    memset(vm->ARS, 0, (vm->maxDepth + 1)*sizeof(int));
+    vm->used = 0;
+  }
+
+  vm->BP = CODE_ADDRESS(vm->codeLength);
+  vm->SP = vm->BP + 1;
+  vm->PC = CODE_ADDRESS(0);
+  vm->GP = vm->BP;
+  vm->display[0] = vm->BP;
+  vm->depth = 0;
+  vm->topARs = 0;
+  startFuel(vm);
+}
+
+void unloadProgram(VM* vm)
+{
+  free(vm->code);
+  free(vm->procedures);
+  free(vm->procedureAt);
+  free(vm->owner);
+  free(vm->height);
+  free(vm->worklist);
+  free(vm->hotness);
+  vm->code = NULL;
+  vm->codeLength = 0;
+  vm->threadedLabels = NULL;
+  vm->verified = 0;
+  vm->prepared = 0;
+  vm->procedures = NULL;
+  vm->procedureCount = 0;
+  vm->procedureAt = vm->owner = vm->height = vm->worklist = vm->hotness = NULL;
+}
+
+VM* vm_create(int _memorySize, int _maxDepth)
+{
+  if(_memorySize < 4 || _maxDepth < 1)
+    return NULL;
+
+  VM* vm = calloc(1, sizeof(VM));
+  if(vm == NULL)
+    return NULL;
+  vm->memorySize = _memorySize;
+  vm->maxDepth = _maxDepth;
+  vm->input = stdin;
+  vm->output = stdout;
+  if(!allocateMemory(vm))
+  {
+    vm_destroy(vm);
+    return NULL;
+  }
+  return vm;
+}
+
+void vm_destroy(VM* vm)
+{
+  if(vm == NULL)
+    return;
+  unloadProgram(vm);
+  freeMemory(vm);
+  dropInput(vm);
+  free(vm);
+}
+
+void vm_io(VM* vm, FILE* _input, FILE* _output)
+{
+  dropInput(vm); //batch input read from the old stream
+  vm->input = _input;
+  vm->output = _output;
+}
+
+void vm_batch(VM* vm, int _batch)
+{
+  vm->batch = _batch;
+}
+
+void vm_limit(VM* vm, long long _instructions, long long _milliseconds)
+{
+  vm->instructionLimit = _instructions > 0 ? _instructions : 0;
+  vm->timeLimit = _milliseconds > 0 ? _milliseconds : 0;
+}
+
+void vm_input_buffer(VM* vm, const char* _data, size_t _size)
+{
+  dropInput(vm);
+  vm->batch = 1;
+  vm->inputData = _data;
+  vm->inputSize = _size;
+}
+
+//appends an instruction to code, 0 if PAS has no room left for it
+int addInstruction(VM* vm, int _op, int _l, int _m, int* _capacity)
+{
+  if(CODE_ADDRESS(vm->codeLength + 1) < 1) //one word of PAS is left for the stack
+  {
+    fprintf(vm->output, "Program too large\n");
+    return 0;
+  }
+
+  //one spare entry for the illegal sentinel
+  if(vm->codeLength + 1 >= *_capacity)
+  {
+    int capacity = *_capacity ? 2 * *_capacity : 64;
+    Decoded* code = realloc(vm->code, capacity*sizeof(Decoded));
+    if(code == NULL)
+    {
+      fprintf(vm->output, "Unable to allocate the program's code\n");
+      return 0;
+    }
+    vm->code = code;
+    *_capacity = capacity;
+  }
+
+  Decoded d;
+  memset(&d, 0, sizeof(Decoded));
+  d.op = _op;
+  d.l = _l;
+  d.m = _m;
+  d.handler = decodeHandler(_op, _m);
+  vm->code[vm->codeLength++] = d;
+  return 1;
+}
+
+//once all of the code is added: the sentinel and jumps, then the machine
+//reset to run it from the start and the code verified if asked to
+int finishCode(VM* vm, int _verify)
+{
+  if(vm->code == NULL)
+    vm->code = malloc(sizeof(Decoded));
+  memset(&vm->code[vm->codeLength], 0, sizeof(Decoded));
+
+  //decoded once here instead of on every fetch
+  for(int i=0; i<vm->codeLength; ++i)
+  {
+    int h = vm->code[i].handler;
+    if(h != H_JMP && h != H_JPC && h != H_CAL)
+      continue;
+
+    int m = vm->code[i].m;
+    if(m >= 0 && m % 3 == 0 && m/3 < vm->codeLength)
+      vm->code[i].jump = &vm->code[m/3];
+    else
+      vm->code[i].jump = &vm->code[vm->codeLength];
+  }
+
+  resetMachine(vm);
+
+  if(_verify && !verify(vm))
+    return 0;
+  vm->verified = _verify;
+  vm->stopped = -1;
+  return 1;
+}
+
+int vm_load(VM* vm, const char* _path, int _verify)
+{
+  unloadProgram(vm);
+
+  FILE* fp = fopen(_path, "r");
+  if(fp == NULL)
+  {
+    fprintf(vm->output, "File unable to be opened\n");
+    return 0;
+  }
+
+  int op, l, m;
+  int capacity = 0;
+  int magic = 0;
+  if(fread(&magic, sizeof(int), 1, fp) == 1 && magic == EXECUTABLE_MAGIC)
+  {
+    const ExecutableHeader* header = mapExecutable(fileno(fp), vm->output);
+    fclose(fp);
+    if(header == NULL)
+      return 0;
+
+    //room for all of it and the sentinel up front
+    capacity = header->codeLength + 1;
+    vm->code = malloc(capacity*sizeof(Decoded));
+    int ok = vm->code != NULL;
+    int constant = 0;
+    for(int i=0; i<header->codeLength && ok; ++i)
+    {
+      ok = unpackInstruction(header, i, &constant, &op, &l, &m);
+      if(!ok)
+        fprintf(vm->output, "Executable is damaged\n");
+      ok = ok && addInstruction(vm, op, l, m, &capacity);
+    }
+    unmapExecutable(header);
+    return ok && finishCode(vm, _verify);
+  }
+  rewind(fp);
+
+  while(fscanf(fp, "%d %d %d", &op, &l, &m) == 3)
+  {
+    if(!addInstruction(vm, op, l, m, &capacity))
+    {
+      fclose(fp);
+      return 0;
+    }
+  }
+  fclose(fp);
+
+  return finishCode(vm, _verify);
+}
+
+int vm_run(VM* vm)
+{
+  if(vm->code == NULL)
+    return VM_ERROR;
+
+  resetMachine(vm);
+  vm->stopped = -1;
+  return vm_continue(vm);
+}
+
+int vm_continue(VM* vm)
+{
+  if(vm->code == NULL)
+    return VM_ERROR;
+  if(vm->stopped != -1)
+    return vm->stopped;
+
+  vm->used = 1;
+  runningVM = vm;
+  int result;
+  if(sigsetjmp(vm->overflowJump, 1)) //a push that ran into a guard page
+    result = STACK_OVERFLOW;
+  else
+    result = runFastest(vm);
+  runningVM = NULL;
+
+  vm->stopped = result == STACK_OVERFLOW ? stackOverflow(vm) : result;
+  return vm->stopped;
+}
+
+void vm_start(VM* vm)
+{
+  resetMachine(vm);
+  vm->prompted = 0;
+  vm->stopped = vm->code != NULL ? -1 : VM_ERROR;
+}
+
+int vm_step(VM* vm, long long _budget)
+{
+  if(vm->code == NULL)
+    return VM_ERROR;
+  if(vm->stopped != -1)
+    return vm->stopped;
+  if(_budget < 1)
+    return VM_RUNNING;
+
+  if(vm->prepared)
+    unprepareCode(vm);
+  vm->used = 1;
+  vm->budget = _budget;
+  runningVM = vm;
+  int result;
+  if(sigsetjmp(vm->overflowJump, 0)) //SA_NODEFER left the mask alone, and steps are too short to save it each time
+    result = STACK_OVERFLOW;
+  else
+    result = vm->verified ? runStepping(vm) : runSteppingChecked(vm);
+  runningVM = NULL;
+
+  if(result == VM_RUNNING || result == VM_WAITING)
+    return result;
+  vm->stopped = result == STACK_OVERFLOW ? stackOverflow(vm) : result;
+  return vm->stopped;
+}
+
+int vm_feed(VM* vm, const char* _data, size_t _size)
+{
+  if(!vm->feeding)
+  {
+    dropInput(vm);
+    vm->feeding = 1;
+  }
+  if(_data == NULL)
+  {
+    vm->inputClosed = 1;
+    return 1;
+  }
+  return feedInput(vm, _data, _size);
+}
+
+int vm_run_lanes(VM* vm, int _lanes, FILE** _inputs, FILE** _outputs, int* _results)
+{
+  if(vm->code == NULL || !vm->verified || _lanes < 1 || vm->instructionLimit > 0 || vm->timeLimit > 0)
+    return 0;
+
+  resetMachine(vm);
+  return runLockstep(vm, _lanes, _inputs, _outputs, _results);
+}
+
+int vm_instruction(VM* vm, int _index, VMInstruction* _instruction)
+{
+  if(vm->code == NULL || _index < 0 || _index >= vm->codeLength)
+    return 0;
+  _instruction->op = vm->code[_index].op;
+  _instruction->l = vm->code[_index].l;
+  _instruction->m = vm->code[_index].m;
+  _instruction->procedure = vm->verified ? vm->owner[_index] : -1;
+  _instruction->height = vm->verified ? vm->height[_index] : -1;
+  return 1;
+}
+
+int vm_procedure(VM* vm, int _procedure, VMProcedure* _info)
+{
+  if(vm->code == NULL || !vm->verified || _procedure < 0 || _procedure >= vm->procedureCount)
+    return 0;
+  const Procedure* proc = &vm->procedures[_procedure];
+  _info->entry = proc->entry;
+  _info->parent = proc->parent;
+  _info->depth = proc->depth;
+  _info->frame = proc->frame;
+  _info->maxStack = proc->maxStack;
+  return 1;
+}
+/*----- Library -----*/
+
+
+
+/*----- Snapshots -----*/
+//vm_save() writes everything a machine needs to go on later, in this
+//process or another: its code, registers, the display and call bookkeeping
+//of the active calls, how much input READ has used, and PAS from its lowest
+//to its highest nonzero word, which is all of memory that can matter since
+//PAS starts out zero. Memory is page aligned in the file, so vm_restore()
+//maps it straight into PAS copy on write: restoring reads a header and the
+//code, the pages of memory come in from the page cache as the run touches
+//them, and every process restoring one snapshot shares them until it writes.
+//./vm -k saves at the first READ or where -n or -e stop a run, and ./vm -r
+//goes on from a snapshot.
+#define SNAPSHOT_MAGIC 0x53304d50 //"PM0S"
+#define SNAPSHOT_VERSION 1
+
+//followed by the code (op, l, m per instruction), display[0..depth], and
+//ARS, savedDisplay, and savedDepth of each active call, then memory at memoryAt
+typedef struct SnapshotHeader
+{
+  int magic;
+  int version;
+  int memorySize;
+  int maxDepth;
+  int codeLength;
+  int verified;
+  int PC;
+  int SP;
+  int BP;
+  int GP;
+  int depth;
+  int topARs;
+  int prompted;
+  int pageSize;          //memory's alignment in the file
+  long long inputCursor; //bytes of input READ had used, -1 if unknown
+  long long memoryFrom;  //bytes of PAS saved, page aligned
+  long long memoryTo;
+  long long memoryAt;    //file offset of memoryFrom
+}SnapshotHeader;
+
+//ints between the header and memory
+long long snapshotWords(const SnapshotHeader* _header)
+{
+  return 3LL*_header->codeLength + _header->depth + 1 + 3LL*_header->topARs;
+}
+
+//the header of the snapshot open on fd, 0 if it isn't one
+int readSnapshotHeader(int _fd, SnapshotHeader* _header)
+{
+  return pread(_fd, _header, sizeof(SnapshotHeader), 0) == sizeof(SnapshotHeader) &&
+         _header->magic == SNAPSHOT_MAGIC && _header->version == SNAPSHOT_VERSION;
+}
+
+int vm_save(VM* vm, const char* _path)
+{
+  if(vm->code == NULL)
+    return 0;
+
+  SnapshotHeader header;
+  memset(&header, 0, sizeof(SnapshotHeader));
+  header.magic = SNAPSHOT_MAGIC;
+  header.version = SNAPSHOT_VERSION;
+  header.memorySize = vm->memorySize;
+  header.maxDepth = vm->maxDepth;
+  header.codeLength = vm->codeLength;
+  header.verified = vm->verified;
+  header.PC = vm->PC;
+  header.SP = vm->SP;
+  header.BP = vm->BP;
+  header.GP = vm->GP;
+  header.depth = vm->depth;
+  header.topARs = vm->topARs;
+  header.prompted = vm->prompted;
+  header.pageSize = (int)pageSize;
+  header.inputCursor = inputCursor(vm);
+
+  int low = 0, high = vm->memorySize - 1;
+  while(low <= high && vm->PAS[low] == 0)
+    ++low;
+  while(high >= low && vm->PAS[high] == 0)
+    --high;
+  if(low <= high)
+  {
+    long long dataBytes = (long long)vm->mapped - 2*pageSize;
+    long long to = ((long long)(high + 1)*sizeof(int) + pageSize - 1) / pageSize * pageSize;
+    header.memoryFrom = (long long)low*sizeof(int) / pageSize * pageSize;
+    header.memoryTo = to < dataBytes ? to : dataBytes;
+  }
+  long long metadata = sizeof(SnapshotHeader) + snapshotWords(&header)*sizeof(int);
+  header.memoryAt = (metadata + pageSize - 1) / pageSize * pageSize;
+
+  FILE* fp = fopen(_path, "wb");
+  if(fp == NULL)
+    return 0;
+  fwrite(&header, sizeof(SnapshotHeader), 1, fp);
+  for(int i=0; i<vm->codeLength; ++i)
+  {
+    int instruction[3] = {vm->code[i].op, vm->code[i].l, vm->code[i].m};
+    fwrite(instruction, sizeof(int), 3, fp);
+  }
+  fwrite(vm->display, sizeof(int), vm->depth + 1, fp);
+  fwrite(vm->ARS, sizeof(int), vm->topARs, fp);
+  fwrite(vm->savedDisplay, sizeof(int), vm->topARs, fp);
+  fwrite(vm->savedDepth, sizeof(int), vm->topARs, fp);
+
+  //zeros up to memoryAt, so the file is never shorter than what gets mapped
+  static const char padding[1 << 16];
+  fwrite(padding, 1, header.memoryAt - metadata, fp);
+  fwrite((char*)vm->PAS + header.memoryFrom, 1, header.memoryTo - header.memoryFrom, fp);
+
+  int written = !ferror(fp);
+  return fclose(fp) == 0 && written;
+}
+
+//whether _base is GP or the base of one of the first _count active records,
+//which are in falling order
+int activeRecord(const VM* vm, int _base, int _count)
+{
+  int low = 0, high = _count - 1;
+  while(low <= high)
+  {
+    int middle = (low + high) / 2;
+    if(vm->ARS[middle] == _base)
+      return 1;
+    if(vm->ARS[middle] > _base)
+      low = middle + 1;
+    else
+      high = middle - 1;
+  }
+  return _base == vm->GP;
+}
+
+//verified code indexes PAS through the display and the records' links without
+//checks, so a restored machine must hold what CAL and RTN could have left:
+//records below GP linked to each other with real return addresses, display
+//entries that are active records, and each call's saved depth no deeper than
+//its caller could have been. The checked loop needs none of this
+int restoredMachineValid(const VM* vm)
+{
+  if(vm->GP != CODE_ADDRESS(vm->codeLength) || vm->BP != (vm->topARs > 0 ? vm->ARS[vm->topARs - 1] : vm->GP))
+    return 0;
+  for(int i=0; i<vm->topARs; ++i)
+  {
+    int caller = i > 0 ? vm->ARS[i - 1] : vm->GP;
+    int record = vm->ARS[i];
+    if(record < 2 || record >= caller || vm->PAS[record - 1] != caller)
+      return 0;
+    int returnAddress = vm->PAS[record - 2];
+    if(returnAddress < 0 || returnAddress >= vm->memorySize || CODE_INDEX(returnAddress) >= vm->codeLength ||
+       (vm->memorySize - 1 - returnAddress) % 3 != 0)
+      return 0;
+    if(vm->savedDepth[i] < 0 || vm->savedDepth[i] > i ||
+       (vm->savedDisplay[i] != 0 && !activeRecord(vm, vm->savedDisplay[i], i)))
+      return 0;
+  }
+  for(int d=0; d<=vm->depth; ++d)
+    if(!activeRecord(vm, vm->display[d], vm->topARs))
+      return 0;
+  return 1;
+}
+
+int vm_restore(VM* vm, const char* _path)
+{
+  int fd = open(_path, O_RDONLY);
+  if(fd == -1)
+  {
+    fprintf(vm->output, "File unable to be opened\n");
+    return 0;
+  }
+
+  SnapshotHeader header;
+  struct stat file;
+  long long dataBytes = (long long)vm->mapped - 2*pageSize;
+  if(!readSnapshotHeader(fd, &header) || fstat(fd, &file) != 0 || header.codeLength < 1 ||
+     header.depth < 0 || header.depth > header.topARs || header.topARs < 0 ||
+     header.memoryFrom < 0 || header.memoryFrom > header.memoryTo || header.memoryTo > dataBytes ||
+     header.memoryAt < (long long)sizeof(SnapshotHeader) + snapshotWords(&header)*(long long)sizeof(int) ||
+     file.st_size < header.memoryAt + header.memoryTo - header.memoryFrom)
+  {
+    fprintf(vm->output, "Not a snapshot\n");
+    close(fd);
+    return 0;
+  }
+  if(header.memorySize != vm->memorySize || header.topARs > vm->maxDepth)
+  {
+    fprintf(vm->output, "Snapshot needs %d words of memory and a call depth of %d\n", header.memorySize, header.topARs);
+    close(fd);
+    return 0;
+  }
+
+  size_t words = snapshotWords(&header);
+  int* data = malloc(words*sizeof(int));
+  if(data == NULL || pread(fd, data, words*sizeof(int), sizeof(SnapshotHeader)) != (ssize_t)(words*sizeof(int)))
+  {
+    fprintf(vm->output, "Not a snapshot\n");
+    free(data);
+    close(fd);
+    return 0;
+  }
+
+  //the code as vm_load() would have it, then the machine where it stopped
+  unloadProgram(vm);
+  int capacity = 0;
+  int ok = 1;
+  for(int i=0; i<header.codeLength && ok; ++i)
+    ok = addInstruction(vm, data[3*i], data[3*i + 1], data[3*i + 2], &capacity);
+  ok = ok && finishCode(vm, header.verified);
+  if(ok && (CODE_INDEX(header.PC) < 0 || CODE_INDEX(header.PC) >= header.codeLength || (header.memorySize - 1 - header.PC) % 3 != 0 ||
+            header.SP < 1 || header.SP > header.memorySize || header.BP < 0 || header.BP >= header.memorySize))
+  {
+    fprintf(vm->output, "Not a snapshot\n");
+    ok = 0;
+  }
+  if(!ok)
+  {
+    free(data);
+    close(fd);
+    return 0;
+  }
+
+  const int* at = data + 3*header.codeLength;
+  memcpy(vm->display, at, (header.depth + 1)*sizeof(int));
+  at += header.depth + 1;
+  memcpy(vm->ARS, at, header.topARs*sizeof(int));
+  at += header.topARs;
+  memcpy(vm->savedDisplay, at, header.topARs*sizeof(int));
+  at += header.topARs;
+  memcpy(vm->savedDepth, at, header.topARs*sizeof(int));
+  free(data);
+
+  vm->PC = header.PC;
+  vm->SP = header.SP;
+  vm->BP = header.BP;
+  vm->GP = header.GP;
+  vm->depth = header.depth;
+  vm->topARs = header.topARs;
+  vm->prompted = header.prompted;
+  vm->inputSkip = header.inputCursor > 0 ? header.inputCursor : 0;
+
+  //mapped where the page sizes agree, read otherwise
+  size_t length = header.memoryTo - header.memoryFrom;
+  char* memory = (char*)vm->PAS + header.memoryFrom;
+  if(length > 0 && (header.pageSize != pageSize ||
+                    mmap(memory, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, header.memoryAt) == MAP_FAILED) &&
+     pread(fd, memory, length, header.memoryAt) != (ssize_t)length)
+  {
+    fprintf(vm->output, "Not a snapshot\n");
+    ok = 0;
+  }
+  else if(vm->verified && !restoredMachineValid(vm))
+  {
+    fprintf(vm->output, "Not a snapshot\n");
+    ok = 0;
+  }
+  close(fd);
+  vm->used = 1;
+  return ok;
+}
+/*----- Snapshots -----*/
+
+
+
+#ifndef VM_LIBRARY
+int main(int argc, char* argv[])
+{
+  //volatile where they live across the sigsetjmp() below
+  volatile int mode = TRACE_TEXT;
+  volatile int verified = 1;
+  int memorySize = 500;
+  int maxDepth = 100;
+  volatile int showFinal = 0;
+  volatile int showTiers = 0;
+  int batch = 0;
+  const char* inputPath = NULL;
+  long long instructionLimit = 0;
+  long long timeLimit = 0;
+  const char* savePath = NULL;
+  const char* volatile restorePath = NULL;
+  const char* programPath = "elf.txt";
+  const char* executablePath = NULL;
+  int sized = 0; //-s or -d given, otherwise a snapshot's are used
+  int valid = 1;
+  for(int i=1; i<argc; i+=2)
+  {
+    if(strcmp(argv[i], "-u") == 0)
+    {
+      verified = 0;
+      --i;
+    }
+    else if(strcmp(argv[i], "-f") == 0)
+    {
+      showFinal = 1;
+      --i;
+    }
+    else if(strcmp(argv[i], "-g") == 0)
+    {
+      annotateTrace = 1;
+      --i;
+    }
+    else if(strcmp(argv[i], "-t") == 0)
+    {
+      showTiers = 1;
+      --i;
+    }
+    else if(strcmp(argv[i], "-b") == 0)
+    {
+      batch = 1;
+      --i;
+    }
+    else if(i + 1 == argc)
+      valid = 0;
+    else if(strcmp(argv[i], "-m") == 0)
+    {
+      if(strcmp(argv[i+1], "quiet") == 0) mode = TRACE_NONE;
+      else if(strcmp(argv[i+1], "trace") == 0) mode = TRACE_TEXT;
+      else if(strcmp(argv[i+1], "binary-trace") == 0) mode = TRACE_BINARY;
+      else if(strcmp(argv[i+1], "jit") == 0) mode = JIT;
+      else if(strcmp(argv[i+1], "tiered") == 0) mode = TIERS;
+      else if(strcmp(argv[i+1], "profile") == 0) mode = TRACE_PROFILE;
+      else valid = 0;
+    }
+    else if(strcmp(argv[i], "-s") == 0)
+    {
+      memorySize = atoi(argv[i+1]);
+      sized = 1;
+    }
+    else if(strcmp(argv[i], "-d") == 0)
+    {
+      maxDepth = atoi(argv[i+1]);
+      sized = 1;
+    }
+    else if(strcmp(argv[i], "-l") == 0)
+      loopThreshold = atoi(argv[i+1]);
+    else if(strcmp(argv[i], "-c") == 0)
+      callThreshold = atoi(argv[i+1]);
+    else if(strcmp(argv[i], "-i") == 0)
+      inputPath = argv[i+1];
+    else if(strcmp(argv[i], "-n") == 0)
+      instructionLimit = atoll(argv[i+1]);
+    else if(strcmp(argv[i], "-e") == 0)
+      timeLimit = atoll(argv[i+1]);
+    else if(strcmp(argv[i], "-k") == 0)
+      savePath = argv[i+1];
+    else if(strcmp(argv[i], "-r") == 0)
+      restorePath = argv[i+1];
+    else if(strcmp(argv[i], "-p") == 0)
+      programPath = argv[i+1];
+    else if(strcmp(argv[i], "-w") == 0)
+      executablePath = argv[i+1];
+    else
+      valid = 0;
+  }
+  if(!valid || memorySize < 4 || maxDepth < 1 || instructionLimit < 0 || timeLimit < 0)
+  {
+    printf("Usage: ./vm [-m quiet|trace|binary-trace|jit|tiered|profile] [-s words] [-d calls] [-l loops] [-c calls] [-n instructions] [-e ms] [-k snapshot] [-r snapshot] [-p program] [-w executable] [-u] [-f] [-t] [-g] [-b] [-i input]\n");
+    return 1;
+  }
+  if(restorePath != NULL && mode == TRACE_PROFILE)
+  {
+    printf("-m profile can't start from a snapshot\n");
+    return 1;
+  }
+
+  //the machine the snapshot was saved from, unless told otherwise
+  SnapshotHeader header;
+  int fd = restorePath != NULL && !sized ? open(restorePath, O_RDONLY) : -1;
+  if(fd != -1)
+  {
+    if(readSnapshotHeader(fd, &header) && header.memorySize >= 4 && header.maxDepth >= 1)
+    {
+      memorySize = header.memorySize;
+      maxDepth = header.maxDepth;
+    }
+    close(fd);
+  }
+
+  //before anything is printed, stdout can't change buffers after that
+  static char outputBuffer[1 << 20];
+  if(batch)
+    setvbuf(stdout, outputBuffer, _IOFBF, sizeof(outputBuffer));
+
+  VM* vm = vm_create(memorySize, maxDepth);
+  if(vm == NULL)
+  {
+    printf("Unable to allocate %d words of memory\n", memorySize);
+    return 1;
+  }
+
+  if(inputPath != NULL)
+  {
+    FILE* input = fopen(inputPath, "r");
+    if(input == NULL)
+    {
+      printf("File unable to be opened\n");
+      return 1;
+    }
+    vm_io(vm, input, stdout);
+  }
+  vm_batch(vm, batch);
+  vm_limit(vm, instructionLimit, timeLimit);
+
+  if(restorePath != NULL ? !vm_restore(vm, restorePath) : !vm_load(vm, programPath, verified))
+    return 1;
+
+  if(executablePath != NULL)
+  {
+    loadSourceMap(vm, programPath);
+    if(!writeExecutable(vm, executablePath))
+    {
+      printf("Unable to write %s\n", executablePath);
+      return 1;
+    }
+    return 0;
+  }
+
+  //quiet up to the first READ, which waits on input that never comes, or
+  //to where -n or -e stop it, and saved there
+  if(savePath != NULL)
+  {
+    vm_feed(vm, "", 0);
+    int result = vm_step(vm, LLONG_MAX);
+    if(result != VM_WAITING && result != OUT_OF_FUEL)
+      return result;
+    if(!vm_save(vm, savePath))
+    {
+      printf("Unable to write %s\n", savePath);
+      return 1;
+    }
+    return result == OUT_OF_FUEL ? result : 0;
+  }
+
+  if(mode == TRACE_PROFILE || annotateTrace)
+    loadSourceMap(vm, programPath);
+  if(mode == TRACE_PROFILE && !verified)
+  {
+    printf("-m profile needs verified code\n");
+    return 1;
+  }
+
+  //native code can only start part way through a run where tiers hand over
+  if(mode == JIT && restorePath != NULL)
+    mode = TIERS;
+
+  //a push that ran into a guard page lands here
+  runningVM = vm;
+  if(sigsetjmp(vm->overflowJump, 1))
+  {
+    if(traceFile != NULL)
+    {
+      flushTrace();
+      fclose(traceFile);
+    }
+    return stackOverflow(vm);
+  }
+
+  int result = JIT_UNSUPPORTED;
+  if(mode == JIT && verified)
+    result = jitRun(vm);
+
+  if(result != JIT_UNSUPPORTED)
+    ; //ran natively
+  else if(mode == TRACE_PROFILE)
+  {
+    if(!startProfile(vm))
+    {
+      printf("Unable to allocate the profile\n");
+      return 1;
+    }
+#if !defined(VM_NO_TOS_CACHE)
+    specializeEmptyStack(vm);
+#endif
+    result = runProfile(vm);
+    if(!writeProfile(vm))
+      return 1;
+  }
+  else if(mode == TIERS && verified)
+  {
+    result = runTiered(vm);
+    if(showTiers)
+      fprintf(stderr, "Tiers: interpreter %.3f ms, compile %.3f ms, %s %.3f ms, %d promotions\n",
+              tierTime[TIER_INTERPRETER], tierTime[TIER_COMPILE], optimisedTier, tierTime[TIER_OPTIMISED], promotions);
+  }
+  else if(mode == TRACE_NONE || mode == JIT || mode == TIERS)
+    result = runFastest(vm);
+  else if(mode == TRACE_BINARY)
+  {
+    traceFile = fopen("trace.bin", "wb");
+    if(traceFile == NULL)
+    {
+      printf("File unable to be opened\n");
+      return 1;
+    }
+
+    TraceHeader header = {TRACE_MAGIC, vm->memorySize, vm->PC, vm->BP, vm->SP};
+    fwrite(&header, sizeof(TraceHeader), 1, traceFile);
+
+    result = verified ? runBinaryTrace(vm) : runBinaryTraceChecked(vm);
+    flushTrace();
+    fclose(traceFile);
+  }
+  else
+  {
+    //headers
+    printf("\n\tL\tM    %s   %s   %s   %s\n", "PC", "BP", "SP", "stack");
+    printf("Initial values:\t   %5d%5d%5d\n", vm->PC, vm->BP, vm->SP);
+
+    result = verified ? runTrace(vm) : runTraceChecked(vm);
+  }
+
+  //same registers and stack as the last trace line, for comparing modes
+  if(showFinal && result == 0)
+  {
+    printf("Final values:\t   %5d%5d%5d  ", vm->PC, vm->BP, vm->SP);
+    printStack(vm);
+  }
+
+  return result == STACK_OVERFLOW ? stackOverflow(vm) : result;
+}
+#endif
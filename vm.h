@@ -0,0 +1,137 @@
+/*
+  PM/0 Virtual Machine Library
+
+  The machine of vm.c as a library: each VM holds its own memory, registers,
+  code, and I/O streams, so programs can be loaded and run on any number of
+  them at once, one thread per VM at a time.
+
+  To Compile:
+    gcc -O2 -std=c11 -DVM_LIBRARY -c vm.c
+    (see vmbatch.c for a program using it)
+
+  Notes:
+    - vm_load() reads an elf.txt-format file or maps a binary executable
+      (elf.bin), verifies it unless told not to, and leaves the machine ready
+      to run from the first instruction
+    - vm_run() runs the loaded program quietly from the start, so one load can
+      be run again with different input
+    - SYS READ/PRINT, load errors, and "Stack overflow" go to the streams set
+      with vm_io(), stdin and stdout until then
+    - Batch input, read whole from the stream or given with vm_input_buffer(),
+      is kept across runs: a second vm_run() reads on where the first stopped
+    - vm_limit() stops runaway programs, with VM_OUT_OF_FUEL
+    - vm_save() and vm_restore() snapshot a machine to a file and go on from
+      it later, in another process or in many
+    - Stepping and vm_feed() let one thread interleave many machines, vmserve.c
+      schedules them on the input of pipes and sockets with epoll
+    - vm_instruction() and vm_procedure() give out what the verifier found,
+      so pm0toc.c translates exactly the code vm.c would run unchecked
+*/
+#ifndef VM_H
+#define VM_H
+
+#include <stdio.h>
+
+typedef struct VM VM;
+
+//vm_run() results, the exit status ./vm gives for each
+#define VM_HALTED 0
+#define VM_ERROR 1
+#define VM_STACK_OVERFLOW 2
+//and vm_step()'s for a run that hasn't ended
+#define VM_RUNNING 3 //used up its budget
+#define VM_WAITING 4 //at a READ whose input hasn't been fed yet
+//and either's for a run over a vm_limit()
+#define VM_OUT_OF_FUEL 5
+
+//memory of memorySize words and room for maxDepth active calls, NULL if
+//either is too small or can't be allocated
+VM* vm_create(int memorySize, int maxDepth);
+void vm_destroy(VM* vm);
+
+void vm_io(VM* vm, FILE* input, FILE* output);
+
+//1 once the program at path, text or executable, is loaded, 0 if it can't be
+//read or fails the verifier, which says why on the output stream
+int vm_load(VM* vm, const char* path, int verify);
+
+int vm_run(VM* vm);
+
+//vm_run() from wherever the machine is instead of the start: after a
+//vm_restore(), or to finish a stepped run quietly
+int vm_continue(VM* vm);
+
+//the loaded program from its first instruction, a step at a time: vm_step()
+//runs at most budget instructions from where the last step stopped, and
+//gives the run's result once it has ended, the same one on every call after.
+//vm_load() also leaves the machine ready to step
+void vm_start(VM* vm);
+int vm_step(VM* vm, long long budget);
+
+//appends size bytes of input, data NULL for the end of it. Once input is fed
+//a stepped READ returns VM_WAITING instead of running until its whole integer
+//has arrived, with the prompt printed already. 0 if memory runs out
+int vm_feed(VM* vm, const char* data, size_t size);
+
+//limits on every run from the next vm_run() or vm_start(): instructions
+//(counted at backward jumps and calls, see vm.c's Fuel) and milliseconds of
+//wall time, 0 for none. A run over either stops with VM_OUT_OF_FUEL after
+//printing which limit, PC, SP, and the call depth to the output stream
+void vm_limit(VM* vm, long long instructions, long long milliseconds);
+
+//Snapshots: vm_save() writes all of the machine's state to path whenever it
+//isn't running (after vm_load(), between vm_step()s, or once a run stopped
+//at a vm_limit()), 0 if it can't. vm_restore() loads it, on the same or
+//another process, into a VM of the same memory size and at least its call
+//depth, ready for vm_continue() or vm_step(), or 0 saying why not. Memory is
+//mapped from the file copy on write, so the file must not change while a
+//restored VM is in use. The run's first READ passes over the input the saved
+//run had used, so it expects the same stream from the start (input used by
+//scanf from a pipe can't be counted and isn't passed over)
+int vm_save(VM* vm, const char* path);
+int vm_restore(VM* vm, const char* path);
+
+//batch mode: READ prints no prompt, and the first READ reads all of the
+//input stream into memory and parses it from there. Set a large buffer on
+//the output stream (setvbuf) for PRINT to match
+void vm_batch(VM* vm, int batch);
+
+//batch mode with input from data instead of the input stream, kept by the
+//caller until the VM is done with it or vm_io() replaces it. READs go on from
+//where the last one stopped, across runs
+void vm_input_buffer(VM* vm, const char* data, size_t size);
+
+//vm_run() once per lane, all lanes at once on vectors (see vm_lanes.h): lane
+//i reads inputs[i], prints to outputs[i], and gets its result in results[i].
+//0 if the program wasn't verified, a vm_limit() is set, or the lanes can't be
+//set up, 1 otherwise
+int vm_run_lanes(VM* vm, int lanes, FILE** inputs, FILE** outputs, int* results);
+
+//The loaded program as vm.c's verifier saw it, for tools that translate
+//verified code instead of running it (pm0toc.c)
+typedef struct VMInstruction
+{
+  int op;
+  int l;
+  int m;
+  int procedure; //procedure it belongs to, -1 if unreachable or not verified
+  int height;    //operand stack depth before it, -1 in prologues
+}VMInstruction;
+
+typedef struct VMProcedure
+{
+  int entry;    //code index of the CAL target, 0 for main
+  int parent;   //procedure the static link points at, -1 for main
+  int depth;    //static nesting depth, main is 0
+  int frame;    //words allocated by the INC, links included
+  int maxStack; //deepest the operand stack gets on top of the frame
+}VMProcedure;
+
+//instruction index of the loaded program, 0 past its end
+int vm_instruction(VM* vm, int index, VMInstruction* instruction);
+
+//procedure p of a verified program, main first, 0 past the last or if the
+//program wasn't verified
+int vm_procedure(VM* vm, int p, VMProcedure* procedure);
+
+#endif
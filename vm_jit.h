@@ -0,0 +1,533 @@
+/*
+  x86-64 JIT for vm.c, included once after the interpreter loops.
+
+  Compiles verified code into native code in an mmap'd buffer. Activation
+  records keep their PAS layout, so output and the final stack are the same
+  as the interpreter's, but each procedure is a native function: CAL writes
+  the three link words and does a native call, RTN reloads BP from the
+  dynamic link and returns. The verifier knows the operand stack depth at
+  every instruction, so SP is never kept at run time: the bottom operands
+  live in registers and the rest at fixed offsets from BP, spilled to their
+  PAS words only around calls and HALT. A static chain walk is L inlined
+  loads, and SYS calls back into C.
+
+  Registers while running:
+    r12  PAS
+    r13  BP, as a word index
+    rbx  active calls, checked against maxDepth like topARs
+    r14  RSP around calls into C, which need it 16-byte aligned
+    r15  RSP at entry, to unwind nested calls on HALT or overflow
+    r8-r11, esi, edi  operands 1 to 6 of the current frame
+    eax, ecx, edx     scratch
+
+  Anything jitCompile() can't handle returns JIT_UNSUPPORTED and main()
+  runs the interpreter instead.
+
+  With a vm_limit() set, backward jumps and calls burn fuel in vm->fuel as
+  the interpreter's do and call refuel() when it runs out (see Fuel), without
+  one they compile to the bare jump or call.
+
+  jitEnter() can also start at a loop head or procedure entry of any active
+  record, for -m tiered: the entry stub calls it like a CAL would, so when
+  that record returns the stub hands JIT_RETURNED back to the interpreter.
+*/
+
+#define JIT_UNSUPPORTED -1
+#define JIT_RETURNED -2
+#define JIT_MAX_DEPTH 100000 //8 bytes of native stack per call
+
+#if defined(__x86_64__) && !defined(_WIN32)
+
+unsigned char* jitCode;
+size_t jitCapacity;
+size_t jitLength;
+int* jitOffset; //native offset of each instruction
+
+//rel32 fields waiting for the offset of a later instruction
+int* fixupAt;
+int* fixupTarget;
+int fixupCount;
+
+size_t jitOverflow; //offsets of the shared exit paths
+size_t jitExit;
+
+void emit(int _byte)
+{
+  jitCode[jitLength++] = (unsigned char)_byte;
+}
+
+void emit32(int _value)
+{
+  memcpy(jitCode + jitLength, &_value, 4);
+  jitLength += 4;
+}
+
+void emit64(long long _value)
+{
+  memcpy(jitCode + jitLength, &_value, 8);
+  jitLength += 8;
+}
+
+//rel32 to an offset that is already known
+void emitRelative(size_t _offset)
+{
+  emit32((int)(_offset - (jitLength + 4)));
+}
+
+//rel32 to instruction _index, patched once everything is emitted
+void emitFixup(int _index)
+{
+  fixupAt[fixupCount] = (int)jitLength;
+  fixupTarget[fixupCount++] = _index;
+  emit32(0);
+}
+
+//index register of a PAS operand
+enum JIT_INDEX
+{
+  X_BP,  //[r12 + r13*4 + disp], the current record
+  X_RAX, //[r12 + rax*4 + disp], a record found by walking the static chain
+  X_NONE //[r12 + disp], main's record through GP
+};
+
+//_opcode _reg, dword [PAS + index*4 + _disp], _wide for a 64-bit _reg
+void emitMemory(int _wide, int _opcode, int _reg, int _index, int _disp)
+{
+  emit(0x41 | (_wide ? 0x08 : 0) | ((_reg & 8) ? 0x04 : 0) | (_index == X_BP ? 0x02 : 0));
+  if(_opcode > 0xff)
+    emit(_opcode >> 8);
+  emit(_opcode & 0xff);
+  emit(0x84 | ((_reg & 7) << 3));
+  emit(_index == X_BP ? 0xac : _index == X_RAX ? 0x84 : 0x24);
+  emit32(_disp);
+}
+
+#define JIT_EAX 0
+#define JIT_ECX 1
+#define JIT_ESI 6
+#define JIT_EDI 7
+#define JIT_R13 13
+
+//register holding operand _slot (1 is the bottom), -1 if it stays in PAS
+#define JIT_SLOTS 6
+const int slotRegister[JIT_SLOTS + 1] = {-1, 8, 9, 10, 11, 6, 7};
+
+int jitSlot(int _slot)
+{
+  return _slot <= JIT_SLOTS ? slotRegister[_slot] : -1;
+}
+
+//_opcode _reg, _rm for two registers
+void emitRegisters(int _opcode, int _reg, int _rm)
+{
+  if((_reg | _rm) & 8)
+    emit(0x40 | ((_reg & 8) ? 0x04 : 0) | ((_rm & 8) ? 0x01 : 0));
+  if(_opcode > 0xff)
+    emit(_opcode >> 8);
+  emit(_opcode & 0xff);
+  emit(0xc0 | ((_reg & 7) << 3) | (_rm & 7));
+}
+
+//byte offset from BP of the PAS word for operand _slot
+int slotDisp(const Procedure* _proc, int _slot)
+{
+  return 4*(1 - _proc->frame - _slot);
+}
+
+//_opcode _reg, operand _slot
+void emitSlot(const Procedure* _proc, int _opcode, int _reg, int _slot)
+{
+  if(jitSlot(_slot) >= 0)
+    emitRegisters(_opcode, _reg, jitSlot(_slot));
+  else
+    emitMemory(0, _opcode, _reg, X_BP, slotDisp(_proc, _slot));
+}
+
+//operand _slot = _reg
+void emitStoreSlot(const Procedure* _proc, int _slot, int _reg)
+{
+  if(jitSlot(_slot) >= 0)
+    emitRegisters(0x8b, jitSlot(_slot), _reg);
+  else
+    emitMemory(0, 0x89, _reg, X_BP, slotDisp(_proc, _slot));
+}
+
+//copies operands 1.._count between their registers and PAS words
+void emitSpill(const Procedure* _proc, int _count, int _reload)
+{
+  for(int k=1; k<=_count && k<=JIT_SLOTS; ++k)
+    emitMemory(0, _reload ? 0x8b : 0x89, slotRegister[k], X_BP, slotDisp(_proc, k));
+}
+
+//index register and displacement of variable _m, _levels down the static chain
+int emitFrame(int _levels, int _m, int* _disp)
+{
+  *_disp = -4*_m;
+  if(_levels == 0)
+    return X_BP;
+
+  emit(0x4c); emit(0x89); emit(0xe8); //mov rax, r13
+  while(_levels-- > 0)
+    emitMemory(1, 0x63, JIT_EAX, X_RAX, 0); //movsxd rax, [PAS + rax*4]
+  return X_RAX;
+}
+
+//call a C function with RSP aligned, r12-r15 and rbx survive it
+void emitCallC(void* _function)
+{
+  emit(0x49); emit(0x89); emit(0xe6); //mov r14, rsp
+  emit(0x48); emit(0x83); emit(0xe4); emit(0xf0); //and rsp, -16
+  emit(0x48); emit(0xb8); emit64((long long)_function); //mov rax, _function
+  emit(0xff); emit(0xd0); //call rax
+  emit(0x4c); emit(0x89); emit(0xf4); //mov rsp, r14
+}
+
+void jitPrint(VM* vm, int _value)
+{
+  writeOutput(vm, _value);
+}
+
+int jitRead(VM* vm)
+{
+  return readInput(vm);
+}
+
+//mov rdi, vm: the machine is known at compile time, so SYS passes it as a constant
+void emitMachine(VM* vm)
+{
+  emit(0x48); emit(0xbf); emit64((long long)vm);
+}
+
+//PC, SP, and BP where the interpreter would have them at code[_index] with
+//_height operands, which must be spilled already
+void emitSaveRegisters(VM* vm, const Procedure* _proc, int _index, int _height)
+{
+  emit(0x48); emit(0xb9); emit64((long long)&vm->PC); //mov rcx, &PC
+  emit(0xc7); emit(0x01); emit32(CODE_ADDRESS(_index)); //mov dword [rcx], PC
+  emit(0x41); emit(0x8d); emit(0x85); emit32(slotDisp(_proc, _height)/4); //lea eax, [r13 + SP - BP]
+  emit(0x48); emit(0xb9); emit64((long long)&vm->SP);
+  emit(0x89); emit(0x01); //mov [rcx], eax
+  emit(0x48); emit(0xb9); emit64((long long)&vm->BP);
+  emit(0x44); emit(0x89); emit(0x29); //mov [rcx], r13d
+}
+
+//refuel() with the call depth native code keeps in rbx, which only becomes
+//topARs if the run stops here
+int jitRefuel(VM* vm, int _calls)
+{
+  int saved = vm->topARs;
+  vm->topARs = _calls;
+  int result = refuel(vm);
+  if(result == 0)
+    vm->topARs = saved;
+  return result;
+}
+
+//burns _charge fuel at code[_index] with _height operands, see Fuel. Only
+//emitted while a vm_limit() is set, running out leaves through jitExit
+void emitBurn(VM* vm, const Procedure* _proc, int _index, int _height, int _charge)
+{
+  if(vm->instructionLimit == 0 && vm->timeLimit == 0)
+    return;
+
+  emit(0x48); emit(0xb9); emit64((long long)&vm->fuel); //mov rcx, &fuel
+  emit(0x48); emit(0x81); emit(0x29); emit32(_charge); //sub qword [rcx], charge
+  emit(0x0f); emit(0x8f); //jg past the refuel
+  size_t skip = jitLength;
+  emit32(0);
+
+  emitSpill(_proc, _height, 0);
+  emitSaveRegisters(vm, _proc, _index, _height);
+  emit(0x89); emit(0xde); //mov esi, ebx
+  emitMachine(vm);
+  emitCallC(jitRefuel);
+  emit(0x85); emit(0xc0); //test eax, eax
+  emit(0x0f); emit(0x85); emitRelative(jitExit); //jnz exit
+  emitSpill(_proc, _height, 1);
+
+  int rel = (int)(jitLength - (skip + 4));
+  memcpy(jitCode + skip, &rel, 4);
+}
+
+//translates code[_index], 0 if it can't
+int jitInstruction(VM* vm, int _index)
+{
+  const Decoded* d = &vm->code[_index];
+  const Procedure* proc = &vm->procedures[vm->owner[_index]];
+  int h = vm->height[_index];
+
+  //operand slots of the top, the one under it, and a new push
+  int top = h;
+  int second = h - 1;
+  int push = h + 1;
+  int index, disp;
+
+  switch(d->op)
+  {
+    case LIT:
+      if(jitSlot(push) >= 0)
+      {
+        if(jitSlot(push) & 8)
+          emit(0x41);
+        emit(0xb8 + (jitSlot(push) & 7)); //mov reg, M
+      }
+      else
+        emitMemory(0, 0xc7, 0, X_BP, slotDisp(proc, push)); //mov dword [push], M
+      emit32(d->m);
+      return 1;
+
+    case LOD: case LDL: case LDG:
+      if(d->op == LDG)
+      {
+        index = X_NONE;
+        disp = 4*(vm->GP - d->m);
+      }
+      else
+        index = emitFrame(d->op == LOD ? d->l : 0, d->m, &disp);
+      emitMemory(0, 0x8b, JIT_ECX, index, disp);
+      emitStoreSlot(proc, push, JIT_ECX);
+      return 1;
+
+    case STO: case STL: case STG:
+      if(d->op == STG)
+      {
+        index = X_NONE;
+        disp = 4*(vm->GP - d->m);
+      }
+      else
+        index = emitFrame(d->op == STO ? d->l : 0, d->m, &disp);
+      emitSlot(proc, 0x8b, JIT_ECX, top);
+      emitMemory(0, 0x89, JIT_ECX, index, disp);
+      return 1;
+
+    case CAL:
+      emitBurn(vm, proc, _index, h, 1);
+      emit(0x81); emit(0xfb); emit32(vm->maxDepth); //cmp ebx, maxDepth
+      emit(0x0f); emit(0x8d); emitRelative(jitOverflow); //jge overflow
+      emitSpill(proc, h, 0); //the callee reuses the registers
+      disp = slotDisp(proc, push);
+      if(d->l == 0)
+      {
+        emit(0x44); emit(0x89); emit(0xe9); //mov ecx, r13d
+      }
+      else
+      {
+        emitFrame(d->l, 0, &index);
+        emit(0x89); emit(0xc1); //mov ecx, eax
+      }
+      emitMemory(0, 0x89, JIT_ECX, X_BP, disp); //static link
+      emitMemory(0, 0x89, JIT_R13, X_BP, disp - 4); //dynamic link
+      emitMemory(0, 0xc7, 0, X_BP, disp - 8); //return address
+      emit32(CODE_ADDRESS(_index + 1));
+      emit(0xff); emit(0xc3); //inc ebx
+      emit(0x49); emit(0x81); emit(0xc5); emit32(disp/4); //add r13, push
+      emit(0xe8); emitFixup(jumpTarget(vm, d->m)); //call
+      emit(0xff); emit(0xcb); //dec ebx
+      emitSpill(proc, h, 1);
+      return 1;
+
+    case INC:
+      //the verifier's bound on the whole frame, as in the interpreter
+      emit(0x49); emit(0x81); emit(0xfd); emit32(proc->frame + proc->maxStack + 3 - 1); //cmp r13, ...
+      emit(0x0f); emit(0x8c); emitRelative(jitOverflow); //jl overflow
+      return 1;
+
+    case JMP:
+      if(jumpTarget(vm, d->m) <= _index)
+        emitBurn(vm, proc, _index, h, _index - jumpTarget(vm, d->m) + 1);
+      emit(0xe9); emitFixup(jumpTarget(vm, d->m));
+      return 1;
+
+    case JPC:
+      emitSlot(proc, 0x8b, JIT_EAX, top);
+      emit(0x85); emit(0xc0); //test eax, eax
+      if(jumpTarget(vm, d->m) <= _index && (vm->instructionLimit > 0 || vm->timeLimit > 0))
+      {
+        //a backward branch burns fuel only when taken
+        emit(0x0f); emit(0x85); //jnz past it
+        size_t skip = jitLength;
+        emit32(0);
+        emitBurn(vm, proc, _index, h, _index - jumpTarget(vm, d->m) + 1);
+        emit(0xe9); emitFixup(jumpTarget(vm, d->m));
+        int rel = (int)(jitLength - (skip + 4));
+        memcpy(jitCode + skip, &rel, 4);
+      }
+      else
+      {
+        emit(0x0f); emit(0x84); emitFixup(jumpTarget(vm, d->m)); //jz
+      }
+      return 1;
+
+    case SYS:
+      if(d->m == PRINT)
+      {
+        //C may clobber every operand register
+        emitSlot(proc, 0x8b, JIT_EAX, top);
+        emitSpill(proc, h - 1, 0);
+        emitRegisters(0x8b, JIT_ESI, JIT_EAX);
+        emitMachine(vm);
+        emitCallC(jitPrint);
+        emitSpill(proc, h - 1, 1);
+      }
+      else if(d->m == READ)
+      {
+        emitSpill(proc, h, 0);
+        emitMachine(vm);
+        emitCallC(jitRead);
+        emitSpill(proc, h, 1);
+        emitStoreSlot(proc, push, JIT_EAX);
+      }
+      else
+      {
+        //leave the stack and registers where the interpreter would
+        emitSpill(proc, h, 0);
+        emitSaveRegisters(vm, proc, _index + 1, top);
+        emit(0x31); emit(0xc0); //xor eax, eax
+        emit(0xe9); emitRelative(jitExit);
+      }
+      return 1;
+
+    case OPR:
+      break;
+
+    default:
+      return 0;
+  }
+
+  switch(d->m)
+  {
+    case RTN:
+      emitMemory(1, 0x63, JIT_R13, X_BP, -4); //movsxd r13, dynamic link
+      emit(0xc3); //ret
+      return 1;
+
+    case ADD: case SUB: case MUL:
+      emitSlot(proc, 0x8b, JIT_EAX, second);
+      emitSlot(proc, d->m == ADD ? 0x03 : d->m == SUB ? 0x2b : 0x0faf, JIT_EAX, top);
+      emitStoreSlot(proc, second, JIT_EAX);
+      return 1;
+
+    case DIV:
+      emitSlot(proc, 0x8b, JIT_EAX, second);
+      emit(0x99); //cdq
+      emitSlot(proc, 0xf7, 7, top); //idiv top
+      emitStoreSlot(proc, second, JIT_EAX);
+      return 1;
+
+    case EQL: case NEQ: case LSS: case LEQ: case GTR: case GEQ:
+    {
+      static const int setcc[] = {0x94, 0x95, 0x9c, 0x9e, 0x9f, 0x9d};
+      emitSlot(proc, 0x8b, JIT_EAX, second);
+      emitSlot(proc, 0x3b, JIT_EAX, top); //cmp eax, top
+      emit(0x0f); emit(setcc[d->m - EQL]); emit(0xc0); //setcc al
+      emit(0x0f); emit(0xb6); emit(0xc0); //movzx eax, al
+      emitStoreSlot(proc, second, JIT_EAX);
+      return 1;
+    }
+
+    case EVEN:
+      emitSlot(proc, 0x8b, JIT_EAX, top);
+      emit(0xf7); emit(0xd0); //not eax
+      emit(0x83); emit(0xe0); emit(0x01); //and eax, 1
+      emitStoreSlot(proc, top, JIT_EAX);
+      return 1;
+
+    case DUP:
+      emitSlot(proc, 0x8b, JIT_EAX, top);
+      emitStoreSlot(proc, push, JIT_EAX);
+      return 1;
+  }
+  return 0;
+}
+
+//entry(PAS, BP, code, calls) runs code until HALT (0), STACK_OVERFLOW, or the
+//record BP returns (JIT_RETURNED)
+typedef int (*JitEntry)(int*, long, void*, int);
+
+int jitCompile(VM* vm)
+{
+  if(vm->maxDepth > JIT_MAX_DEPTH)
+    return 0;
+
+  //worst case per instruction is a CAL spilling every operand register
+  //or a LOD walking L links, plus a fuel check's refuel with a vm_limit()
+  jitCapacity = 128;
+  for(int i=0; i<vm->codeLength; ++i)
+    jitCapacity += 96 + 16*JIT_SLOTS + 8*(vm->code[i].l > 0 ? vm->code[i].l : 0) + 240;
+
+  jitCode = mmap(NULL, jitCapacity, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  jitOffset = malloc(vm->codeLength*sizeof(int));
+  fixupAt = malloc(vm->codeLength*sizeof(int));
+  fixupTarget = malloc(vm->codeLength*sizeof(int));
+  if(jitCode == MAP_FAILED || jitOffset == NULL || fixupAt == NULL || fixupTarget == NULL)
+    return 0;
+
+  //entry: save callee-saved registers, r12 = PAS, r13 = BP, rbx = active calls
+  emit(0x53); emit(0x41); emit(0x54); emit(0x41); emit(0x55); emit(0x41); emit(0x56); emit(0x41); emit(0x57);
+  emit(0x49); emit(0x89); emit(0xfc); //mov r12, rdi
+  emit(0x49); emit(0x89); emit(0xf5); //mov r13, rsi
+  emit(0x89); emit(0xcb); //mov ebx, ecx
+  emit(0x49); emit(0x89); emit(0xe7); //mov r15, rsp
+  emit(0xff); emit(0xd2); //call rdx
+  emit(0xb8); emit32(JIT_RETURNED); //mov eax, JIT_RETURNED
+
+  jitExit = jitLength;
+  emit(0x4c); emit(0x89); emit(0xfc); //mov rsp, r15
+  emit(0x41); emit(0x5f); emit(0x41); emit(0x5e); emit(0x41); emit(0x5d); emit(0x41); emit(0x5c); emit(0x5b);
+  emit(0xc3);
+
+  jitOverflow = jitLength;
+  emit(0xb8); emit32(STACK_OVERFLOW); //mov eax, STACK_OVERFLOW
+  emit(0xe9); emitRelative(jitExit);
+
+  for(int i=0; i<vm->codeLength; ++i)
+  {
+    jitOffset[i] = (int)jitLength;
+    if(vm->owner[i] == -1) //never reached
+      continue;
+    if(!jitInstruction(vm, i))
+      return 0;
+  }
+
+  for(int f=0; f<fixupCount; ++f)
+  {
+    int rel = jitOffset[fixupTarget[f]] - (fixupAt[f] + 4);
+    memcpy(jitCode + fixupAt[f], &rel, 4);
+  }
+
+  return mprotect(jitCode, jitCapacity, PROT_READ | PROT_EXEC) == 0;
+}
+
+//runs compiled code from code[_index] in the record at BP, with topARs calls active
+int jitEnter(VM* vm, int _index)
+{
+  JitEntry entry = (JitEntry)(void*)jitCode;
+  return entry(vm->PAS, vm->BP, jitCode + jitOffset[_index], vm->topARs);
+}
+
+//runs verified code natively, JIT_UNSUPPORTED if it couldn't be compiled
+int jitRun(VM* vm)
+{
+  if(!jitCompile(vm))
+    return JIT_UNSUPPORTED;
+  return jitEnter(vm, 0);
+}
+
+#else
+
+int jitCompile(VM* vm)
+{
+  return 0;
+}
+
+int jitEnter(VM* vm, int _index)
+{
+  return JIT_UNSUPPORTED;
+}
+
+int jitRun(VM* vm)
+{
+  return JIT_UNSUPPORTED;
+}
+
+#endif
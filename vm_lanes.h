@@ -0,0 +1,507 @@
+/*
+  Lockstep execution for vm.c, included once after the interpreter loops.
+
+  Runs one verified program once per lane, with every lane reading its own
+  input, as a single pass over the instructions: lanes at the same
+  instruction in the same activation record form a group, and each
+  instruction runs for the whole group at once. Memory is struct of arrays,
+  word a of lane i is memory[a*stride + i], so a group's operands are one
+  row of vectors and LIT, loads, stores, and arithmetic are vector
+  operations with the lanes outside the group masked off. Built for AVX2
+  when the CPU has it (8 lanes per vector), narrower vectors otherwise.
+
+  A JPC that splits its group sends each lane its own way, and the group
+  that runs is always the lanes in the deepest record at the lowest
+  instruction. PL/0 code is structured, so the lanes that went ahead wait at
+  the end of the if or loop until the rest catch up and the group runs whole
+  again. Waiting lanes don't move, so a group only stops to regroup once it
+  reaches or passes the first of them. CAL, RTN, SYS, DIV, and loads and
+  stores through the static chain go lane by lane.
+*/
+
+#define LANE_RUNNING -1 //status of a lane that hasn't stopped
+
+#if defined(__GNUC__)
+
+#define LANE_WIDTH 8 //ints per vector
+typedef int LaneVector __attribute__((vector_size(LANE_WIDTH*sizeof(int))));
+typedef double LaneDoubles __attribute__((vector_size(LANE_WIDTH*sizeof(double))));
+
+//GCC picks the AVX2 copy of the loop at load time when the CPU has it
+#if defined(__x86_64__) && defined(__linux__) && !defined(__clang__)
+#define LANES_TARGET __attribute__((target_clones("avx2", "default")))
+#else
+#define LANES_TARGET
+#endif
+
+typedef struct Lanes
+{
+  int count;
+  int stride;  //count rounded up to a whole vector
+  int* memory; //memorySize rows of stride words
+  int* handler; //decodeHandler() of each instruction, code[].handler may be rewritten
+
+  //registers of each lane, pc as a code index
+  int* pc;
+  int* sp;
+  int* bp;
+  int* depth;
+  int* topARs;
+  int* display; //maxDepth + 1 words per lane, and the same for the two below
+  int* savedDisplay;
+  int* savedDepth;
+  int* status;
+
+  //the running group
+  LaneVector* mask; //-1 in its lanes, 0 elsewhere
+  int* members;
+  int memberCount;
+  int firstChunk; //vectors holding any of its lanes
+  int lastChunk;
+  int running; //lanes still running, in the group or not
+  int waitBp; //record and instruction of the first lane waiting outside the group
+  int waitPc;
+}Lanes;
+
+void freeLanes(Lanes* _ln)
+{
+  free(_ln->memory);
+  free(_ln->handler);
+  free(_ln->pc);
+  free(_ln->sp);
+  free(_ln->bp);
+  free(_ln->depth);
+  free(_ln->topARs);
+  free(_ln->display);
+  free(_ln->savedDisplay);
+  free(_ln->savedDepth);
+  free(_ln->status);
+  free(_ln->mask);
+  free(_ln->members);
+}
+
+//every lane at the first instruction of a reset machine
+int allocateLanes(VM* vm, Lanes* _ln, int _count)
+{
+  memset(_ln, 0, sizeof(Lanes));
+  _ln->count = _count;
+  _ln->stride = (_count + LANE_WIDTH - 1) / LANE_WIDTH * LANE_WIDTH;
+
+  size_t rowBytes = _ln->stride*sizeof(int);
+  _ln->memory = aligned_alloc(sizeof(LaneVector), vm->memorySize*rowBytes);
+  _ln->mask = aligned_alloc(sizeof(LaneVector), rowBytes);
+  _ln->handler = malloc((vm->codeLength + 1)*sizeof(int));
+  _ln->pc = malloc(_count*sizeof(int));
+  _ln->sp = malloc(_count*sizeof(int));
+  _ln->bp = malloc(_count*sizeof(int));
+  _ln->depth = calloc(_count, sizeof(int));
+  _ln->topARs = calloc(_count, sizeof(int));
+  _ln->display = calloc((size_t)_count*(vm->maxDepth + 1), sizeof(int));
+  _ln->savedDisplay = calloc((size_t)_count*(vm->maxDepth + 1), sizeof(int));
+  _ln->savedDepth = calloc((size_t)_count*(vm->maxDepth + 1), sizeof(int));
+  _ln->status = malloc(_count*sizeof(int));
+  _ln->members = malloc(_count*sizeof(int));
+  if(_ln->memory == NULL || _ln->mask == NULL || _ln->handler == NULL ||
+     _ln->pc == NULL || _ln->sp == NULL || _ln->bp == NULL || _ln->depth == NULL || _ln->topARs == NULL ||
+     _ln->display == NULL || _ln->savedDisplay == NULL || _ln->savedDepth == NULL ||
+     _ln->status == NULL || _ln->members == NULL)
+    return 0;
+  memset(_ln->memory, 0, vm->memorySize*rowBytes);
+
+  for(int i=0; i<vm->codeLength; ++i)
+    _ln->handler[i] = decodeHandler(vm->code[i].op, vm->code[i].m);
+  _ln->handler[vm->codeLength] = H_ILLEGAL;
+
+  for(int i=0; i<_count; ++i)
+  {
+    _ln->pc[i] = 0;
+    _ln->bp[i] = vm->GP;
+    _ln->sp[i] = vm->GP + 1;
+    _ln->display[i*(vm->maxDepth + 1)] = vm->GP;
+    _ln->status[i] = LANE_RUNNING;
+  }
+  return 1;
+}
+
+//the lanes in the deepest record at the lowest instruction, 0 once all have stopped
+int gatherGroup(Lanes* _ln)
+{
+  int best = -1;
+  _ln->running = 0;
+  for(int i=0; i<_ln->count; ++i)
+  {
+    if(_ln->status[i] != LANE_RUNNING)
+      continue;
+    ++_ln->running;
+    if(best == -1 || _ln->bp[i] < _ln->bp[best] || (_ln->bp[i] == _ln->bp[best] && _ln->pc[i] < _ln->pc[best]))
+      best = i;
+  }
+
+  int* mask = (int*)_ln->mask;
+  memset(mask, 0, _ln->stride*sizeof(int));
+  _ln->memberCount = 0;
+  if(best == -1)
+    return 0;
+
+  _ln->waitBp = INT_MAX;
+  _ln->waitPc = INT_MAX;
+  for(int i=best; i<_ln->count; ++i)
+  {
+    if(_ln->status[i] != LANE_RUNNING)
+      continue;
+    if(_ln->bp[i] == _ln->bp[best] && _ln->pc[i] == _ln->pc[best])
+    {
+      _ln->members[_ln->memberCount++] = i;
+      mask[i] = -1;
+    }
+    else if(_ln->bp[i] < _ln->waitBp || (_ln->bp[i] == _ln->waitBp && _ln->pc[i] < _ln->waitPc))
+    {
+      _ln->waitBp = _ln->bp[i];
+      _ln->waitPc = _ln->pc[i];
+    }
+  }
+  for(int i=0; i<best; ++i)
+  {
+    if(_ln->status[i] == LANE_RUNNING && (_ln->bp[i] < _ln->waitBp || (_ln->bp[i] == _ln->waitBp && _ln->pc[i] < _ln->waitPc)))
+    {
+      _ln->waitBp = _ln->bp[i];
+      _ln->waitPc = _ln->pc[i];
+    }
+  }
+  _ln->firstChunk = best / LANE_WIDTH;
+  _ln->lastChunk = _ln->members[_ln->memberCount - 1] / LANE_WIDTH;
+  return _ln->memberCount;
+}
+
+void laneOverflow(VM* vm, Lanes* _ln, int _lane, FILE* _output)
+{
+  _ln->status[_lane] = STACK_OVERFLOW;
+  fprintf(_output, "Stack overflow (memory %d words, call depth %d)\n", vm->memorySize, vm->maxDepth);
+}
+
+LANES_TARGET
+void runLanes(VM* vm, Lanes* _ln, FILE** _inputs, FILE** _outputs)
+{
+  const Decoded* const code = vm->code;
+  int* const memory = _ln->memory;
+  const LaneVector* const mask = _ln->mask;
+  const int* const members = _ln->members;
+  const size_t stride = _ln->stride;
+  const int frames = vm->maxDepth + 1; //display words per lane
+  const int GP = vm->GP;
+
+#define ROW(a) ((LaneVector*)(memory + (a)*stride))
+#define WORD(a, lane) memory[(a)*stride + (lane)]
+#define SPLAT(value) ((LaneVector){0} + (value))
+//every vector of the group, c is the vector
+#define EACH_CHUNK for(int c = firstChunk; c <= lastChunk; ++c)
+//row[c] = value in the group's lanes only
+#define BLEND(row, value) do { LaneVector v_ = (value); (row)[c] = (v_ & mask[c]) | ((row)[c] & ~mask[c]); } while(0)
+//every lane of the group, i is the lane
+#define EACH_MEMBER for(int k = 0, i = members[0]; k < n; i = members[++k < n ? k : 0])
+//x/y truncated, as doubles: for 32-bit ints the rounded quotient is always
+//closer than 1/y to the real one, so truncating it gives the int quotient.
+//Lanes outside the group divide by 1 instead of whatever is there
+#define DIVIDE(x, y) __builtin_convertvector(__builtin_convertvector(x, LaneDoubles) / \
+                                             __builtin_convertvector((y) + (((y) == 0) & 1), LaneDoubles), LaneVector)
+//sum of the lanes of v
+#define LANE_SUM(v) ({ int s_ = 0; for(int e_ = 0; e_ < LANE_WIDTH; ++e_) s_ += (v)[e_]; s_; })
+#define BINARY(expr) do { LaneVector* a = ROW(sp + 1); const LaneVector* b = ROW(sp); EACH_CHUNK BLEND(a, expr); ++sp; goto next; } while(0)
+
+  while(gatherGroup(_ln))
+  {
+    const int n = _ln->memberCount;
+    const int waitBp = _ln->waitBp, waitPc = _ln->waitPc;
+    const int firstChunk = _ln->firstChunk, lastChunk = _ln->lastChunk;
+    int pc = _ln->pc[members[0]];
+    int sp = _ln->sp[members[0]];
+    int bp = _ln->bp[members[0]];
+
+    for(;;)
+    {
+      const Decoded* ir = code + pc;
+      switch(_ln->handler[pc])
+      {
+        case H_LIT:
+        {
+          LaneVector* to = ROW(sp - 1);
+          EACH_CHUNK BLEND(to, SPLAT(ir->m));
+          --sp;
+          goto next;
+        }
+
+        case H_LOD: //the record is bp when L is 0, as for LDL
+          if(ir->l != 0)
+          {
+            EACH_MEMBER WORD(sp - 1, i) = WORD(_ln->display[i*frames + _ln->depth[i] - ir->l] - ir->m, i);
+            --sp;
+            goto next;
+          }
+          //fall through
+        case H_LDL:
+        {
+          LaneVector* to = ROW(sp - 1);
+          const LaneVector* from = ROW(bp - ir->m);
+          EACH_CHUNK BLEND(to, from[c]);
+          --sp;
+          goto next;
+        }
+
+        case H_LDG:
+        {
+          LaneVector* to = ROW(sp - 1);
+          const LaneVector* from = ROW(GP - ir->m);
+          EACH_CHUNK BLEND(to, from[c]);
+          --sp;
+          goto next;
+        }
+
+        case H_STO:
+          if(ir->l != 0)
+          {
+            EACH_MEMBER WORD(_ln->display[i*frames + _ln->depth[i] - ir->l] - ir->m, i) = WORD(sp, i);
+            ++sp;
+            goto next;
+          }
+          //fall through
+        case H_STL:
+        {
+          LaneVector* to = ROW(bp - ir->m);
+          const LaneVector* from = ROW(sp);
+          EACH_CHUNK BLEND(to, from[c]);
+          ++sp;
+          goto next;
+        }
+
+        case H_STG:
+        {
+          LaneVector* to = ROW(GP - ir->m);
+          const LaneVector* from = ROW(sp);
+          EACH_CHUNK BLEND(to, from[c]);
+          ++sp;
+          goto next;
+        }
+
+        case H_ADD: BINARY(a[c] + b[c]);
+        case H_SUB: BINARY(a[c] - b[c]);
+        case H_MUL: BINARY(a[c] * b[c]);
+        case H_EQL: BINARY(-(a[c] == b[c])); //comparisons give -1 for true
+        case H_NEQ: BINARY(-(a[c] != b[c]));
+        case H_LSS: BINARY(-(a[c] < b[c]));
+        case H_LEQ: BINARY(-(a[c] <= b[c]));
+        case H_GTR: BINARY(-(a[c] > b[c]));
+        case H_GEQ: BINARY(-(a[c] >= b[c]));
+
+        case H_DIV:
+        {
+          const LaneVector* b = ROW(sp);
+          LaneVector zeros = {0};
+          EACH_CHUNK zeros -= (b[c] == 0) & mask[c];
+          if(LANE_SUM(zeros) == 0)
+            BINARY(DIVIDE(a[c], b[c]));
+
+          //a lane dividing by zero stops instead of taking the batch with it
+          int failed = 0;
+          EACH_MEMBER
+          {
+            if(WORD(sp, i) == 0)
+            {
+              _ln->status[i] = VM_ERROR;
+              failed = 1;
+            }
+            else
+              WORD(sp + 1, i) /= WORD(sp, i);
+          }
+          ++sp;
+          if(failed)
+          {
+            ++pc;
+            goto leave;
+          }
+          goto next;
+        }
+
+        case H_EVEN:
+        {
+          LaneVector* top = ROW(sp);
+          EACH_CHUNK BLEND(top, -((top[c] & 1) == 0));
+          goto next;
+        }
+
+        case H_DUP:
+        {
+          LaneVector* to = ROW(sp - 1);
+          const LaneVector* from = ROW(sp);
+          EACH_CHUNK BLEND(to, from[c]);
+          --sp;
+          goto next;
+        }
+
+        case H_JMP:
+          pc = ir->jump - code;
+          goto jumped;
+
+        case H_JPC:
+        {
+          const LaneVector* top = ROW(sp);
+          LaneVector zeros = {0};
+          EACH_CHUNK zeros -= (top[c] == 0) & mask[c];
+          int taken = LANE_SUM(zeros);
+          ++sp;
+          if(taken == 0)
+            goto next;
+          if(taken == n)
+          {
+            pc = ir->jump - code;
+            goto jumped;
+          }
+
+          //the group splits, each lane goes its own way until they meet again
+          EACH_MEMBER
+          {
+            _ln->pc[i] = WORD(sp - 1, i) == 0 ? ir->jump - code : pc + 1;
+            _ln->sp[i] = sp;
+            _ln->bp[i] = bp;
+          }
+          goto regroup;
+        }
+
+        case H_CAL:
+        {
+          int overflowed = 0;
+          EACH_MEMBER
+          {
+            if(_ln->topARs[i] == vm->maxDepth)
+            {
+              laneOverflow(vm, _ln, i, _outputs[i]);
+              overflowed = 1;
+              continue;
+            }
+
+            int* display = _ln->display + i*frames;
+            int depth = _ln->depth[i];
+            WORD(sp - 1, i) = display[depth - ir->l];
+            WORD(sp - 2, i) = bp;
+            WORD(sp - 3, i) = CODE_ADDRESS(pc + 1);
+
+            int calleeDepth = depth - ir->l + 1;
+            _ln->savedDisplay[i*frames + _ln->topARs[i]] = display[calleeDepth];
+            _ln->savedDepth[i*frames + _ln->topARs[i]] = depth;
+            display[calleeDepth] = sp - 1;
+            _ln->depth[i] = calleeDepth;
+            _ln->topARs[i]++;
+          }
+          bp = sp - 1;
+          pc = ir->jump - code;
+          if(overflowed)
+            goto leave;
+          goto jumped;
+        }
+
+        case H_RTN:
+        {
+          //lanes in the same record can still have been called from different places
+          int together = 1;
+          EACH_MEMBER
+          {
+            _ln->sp[i] = bp + 1;
+            _ln->bp[i] = WORD(bp - 1, i);
+            _ln->pc[i] = CODE_INDEX(WORD(bp - 2, i));
+            --_ln->topARs[i];
+            _ln->display[i*frames + _ln->depth[i]] = _ln->savedDisplay[i*frames + _ln->topARs[i]];
+            _ln->depth[i] = _ln->savedDepth[i*frames + _ln->topARs[i]];
+            together &= _ln->bp[i] == _ln->bp[members[0]] && _ln->pc[i] == _ln->pc[members[0]];
+          }
+          if(!together)
+            goto regroup;
+          sp = bp + 1;
+          bp = _ln->bp[members[0]];
+          pc = _ln->pc[members[0]];
+          goto jumped;
+        }
+
+        case H_INC:
+          sp -= ir->m;
+          if(sp - ir->reserve < 0) //see runQuiet
+          {
+            EACH_MEMBER laneOverflow(vm, _ln, i, _outputs[i]);
+            goto regroup;
+          }
+          goto next;
+
+        case H_READ:
+          EACH_MEMBER
+          {
+            if(!vm->batch)
+              fprintf(_outputs[i], "Please Enter an Integer: ");
+            int input = 0;
+            fscanf(_inputs[i], "%d", &input);
+            WORD(sp - 1, i) = input;
+          }
+          --sp;
+          goto next;
+
+        case H_PRINT:
+          EACH_MEMBER fprintf(_outputs[i], "Output result is: %d\n", WORD(sp, i));
+          ++sp;
+          goto next;
+
+        case H_HALT:
+          EACH_MEMBER _ln->status[i] = VM_HALTED;
+          goto regroup;
+
+        default: //verified code has nothing else
+          EACH_MEMBER _ln->status[i] = VM_ERROR;
+          goto regroup;
+      }
+
+    next:
+      ++pc;
+    jumped:
+      //another group is now first, or this one caught up with it
+      if(bp > waitBp || (bp == waitBp && pc >= waitPc))
+        goto leave;
+    }
+
+  leave:
+    EACH_MEMBER
+    {
+      _ln->pc[i] = pc;
+      _ln->sp[i] = sp;
+      _ln->bp[i] = bp;
+    }
+  regroup:;
+  }
+
+#undef ROW
+#undef WORD
+#undef SPLAT
+#undef EACH_CHUNK
+#undef BLEND
+#undef EACH_MEMBER
+#undef DIVIDE
+#undef LANE_SUM
+#undef BINARY
+}
+
+int runLockstep(VM* vm, int _count, FILE** _inputs, FILE** _outputs, int* _results)
+{
+  Lanes ln;
+  int allocated = allocateLanes(vm, &ln, _count);
+  if(allocated)
+  {
+    runLanes(vm, &ln, _inputs, _outputs);
+    memcpy(_results, ln.status, _count*sizeof(int));
+  }
+  freeLanes(&ln);
+  return allocated;
+}
+
+#else
+
+int runLockstep(VM* vm, int _count, FILE** _inputs, FILE** _outputs, int* _results)
+{
+  return 0; //needs vector extensions
+}
+
+#endif
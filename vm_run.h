@@ -0,0 +1,541 @@
+/*
+  Interpreter loop of vm.c, included once per execution mode so that each
+  mode gets its own copy of the loop and quiet runs carry no tracing code.
+
+  Before including, define:
+    RUN_FUNCTION  name of the generated function, int RUN_FUNCTION(VM* vm)
+    TRACE_MODE    TRACE_NONE, TRACE_TEXT, TRACE_BINARY, or TRACE_PROFILE (verified only)
+    VERIFIED      1 if verify() accepted the code, which drops the static chain
+                  and return address checks, 0 to run anything
+    CACHE_TOS     1 to keep the top of the operand stack in a local, only for
+                  verified quiet and profile runs since the traces read the
+                  stack from PAS
+    TIERED        1 to count arrivals at loop heads and procedure entries and
+                  return TIER_UP at a hot one (see Tiered Execution)
+    STEPPED       1 to return VM_RUNNING after vm->budget instructions, and
+                  VM_WAITING at a READ whose input hasn't arrived (see vm_step)
+
+  The loop starts at PC, so a run can resume where another tier stopped.
+*/
+
+int RUN_FUNCTION(VM* vm)
+{
+  //none of these move during a run, as locals they can stay in registers
+  int* const PAS = vm->PAS;
+  Decoded* const code = vm->code;
+  int* const display = vm->display;
+  const int GP = vm->GP;
+
+#ifdef VM_THREADED_DISPATCH
+  static void* labels[HANDLER_COUNT] = {
+    [H_ILLEGAL] = &&L_H_ILLEGAL, [H_LIT] = &&L_H_LIT, [H_LOD] = &&L_H_LOD, [H_STO] = &&L_H_STO,
+    [H_CAL] = &&L_H_CAL, [H_INC] = &&L_H_INC, [H_JMP] = &&L_H_JMP, [H_JPC] = &&L_H_JPC,
+    [H_LDL] = &&L_H_LDL, [H_STL] = &&L_H_STL, [H_LDG] = &&L_H_LDG, [H_STG] = &&L_H_STG,
+    [H_PRINT] = &&L_H_PRINT, [H_READ] = &&L_H_READ, [H_HALT] = &&L_H_HALT, [H_RTN] = &&L_H_RTN,
+    [H_ADD] = &&L_H_ADD, [H_SUB] = &&L_H_SUB, [H_MUL] = &&L_H_MUL, [H_DIV] = &&L_H_DIV,
+    [H_EQL] = &&L_H_EQL, [H_NEQ] = &&L_H_NEQ, [H_LSS] = &&L_H_LSS, [H_LEQ] = &&L_H_LEQ,
+    [H_GTR] = &&L_H_GTR, [H_GEQ] = &&L_H_GEQ, [H_EVEN] = &&L_H_EVEN, [H_DUP] = &&L_H_DUP,
+    [H_BADOPR] = &&L_H_BADOPR,
+#if CACHE_TOS
+    [H_LIT_EMPTY] = &&L_H_LIT_EMPTY, [H_LOD_EMPTY] = &&L_H_LOD_EMPTY, [H_LDL_EMPTY] = &&L_H_LDL_EMPTY,
+    [H_LDG_EMPTY] = &&L_H_LDG_EMPTY, [H_READ_EMPTY] = &&L_H_READ_EMPTY, [H_STO_EMPTY] = &&L_H_STO_EMPTY,
+    [H_STL_EMPTY] = &&L_H_STL_EMPTY, [H_STG_EMPTY] = &&L_H_STG_EMPTY, [H_JPC_EMPTY] = &&L_H_JPC_EMPTY,
+    [H_PRINT_EMPTY] = &&L_H_PRINT_EMPTY, [H_CAL_EMPTY] = &&L_H_CAL_EMPTY,
+#endif
+#if TRACE_MODE == TRACE_NONE && VERIFIED
+    [H_BRANCH_EQL] = &&L_H_BRANCH_EQL, [H_BRANCH_NEQ] = &&L_H_BRANCH_NEQ, [H_BRANCH_LSS] = &&L_H_BRANCH_LSS,
+    [H_BRANCH_LEQ] = &&L_H_BRANCH_LEQ, [H_BRANCH_GTR] = &&L_H_BRANCH_GTR, [H_BRANCH_GEQ] = &&L_H_BRANCH_GEQ,
+    [H_ADD_CONST] = &&L_H_ADD_CONST, [H_ADD_CONST_JMP] = &&L_H_ADD_CONST_JMP, [H_ADD_LOCALS] = &&L_H_ADD_LOCALS,
+    [H_COPY_LOCAL] = &&L_H_COPY_LOCAL, [H_SET_LOCAL] = &&L_H_SET_LOCAL
+#endif
+  };
+
+  //only when another loop (or a rewrite of code) filled them since
+  if(vm->threadedLabels != labels)
+  {
+    for(int i=0; i<=vm->codeLength; ++i)
+      code[i].target = labels[code[i].handler];
+    vm->threadedLabels = labels;
+  }
+
+#define HANDLER(h) L_##h:
+#define DISPATCH() goto *(ir = ip++)->target
+#else
+#define HANDLER(h) case h:
+#define DISPATCH() goto dispatch
+#endif
+
+//SP, BP, and PC are only written back when something outside the loop looks at them
+#if TRACE_MODE == TRACE_PROFILE
+#define SYNC() do { vm->SP = sp; vm->BP = bp; vm->PC = CODE_ADDRESS(ip - code); vm->fuel = fuel; profileExecuted = executed; } while(0)
+#else
+#define SYNC() do { vm->SP = sp; vm->BP = bp; vm->PC = CODE_ADDRESS(ip - code); vm->fuel = fuel; } while(0)
+#endif
+
+#if STEPPED
+#define NEXT() do { if(--budget == 0) { SYNC(); return VM_RUNNING; } DISPATCH(); } while(0)
+#define WROTE(address)
+#define PRINTED(value)
+#elif TRACE_MODE == TRACE_TEXT
+#define NEXT() do { SYNC(); printTrace(vm, ir); DISPATCH(); } while(0)
+#define WROTE(address)
+#define PRINTED(value)
+#elif TRACE_MODE == TRACE_BINARY
+  int traceAddress = -1, traceValue = 0;
+#define NEXT() do { SYNC(); recordTrace(vm, ir, traceAddress, traceValue); traceAddress = -1; DISPATCH(); } while(0)
+#define WROTE(address) do { traceAddress = (address); traceValue = PAS[traceAddress]; } while(0)
+#define PRINTED(value) traceValue = (value)
+#elif TRACE_MODE == TRACE_PROFILE
+#define NEXT() do { ++executed; DISPATCH(); } while(0)
+#define WROTE(address)
+#define PRINTED(value)
+#else
+#define NEXT() DISPATCH()
+#define WROTE(address)
+#define PRINTED(value)
+#endif
+
+#if TRACE_MODE == TRACE_PROFILE
+#define FRAME_BASE(l) (++chainWalks[l], display[vm->depth - (l)]) //the walk base() would have done
+#elif VERIFIED
+#define FRAME_BASE(l) display[vm->depth - (l)]
+#else
+#define FRAME_BASE(l) frameBase(vm, bp, l)
+#endif
+
+//With CACHE_TOS the top operand lives in tos and PAS[sp] is stale. When the
+//operand stack is empty PAS[sp] is a variable, so instructions that push onto
+//or pop back to an empty stack run the _EMPTY handlers picked by
+//specializeEmptyStack(), which neither spill nor refill. Otherwise only CAL
+//(spill) and RTN (refill) sync the cache, the verifier already guarantees
+//nothing else reads the operand stack.
+#if CACHE_TOS
+#define TOP tos
+#define PUSH(value) do { PAS[sp] = tos; tos = (value); --sp; } while(0)
+#define DROP() tos = PAS[++sp]
+#define SPILL() PAS[sp] = tos
+#define FILL() tos = PAS[sp]
+#define BINARY(expr) do { tos = (expr); ++sp; NEXT(); } while(0)
+#else
+#define TOP PAS[sp]
+#define PUSH(value) do { PAS[sp-1] = (value); --sp; WROTE(sp); } while(0)
+#define DROP() ++sp
+#define SPILL()
+#define FILL()
+#define BINARY(expr) do { PAS[sp+1] = (expr); ++sp; WROTE(sp); NEXT(); } while(0)
+#endif
+#define SECOND PAS[sp+1]
+
+//counts an arrival at ip, loop heads and procedure entries with no operands
+//pending are where a run can switch tiers
+#if TIERED
+#define COUNT(arrived, threshold) do { \
+    if((arrived) && ++vm->hotness[ip - code] >= (threshold) && vm->height[ip - code] <= 0) { SYNC(); return TIER_UP; } \
+  } while(0)
+#else
+#define COUNT(arrived, threshold)
+#endif
+
+//a backward jump or call burns charge fuel, running out stops the run at the
+//instruction at, before it runs (see Fuel), with the top operand in PAS if
+//there is one so a snapshot can go on from there
+#if CACHE_TOS
+#define SPILL_AT(at) do { if(vm->height[(at) - code] > 0) SPILL(); } while(0)
+#else
+#define SPILL_AT(at)
+#endif
+#define BURN(at, charge) do { \
+    if(UNLIKELY((fuel -= (charge)) <= 0)) { \
+      const Decoded* resume = ip; \
+      ip = (at); \
+      SYNC(); \
+      SPILL_AT(ip); \
+      int burnt = refuel(vm); \
+      if(burnt) return burnt; \
+      fuel = vm->fuel; \
+      ip = resume; \
+    } \
+  } while(0)
+
+//control moved to ip other than by falling through, see Profiler
+#if TRACE_MODE == TRACE_PROFILE
+#define ARRIVED() ++profileArrivals[ip - code]
+#else
+#define ARRIVED()
+#endif
+
+  const Decoded* ip = code + CODE_INDEX(vm->PC);
+  const Decoded* ir;
+  int sp = vm->SP, bp = vm->BP;
+  long long fuel = vm->fuel; //see Fuel
+#if CACHE_TOS
+  int tos = PAS[sp]; //the top operand when a run resumes with some pending, unused otherwise
+#endif
+#if TRACE_MODE == TRACE_PROFILE
+  long long executed = profileExecuted; //in a register, a counter in memory would chain every instruction
+#endif
+#if STEPPED
+  long long budget = vm->budget;
+#endif
+  ARRIVED();
+
+  /*----- Main Loop -----*/
+#ifdef VM_THREADED_DISPATCH
+  DISPATCH();
+#else
+dispatch:
+  ir = ip++;
+  switch(ir->handler)
+  {
+#endif
+
+  HANDLER(H_LIT)
+    PUSH(ir->m);
+    NEXT();
+
+  HANDLER(H_LOD)
+    PUSH(PAS[FRAME_BASE(ir->l) - ir->m]);
+    NEXT();
+
+  HANDLER(H_STO)
+  {
+    int address = FRAME_BASE(ir->l) - ir->m;
+    PAS[address] = TOP;
+    DROP();
+    WROTE(address);
+  }
+    NEXT();
+
+  HANDLER(H_LDL)
+    PUSH(PAS[bp - ir->m]);
+    NEXT();
+
+  HANDLER(H_STL)
+    PAS[bp - ir->m] = TOP;
+    DROP();
+    WROTE(bp - ir->m);
+    NEXT();
+
+  HANDLER(H_LDG)
+    PUSH(PAS[GP - ir->m]);
+    NEXT();
+
+  HANDLER(H_STG)
+    PAS[GP - ir->m] = TOP;
+    DROP();
+    WROTE(GP - ir->m);
+    NEXT();
+
+#if CACHE_TOS
+  HANDLER(H_CAL)
+    SPILL();
+    goto call;
+
+  HANDLER(H_CAL_EMPTY)
+  call:
+#else
+  HANDLER(H_CAL)
+#endif
+  {
+    BURN(ir, 1);
+    if(vm->topARs == vm->maxDepth)
+    {
+      SYNC();
+      return STACK_OVERFLOW;
+    }
+
+    PAS[sp-1] = FRAME_BASE(ir->l);
+    PAS[sp-2] = bp;
+    PAS[sp-3] = CODE_ADDRESS(ip - code);
+    bp = sp - 1;
+    ip = ir->jump;
+    WROTE(bp); //the dynamic link and return address follow from the previous record
+
+    //the callee is one level deeper than the record its static link points at
+#if VERIFIED
+    int calleeDepth = vm->depth - ir->l + 1;
+#else
+    int calleeDepth = ir->l > vm->depth ? 0 : vm->depth - ir->l + 1;
+#endif
+    vm->savedDisplay[vm->topARs] = display[calleeDepth];
+    vm->savedDepth[vm->topARs] = vm->depth;
+    display[calleeDepth] = bp;
+    vm->depth = calleeDepth;
+
+    vm->ARS[vm->topARs] = bp;
+    vm->topARs++;
+#if TRACE_MODE == TRACE_PROFILE
+    ARRIVED();
+    profileCall(vm, ip - code, executed);
+#endif
+    COUNT(1, callThreshold);
+  }
+    NEXT();
+
+  HANDLER(H_RTN)
+  {
+    sp = bp + 1;
+    bp = PAS[sp-2];
+
+#if VERIFIED
+    ip = code + CODE_INDEX(PAS[sp-3]); //only CAL writes return addresses
+#else
+    //return addresses are data, so they are the only targets still checked at run time
+    int index = CODE_INDEX(PAS[sp-3]);
+    ip = (index >= 0 && index < vm->codeLength) ? code + index : code + vm->codeLength;
+#endif
+    vm->ARS[vm->topARs] = 0;
+    --vm->topARs;
+    display[vm->depth] = vm->savedDisplay[vm->topARs];
+    vm->depth = vm->savedDepth[vm->topARs];
+#if TRACE_MODE == TRACE_PROFILE
+    ARRIVED();
+    profileReturn(executed);
+#endif
+    FILL();
+  }
+    NEXT();
+
+  HANDLER(H_INC)
+    sp -= ir->m;
+#if VERIFIED
+    if(sp - ir->reserve < 0) //everything the frame will need, so the guard pages are never hit
+#else
+    if(sp < 0) //the guard page only catches pushes, a whole frame can jump past it
+#endif
+    {
+      SYNC();
+      return STACK_OVERFLOW;
+    }
+    NEXT();
+
+  HANDLER(H_JMP)
+    if(ir->jump <= ir)
+      BURN(ir, ir - ir->jump + 1);
+    ip = ir->jump;
+    ARRIVED();
+    COUNT(ip <= ir, loopThreshold); //backward jumps close loops
+    NEXT();
+
+  HANDLER(H_JPC)
+    if(TOP == 0)
+    {
+      if(ir->jump <= ir)
+        BURN(ir, ir - ir->jump + 1);
+      ip = ir->jump;
+    }
+    ARRIVED(); //taken or not, so the next instruction after a JPC never counts as falling through
+    DROP();
+    NEXT();
+
+  HANDLER(H_PRINT)
+    PRINTED(TOP);
+    writeOutput(vm, TOP);
+    DROP();
+    NEXT();
+
+  HANDLER(H_READ)
+#if STEPPED
+    if(!inputReady(vm))
+    {
+      ip = ir; //runs again on the next step
+      SYNC();
+      return VM_WAITING;
+    }
+#endif
+    PUSH(readInput(vm));
+    NEXT();
+
+  HANDLER(H_HALT)
+    SYNC();
+#if TRACE_MODE == TRACE_TEXT
+    printTrace(vm, ir);
+#elif TRACE_MODE == TRACE_BINARY
+    recordTrace(vm, ir, -1, 0);
+#elif TRACE_MODE == TRACE_PROFILE
+    ++profileExecuted;
+#endif
+    return 0;
+
+  HANDLER(H_ADD) BINARY(SECOND + TOP);
+  HANDLER(H_SUB) BINARY(SECOND - TOP);
+  HANDLER(H_MUL) BINARY(SECOND * TOP);
+#if STEPPED
+  //one instance dividing by zero stops with VM_ERROR instead of taking the
+  //others on its process down, and INT_MIN / -1 wraps instead of trapping
+  HANDLER(H_DIV)
+    if(TOP == 0)
+      return VM_ERROR;
+    BINARY(TOP == -1 ? (int)(0u - (unsigned int)SECOND) : SECOND / TOP);
+#else
+  HANDLER(H_DIV) BINARY(SECOND / TOP);
+#endif
+  HANDLER(H_EQL) BINARY(SECOND == TOP);
+  HANDLER(H_NEQ) BINARY(SECOND != TOP);
+  HANDLER(H_LSS) BINARY(SECOND < TOP);
+  HANDLER(H_LEQ) BINARY(SECOND <= TOP);
+  HANDLER(H_GTR) BINARY(SECOND > TOP);
+  HANDLER(H_GEQ) BINARY(SECOND >= TOP);
+
+  HANDLER(H_EVEN)
+    TOP = (TOP % 2 == 0);
+    WROTE(sp);
+    NEXT();
+
+  HANDLER(H_DUP)
+    PUSH(TOP);
+    NEXT();
+
+#if CACHE_TOS
+  HANDLER(H_LIT_EMPTY)
+    tos = ir->m;
+    --sp;
+    NEXT();
+
+  HANDLER(H_LOD_EMPTY)
+    tos = PAS[FRAME_BASE(ir->l) - ir->m];
+    --sp;
+    NEXT();
+
+  HANDLER(H_LDL_EMPTY)
+    tos = PAS[bp - ir->m];
+    --sp;
+    NEXT();
+
+  HANDLER(H_LDG_EMPTY)
+    tos = PAS[GP - ir->m];
+    --sp;
+    NEXT();
+
+  HANDLER(H_READ_EMPTY)
+    tos = readInput(vm);
+    --sp;
+    NEXT();
+
+  HANDLER(H_STO_EMPTY)
+    PAS[FRAME_BASE(ir->l) - ir->m] = tos;
+    ++sp;
+    NEXT();
+
+  HANDLER(H_STL_EMPTY)
+    PAS[bp - ir->m] = tos;
+    ++sp;
+    NEXT();
+
+  HANDLER(H_STG_EMPTY)
+    PAS[GP - ir->m] = tos;
+    ++sp;
+    NEXT();
+
+  HANDLER(H_JPC_EMPTY)
+    if(tos == 0)
+    {
+      if(ir->jump <= ir)
+        BURN(ir, ir - ir->jump + 1);
+      ip = ir->jump;
+    }
+    ARRIVED();
+    ++sp;
+    NEXT();
+
+  HANDLER(H_PRINT_EMPTY)
+    writeOutput(vm, tos);
+    ++sp;
+    NEXT();
+#endif
+
+#if TRACE_MODE == TRACE_NONE && VERIFIED
+  //superinstructions, ir[k] is the k-th instruction of the sequence
+  //a loop that would run out of fuel here goes on unfused from the second
+  //instruction, so it stops at the JPC with the comparison on the stack
+#if CACHE_TOS
+#define UNFUSE() do { tos = PAS[bp - ir->m]; --sp; ip = ir + 1; NEXT(); } while(0)
+#else
+#define UNFUSE() do { PAS[sp-1] = PAS[bp - ir->m]; --sp; ip = ir + 1; NEXT(); } while(0)
+#endif
+#define BRANCH(cmp) do { \
+    ip = (PAS[bp - ir->m] cmp PAS[bp - ir[1].m]) ? ir + 4 : ir[3].jump; \
+    if(ip <= ir + 3) \
+    { \
+      if(UNLIKELY(fuel <= ir + 4 - ip)) \
+        UNFUSE(); \
+      fuel -= ir + 4 - ip; \
+    } \
+    NEXT(); \
+  } while(0)
+  HANDLER(H_BRANCH_EQL) BRANCH(==);
+  HANDLER(H_BRANCH_NEQ) BRANCH(!=);
+  HANDLER(H_BRANCH_LSS) BRANCH(<);
+  HANDLER(H_BRANCH_LEQ) BRANCH(<=);
+  HANDLER(H_BRANCH_GTR) BRANCH(>);
+  HANDLER(H_BRANCH_GEQ) BRANCH(>=);
+#undef BRANCH
+#undef UNFUSE
+
+  HANDLER(H_ADD_CONST)
+    PAS[bp - ir[3].m] = PAS[bp - ir->m] + ir[1].m;
+    ip = ir + 4;
+    NEXT();
+
+  HANDLER(H_ADD_CONST_JMP)
+    PAS[bp - ir[3].m] = PAS[bp - ir->m] + ir[1].m;
+    if(ir[4].jump <= ir + 4)
+      BURN(ir + 4, ir + 5 - ir[4].jump); //stopping at the JMP, as unfused code would
+    ip = ir[4].jump;
+    NEXT();
+
+  HANDLER(H_ADD_LOCALS)
+    PAS[bp - ir[3].m] = PAS[bp - ir->m] + PAS[bp - ir[1].m];
+    ip = ir + 4;
+    NEXT();
+
+  HANDLER(H_COPY_LOCAL)
+    PAS[bp - ir[1].m] = PAS[bp - ir->m];
+    ip = ir + 2;
+    NEXT();
+
+  HANDLER(H_SET_LOCAL)
+    PAS[bp - ir[1].m] = ir->m;
+    ip = ir + 2;
+    NEXT();
+#endif
+
+  HANDLER(H_BADOPR)
+    fprintf(vm->output, "How did you get here? %d %d %d\n", ir->op, ir->l, ir->m);
+    return 1;
+
+  HANDLER(H_ILLEGAL)
+    return 1;
+
+#ifndef VM_THREADED_DISPATCH
+  }
+  return 1;
+#endif
+  /*----- Main Loop -----*/
+
+#undef HANDLER
+#undef DISPATCH
+#undef SYNC
+#undef NEXT
+#undef WROTE
+#undef PRINTED
+#undef FRAME_BASE
+#undef TOP
+#undef PUSH
+#undef DROP
+#undef SPILL
+#undef FILL
+#undef BINARY
+#undef SECOND
+#undef COUNT
+#undef BURN
+#undef SPILL_AT
+#undef ARRIVED
+}
+
+#undef RUN_FUNCTION
+#undef TRACE_MODE
+#undef VERIFIED
+#undef CACHE_TOS
+#undef TIERED
+#undef STEPPED
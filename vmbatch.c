@@ -0,0 +1,310 @@
+/*
+  Batch Runner
+
+  Runs many PM/0 programs, or one program against many inputs, on a pool of
+  threads. Every thread has its own VM (vm.h), so runs share nothing but the
+  job list.
+
+  To Compile:
+    gcc -O2 -std=c11 -pthread -DVM_LIBRARY -o vmbatch vmbatch.c vm.c
+
+  To Execute:
+    ./vmbatch [-j threads] [-s words] [-d calls] [-n instructions] [-e ms] [-u] [-b] [-i input] elf...
+    ./vmbatch [-j threads] [-s words] [-d calls] [-n instructions] [-e ms] [-u] [-b] [-w lanes] -p elf input...
+
+  Notes:
+    - The first form runs every elf file, all reading the -i file if given and
+      an empty input otherwise (READ gets 0). The second loads elf once per
+      thread and runs it once per input file
+    - Each run prints to its own buffer. When all are done they are written
+      in argument order, each after an "== name (status N)" line with the
+      status ./vm would exit with
+    - -j defaults to the number of online CPUs, -s, -d, -n, -e, -u, and -b are
+      as in ./vm, the limits apply to each run
+    - -w runs the inputs in lockstep, up to lanes of them at a time per thread
+      sharing one pass over the code with their data in vectors (vm_lanes.h).
+      The output is the same, except that a lane dividing by zero stops with
+      status 1 where ./vm would crash. Unverified (-u) programs, and any with
+      -n or -e, run one input at a time as without -w
+    - The run count and wall time go to stderr
+*/
+#define _DEFAULT_SOURCE //open_memstream and sysconf under -std=c11
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "vm.h"
+
+
+
+
+
+/*----- Jobs -----*/
+typedef struct Job
+{
+  const char* program;
+  const char* input; //NULL for an empty input
+  char* output;      //everything the run printed
+  size_t outputSize;
+  int status;
+}Job;
+
+Job* jobs;
+int jobCount;
+int nextJob;
+pthread_mutex_t jobLock = PTHREAD_MUTEX_INITIALIZER;
+
+//settings shared by every worker
+int memorySize = 500;
+int maxDepth = 100;
+int verified = 1;
+int lanes = 1; //-w
+int batch = 0; //-b
+long long instructionLimit = 0; //-n
+long long timeLimit = 0; //-e
+const char* sharedProgram; //-p
+
+//index of the first of up to _count jobs in a row to run, -1 once there are none left
+int takeJobs(int _count, int* _taken)
+{
+  pthread_mutex_lock(&jobLock);
+  int job = -1;
+  if(nextJob < jobCount)
+  {
+    job = nextJob;
+    *_taken = jobCount - nextJob < _count ? jobCount - nextJob : _count;
+    nextJob += *_taken;
+  }
+  pthread_mutex_unlock(&jobLock);
+  return job;
+}
+
+//the job's input and output buffer, 0 with the job failed if either won't open
+int openJob(Job* _job, FILE** _input, FILE** _output)
+{
+  *_output = open_memstream(&_job->output, &_job->outputSize);
+  *_input = fopen(_job->input != NULL ? _job->input : "/dev/null", "r");
+  if(*_output != NULL && *_input != NULL)
+    return 1;
+
+  if(*_output != NULL)
+  {
+    fprintf(*_output, "File unable to be opened\n");
+    fclose(*_output);
+  }
+  if(*_input != NULL)
+    fclose(*_input);
+  _job->status = VM_ERROR;
+  return 0;
+}
+
+void runJob(VM* vm, Job* _job)
+{
+  FILE* input;
+  FILE* output;
+  if(!openJob(_job, &input, &output))
+    return;
+
+  vm_io(vm, input, output);
+  if(sharedProgram == NULL && !vm_load(vm, _job->program, verified))
+    _job->status = VM_ERROR;
+  else
+    _job->status = vm_run(vm);
+
+  fclose(input);
+  fclose(output);
+}
+
+//-w, the shared program once per job on the lanes of one vm_run_lanes(), or
+//one job at a time when it can't
+void runLockstepJobs(VM* vm, Job* _jobs, int _count)
+{
+  FILE** inputs = malloc(_count*sizeof(FILE*));
+  FILE** outputs = malloc(_count*sizeof(FILE*));
+  int* results = malloc(_count*sizeof(int));
+  int* lane = malloc(_count*sizeof(int)); //job on each lane
+  int lanes = 0;
+  if(inputs == NULL || outputs == NULL || results == NULL || lane == NULL)
+    lanes = -1;
+  for(int j=0; j<_count && lanes != -1; ++j)
+  {
+    if(openJob(&_jobs[j], &inputs[lanes], &outputs[lanes]))
+      lane[lanes++] = j;
+  }
+
+  if(lanes == -1)
+  {
+    for(int j=0; j<_count; ++j)
+      runJob(vm, &_jobs[j]);
+  }
+  else if(lanes > 0 && vm_run_lanes(vm, lanes, inputs, outputs, results))
+  {
+    for(int k=0; k<lanes; ++k)
+      _jobs[lane[k]].status = results[k];
+  }
+  else
+  {
+    for(int k=0; k<lanes; ++k)
+    {
+      vm_io(vm, inputs[k], outputs[k]);
+      _jobs[lane[k]].status = vm_run(vm);
+    }
+  }
+
+  for(int k=0; k<lanes; ++k)
+  {
+    fclose(inputs[k]);
+    fclose(outputs[k]);
+  }
+  free(inputs);
+  free(outputs);
+  free(results);
+  free(lane);
+}
+
+void* worker(void* _unused)
+{
+  VM* vm = vm_create(memorySize, maxDepth);
+  if(vm == NULL)
+    return NULL;
+  vm_batch(vm, batch);
+  vm_limit(vm, instructionLimit, timeLimit);
+
+  //one program for every job, main already loaded it once to check it
+  if(sharedProgram != NULL && !vm_load(vm, sharedProgram, verified))
+  {
+    vm_destroy(vm);
+    return NULL;
+  }
+
+  int taken;
+  for(int j; (j = takeJobs(lanes, &taken)) != -1; )
+  {
+    if(lanes > 1)
+      runLockstepJobs(vm, &jobs[j], taken);
+    else
+      runJob(vm, &jobs[j]);
+  }
+
+  vm_destroy(vm);
+  return NULL;
+}
+/*----- Jobs -----*/
+
+
+
+double wallMilliseconds()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec*1e3 + now.tv_nsec/1e6;
+}
+
+int main(int argc, char* argv[])
+{
+  int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  const char* sharedInput = NULL;
+  int first = argc;
+  for(int i=1; i<argc; ++i)
+  {
+    if(strcmp(argv[i], "-u") == 0)
+      verified = 0;
+    else if(strcmp(argv[i], "-b") == 0)
+      batch = 1;
+    else if(argv[i][0] != '-')
+    {
+      first = i;
+      break;
+    }
+    else if(i + 1 == argc)
+      first = argc;
+    else if(strcmp(argv[i], "-j") == 0)
+      threads = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-s") == 0)
+      memorySize = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-d") == 0)
+      maxDepth = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-i") == 0)
+      sharedInput = argv[++i];
+    else if(strcmp(argv[i], "-p") == 0)
+      sharedProgram = argv[++i];
+    else if(strcmp(argv[i], "-w") == 0)
+      lanes = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-n") == 0)
+      instructionLimit = atoll(argv[++i]);
+    else if(strcmp(argv[i], "-e") == 0)
+      timeLimit = atoll(argv[++i]);
+    else
+    {
+      first = argc;
+      break;
+    }
+  }
+  if(first == argc || threads < 1 || memorySize < 4 || maxDepth < 1 || lanes < 1 || (lanes > 1 && sharedProgram == NULL) ||
+     instructionLimit < 0 || timeLimit < 0)
+  {
+    printf("Usage: ./vmbatch [-j threads] [-s words] [-d calls] [-n instructions] [-e ms] [-u] [-b] [-i input] elf...\n"
+           "       ./vmbatch [-j threads] [-s words] [-d calls] [-n instructions] [-e ms] [-u] [-b] [-w lanes] -p elf input...\n");
+    return 1;
+  }
+
+  //load errors of a shared program are reported once, here
+  if(sharedProgram != NULL)
+  {
+    VM* check = vm_create(memorySize, maxDepth);
+    if(check == NULL || !vm_load(check, sharedProgram, verified))
+    {
+      if(check == NULL)
+        printf("Unable to allocate %d words of memory\n", memorySize);
+      return 1;
+    }
+    vm_destroy(check);
+  }
+
+  jobCount = argc - first;
+  jobs = calloc(jobCount, sizeof(Job));
+  if(jobs == NULL)
+  {
+    printf("Unable to allocate %d jobs\n", jobCount);
+    return 1;
+  }
+  for(int j=0; j<jobCount; ++j)
+  {
+    jobs[j].program = sharedProgram != NULL ? sharedProgram : argv[first + j];
+    jobs[j].input = sharedProgram != NULL ? argv[first + j] : sharedInput;
+    jobs[j].status = VM_ERROR; //unless a worker gets to it
+  }
+  if(threads > jobCount)
+    threads = jobCount;
+
+  double start = wallMilliseconds();
+  pthread_t* pool = malloc(threads*sizeof(pthread_t));
+  int started = 0;
+  while(pool != NULL && started < threads && pthread_create(&pool[started], NULL, worker, NULL) == 0)
+    ++started;
+  if(started == 0)
+  {
+    printf("Unable to start a thread\n");
+    return 1;
+  }
+  for(int t=0; t<started; ++t)
+    pthread_join(pool[t], NULL);
+  double elapsed = wallMilliseconds() - start;
+
+  int failed = 0;
+  for(int j=0; j<jobCount; ++j)
+  {
+    printf("== %s (status %d)\n", argv[first + j], jobs[j].status);
+    if(jobs[j].output != NULL)
+      fwrite(jobs[j].output, 1, jobs[j].outputSize, stdout);
+    failed += jobs[j].status != VM_HALTED;
+    free(jobs[j].output);
+  }
+
+  fprintf(stderr, "%d runs (%d failed) on %d threads in %.3f ms\n", jobCount, failed, started, elapsed);
+  free(pool);
+  free(jobs);
+  return failed > 0;
+}
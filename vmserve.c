@@ -0,0 +1,476 @@
+/*
+  Instance Scheduler
+
+  Runs many PM/0 programs reading from pipes or sockets on a few threads.
+  Every instance has its own VM (vm.h) and is stepped a quantum at a time in
+  turn with the others on its thread. A READ whose input hasn't arrived
+  suspends its instance instead of blocking the thread, and epoll wakes the
+  instance again once there is more input, so a thread only ever sleeps
+  when all of its instances are waiting.
+
+  To Compile:
+    gcc -O2 -std=c11 -pthread -DVM_LIBRARY -o vmserve vmserve.c vm.c
+
+  To Execute:
+    ./vmserve [-t threads] [-q steps] [-s words] [-d calls] [-n instructions] [-e ms] [-u] [-b] -p elf -l socket
+    ./vmserve [-t threads] [-q steps] [-s words] [-d calls] [-n instructions] [-e ms] [-u] [-b] -p elf -c clients input
+
+  Notes:
+    - The first form listens on the Unix socket at path socket and runs elf
+      once per connection, reading from it and printing back to it, until
+      killed
+    - The second is a local stand-in for a server full of slow clients: each
+      of the clients instances reads through its own pipe, and a feeder
+      thread writes input into the pipes one line per instance in turn. When
+      all are done their outputs are printed in order, each after an
+      "== client k (status N)" line as in vmbatch
+    - -t defaults to 1, -q is how many instructions an instance runs before
+      the next one gets a turn (default 10000), -s, -d, -n, -e, -u, and -b
+      are as in ./vm. The -e clock starts when the client connects, so time
+      spent waiting for its input counts
+    - An instance's output is flushed when it waits for input and when it
+      ends. Writes to a client that isn't reading block the whole thread
+    - The instance count and wall time go to stderr
+*/
+#define _DEFAULT_SOURCE //open_memstream and fdopen under -std=c11
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "vm.h"
+
+
+
+
+
+/*----- Instances -----*/
+typedef struct Instance
+{
+  VM* vm;
+  int fd; //input, a socket or the read end of a pipe, -1 once it's closed
+  FILE* output;
+  char* outputData; //-c, everything the instance printed
+  size_t outputSize;
+  int waiting; //suspended at a READ
+  int status;
+  struct Instance* next; //in its scheduler's ready queue
+}Instance;
+
+//one per thread, nothing in it is touched by another
+typedef struct Scheduler
+{
+  int epoll;
+  Instance* head; //ready to step, in turn
+  Instance* tail;
+  int live; //instances that haven't ended
+  pthread_t thread;
+}Scheduler;
+
+//settings shared by every scheduler
+int memorySize = 500;
+int maxDepth = 100;
+int verified = 1;
+int batch = 0;
+long long instructionLimit = 0;
+long long timeLimit = 0;
+long long quantum = 10000;
+const char* program;
+int listener = -1; //-l
+
+void makeReady(Scheduler* s, Instance* _instance)
+{
+  _instance->next = NULL;
+  if(s->tail != NULL)
+    s->tail->next = _instance;
+  else
+    s->head = _instance;
+  s->tail = _instance;
+}
+
+void endInstance(Scheduler* s, Instance* _instance, int _status)
+{
+  _instance->status = _status;
+  if(_instance->fd != -1)
+  {
+    epoll_ctl(s->epoll, EPOLL_CTL_DEL, _instance->fd, NULL);
+    close(_instance->fd);
+    _instance->fd = -1;
+  }
+  fclose(_instance->output);
+  vm_destroy(_instance->vm);
+  _instance->vm = NULL;
+  --s->live;
+
+  //-c reports it at the end
+  if(listener != -1)
+    free(_instance);
+}
+
+//the program on a fresh machine fed from fd, ready for its first step
+void startInstance(Scheduler* s, Instance* _instance, int _fd, FILE* _output)
+{
+  _instance->fd = _fd;
+  _instance->output = _output;
+  _instance->status = VM_ERROR;
+  ++s->live;
+
+  _instance->vm = vm_create(memorySize, maxDepth);
+  if(_instance->vm == NULL)
+  {
+    fprintf(_output, "Unable to allocate %d words of memory\n", memorySize);
+    endInstance(s, _instance, VM_ERROR);
+    return;
+  }
+  vm_io(_instance->vm, NULL, _output);
+  vm_batch(_instance->vm, batch);
+  vm_limit(_instance->vm, instructionLimit, timeLimit);
+  vm_feed(_instance->vm, "", 0); //READs wait for input from here on
+  if(!vm_load(_instance->vm, program, verified))
+  {
+    endInstance(s, _instance, VM_ERROR);
+    return;
+  }
+
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.ptr = _instance;
+  epoll_ctl(s->epoll, EPOLL_CTL_ADD, _fd, &event);
+  makeReady(s, _instance);
+}
+
+//fd has input, or has closed
+void feedInstance(Scheduler* s, Instance* _instance)
+{
+  char buffer[4096];
+  ssize_t got = read(_instance->fd, buffer, sizeof(buffer));
+  if(got > 0)
+    vm_feed(_instance->vm, buffer, got);
+  else if(got == 0 || (errno != EAGAIN && errno != EINTR))
+  {
+    vm_feed(_instance->vm, NULL, 0);
+    epoll_ctl(s->epoll, EPOLL_CTL_DEL, _instance->fd, NULL);
+    close(_instance->fd);
+    _instance->fd = -1;
+  }
+  else
+    return;
+
+  if(_instance->waiting)
+  {
+    _instance->waiting = 0;
+    makeReady(s, _instance);
+  }
+}
+
+//-l, every connection waiting on the listening socket
+void acceptClients(Scheduler* s)
+{
+  int fd;
+  while((fd = accept(listener, NULL, NULL)) != -1)
+  {
+    //a second descriptor for output, fclose() closes it and endInstance() the first
+    int out = dup(fd);
+    FILE* output = out != -1 ? fdopen(out, "w") : NULL;
+    Instance* instance = calloc(1, sizeof(Instance));
+    if(output == NULL || instance == NULL)
+    {
+      if(output != NULL)
+        fclose(output);
+      else if(out != -1)
+        close(out);
+      close(fd);
+      free(instance);
+      continue;
+    }
+    startInstance(s, instance, fd, output);
+  }
+}
+
+void* schedule(void* _scheduler)
+{
+  Scheduler* s = _scheduler;
+  struct epoll_event events[64];
+  while(s->live > 0 || listener != -1)
+  {
+    //only sleeps when nothing is ready to step
+    int n = epoll_wait(s->epoll, events, 64, s->head != NULL ? 0 : -1);
+    for(int e=0; e<n; ++e)
+    {
+      if(events[e].data.ptr == NULL)
+        acceptClients(s);
+      else
+        feedInstance(s, events[e].data.ptr);
+    }
+
+    //a quantum for each instance ready now, those still running go to the back
+    Instance* ready = s->head;
+    s->head = s->tail = NULL;
+    while(ready != NULL)
+    {
+      Instance* instance = ready;
+      ready = ready->next;
+
+      int result = vm_step(instance->vm, quantum);
+      if(result == VM_RUNNING)
+        makeReady(s, instance);
+      else if(result == VM_WAITING)
+      {
+        instance->waiting = 1;
+        fflush(instance->output); //the prompt and anything before it
+      }
+      else
+        endInstance(s, instance, result);
+    }
+  }
+  return NULL;
+}
+/*----- Instances -----*/
+
+
+
+/*----- Feeder -----*/
+//-c, input written to every client's pipe a line at a time, round robin
+typedef struct Feeder
+{
+  const char* input; //the whole input file
+  size_t size;
+  int* pipes; //write ends
+  int count;
+}Feeder;
+
+void writeAll(int _fd, const char* _data, size_t _size)
+{
+  while(_size > 0)
+  {
+    ssize_t wrote = write(_fd, _data, _size);
+    if(wrote <= 0 && errno != EINTR)
+      return; //the instance ended without reading it all
+    if(wrote > 0)
+    {
+      _data += wrote;
+      _size -= wrote;
+    }
+  }
+}
+
+void* feed(void* _feeder)
+{
+  Feeder* f = _feeder;
+  size_t at = 0;
+  while(at < f->size)
+  {
+    const char* newline = memchr(f->input + at, '\n', f->size - at);
+    size_t length = newline != NULL ? (size_t)(newline - (f->input + at)) + 1 : f->size - at;
+    for(int k=0; k<f->count; ++k)
+      writeAll(f->pipes[k], f->input + at, length);
+    at += length;
+  }
+
+  for(int k=0; k<f->count; ++k)
+    close(f->pipes[k]);
+  return NULL;
+}
+/*----- Feeder -----*/
+
+
+
+double wallMilliseconds()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec*1e3 + now.tv_nsec/1e6;
+}
+
+//the whole file, NULL if it can't be read
+char* readFile(const char* _path, size_t* _size)
+{
+  FILE* fp = fopen(_path, "rb");
+  if(fp == NULL)
+    return NULL;
+  char* data = NULL;
+  size_t capacity = 0;
+  *_size = 0;
+  for(;;)
+  {
+    if(*_size == capacity)
+    {
+      capacity = capacity ? 2*capacity : 4096;
+      char* grown = realloc(data, capacity);
+      if(grown == NULL)
+        break;
+      data = grown;
+    }
+    size_t got = fread(data + *_size, 1, capacity - *_size, fp);
+    *_size += got;
+    if(got == 0)
+      break;
+  }
+  fclose(fp);
+  return data;
+}
+
+int main(int argc, char* argv[])
+{
+  int threads = 1;
+  int clients = 0;
+  const char* socketPath = NULL;
+  int valid = 1;
+  int first = argc;
+  for(int i=1; i<argc; ++i)
+  {
+    if(strcmp(argv[i], "-u") == 0)
+      verified = 0;
+    else if(strcmp(argv[i], "-b") == 0)
+      batch = 1;
+    else if(argv[i][0] != '-')
+    {
+      first = i;
+      break;
+    }
+    else if(i + 1 == argc)
+      valid = 0;
+    else if(strcmp(argv[i], "-t") == 0)
+      threads = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-q") == 0)
+      quantum = atoll(argv[++i]);
+    else if(strcmp(argv[i], "-s") == 0)
+      memorySize = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-d") == 0)
+      maxDepth = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-p") == 0)
+      program = argv[++i];
+    else if(strcmp(argv[i], "-l") == 0)
+      socketPath = argv[++i];
+    else if(strcmp(argv[i], "-c") == 0)
+      clients = atoi(argv[++i]);
+    else if(strcmp(argv[i], "-n") == 0)
+      instructionLimit = atoll(argv[++i]);
+    else if(strcmp(argv[i], "-e") == 0)
+      timeLimit = atoll(argv[++i]);
+    else
+      valid = 0;
+  }
+  if(!valid || program == NULL || threads < 1 || quantum < 1 || memorySize < 4 || maxDepth < 1 || instructionLimit < 0 || timeLimit < 0 ||
+     (socketPath != NULL) == (clients > 0) || (clients > 0 && first != argc - 1) || (socketPath != NULL && first != argc))
+  {
+    printf("Usage: ./vmserve [-t threads] [-q steps] [-s words] [-d calls] [-n instructions] [-e ms] [-u] [-b] -p elf -l socket\n"
+           "       ./vmserve [-t threads] [-q steps] [-s words] [-d calls] [-n instructions] [-e ms] [-u] [-b] -p elf -c clients input\n");
+    return 1;
+  }
+
+  //load errors are reported once, here
+  VM* check = vm_create(memorySize, maxDepth);
+  if(check == NULL || !vm_load(check, program, verified))
+  {
+    if(check == NULL)
+      printf("Unable to allocate %d words of memory\n", memorySize);
+    return 1;
+  }
+  vm_destroy(check);
+  signal(SIGPIPE, SIG_IGN); //a client that hung up fails the write instead
+
+  Scheduler* schedulers = calloc(threads, sizeof(Scheduler));
+  if(schedulers == NULL)
+  {
+    printf("Unable to allocate %d schedulers\n", threads);
+    return 1;
+  }
+  for(int t=0; t<threads; ++t)
+  {
+    schedulers[t].epoll = epoll_create1(0);
+    if(schedulers[t].epoll == -1)
+    {
+      printf("Unable to create an epoll instance\n");
+      return 1;
+    }
+  }
+
+  if(socketPath != NULL)
+  {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+    unlink(socketPath);
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listener == -1 || bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 128) != 0 ||
+       fcntl(listener, F_SETFL, O_NONBLOCK) != 0)
+    {
+      printf("Unable to listen on %s\n", socketPath);
+      return 1;
+    }
+
+    //every thread waits on it, a new connection wakes just one
+    for(int t=0; t<threads; ++t)
+    {
+      struct epoll_event event;
+      event.events = EPOLLIN | EPOLLEXCLUSIVE;
+      event.data.ptr = NULL;
+      epoll_ctl(schedulers[t].epoll, EPOLL_CTL_ADD, listener, &event);
+    }
+    for(int t=0; t<threads; ++t)
+      pthread_create(&schedulers[t].thread, NULL, schedule, &schedulers[t]);
+    for(int t=0; t<threads; ++t)
+      pthread_join(schedulers[t].thread, NULL);
+    return 0;
+  }
+
+  //-c: every instance is started before the threads are, so nothing is shared
+  Feeder feeder;
+  feeder.input = readFile(argv[first], &feeder.size);
+  feeder.count = clients;
+  feeder.pipes = malloc(clients*sizeof(int));
+  Instance* instances = calloc(clients, sizeof(Instance));
+  if(feeder.input == NULL || feeder.pipes == NULL || instances == NULL)
+  {
+    printf("File unable to be opened\n");
+    return 1;
+  }
+
+  double start = wallMilliseconds();
+  for(int k=0; k<clients; ++k)
+  {
+    int ends[2];
+    FILE* output = open_memstream(&instances[k].outputData, &instances[k].outputSize);
+    if(output == NULL || pipe(ends) != 0)
+    {
+      printf("Unable to start client %d\n", k);
+      return 1;
+    }
+    feeder.pipes[k] = ends[1];
+    startInstance(&schedulers[k % threads], &instances[k], ends[0], output);
+  }
+
+  pthread_t feederThread;
+  pthread_create(&feederThread, NULL, feed, &feeder);
+  for(int t=0; t<threads; ++t)
+    pthread_create(&schedulers[t].thread, NULL, schedule, &schedulers[t]);
+  for(int t=0; t<threads; ++t)
+    pthread_join(schedulers[t].thread, NULL);
+  pthread_join(feederThread, NULL);
+  double elapsed = wallMilliseconds() - start;
+
+  int failed = 0;
+  for(int k=0; k<clients; ++k)
+  {
+    printf("== client %d (status %d)\n", k, instances[k].status);
+    fwrite(instances[k].outputData, 1, instances[k].outputSize, stdout);
+    failed += instances[k].status != VM_HALTED;
+    free(instances[k].outputData);
+  }
+
+  fprintf(stderr, "%d instances (%d failed) on %d threads in %.3f ms\n", clients, failed, threads, elapsed);
+  free(instances);
+  free(feeder.pipes);
+  free((char*)feeder.input);
+  free(schedulers);
+  return failed > 0;
+}